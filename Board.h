@@ -69,6 +69,7 @@ extern "C" {
 #define Board_I2S0                   CC3220SF_LAUNCHXL_I2S0
 
 #define Board_PWM_IR_OUTPUT          CC3220SF_LAUNCHXL_PWM_IR_OUTPUT
+#define Board_PWM_IR_OUTPUT2         CC3220SF_LAUNCHXL_PWM_IR_OUTPUT2
 
 #define Board_SD0                    CC3220SF_LAUNCHXL_SD0
 
@@ -82,7 +83,7 @@ extern "C" {
 #define Board_SPI_SLAVE_READY        CC3220SF_LAUNCHXL_SPI_SLAVE_READY
 
 #define Board_EMITTER_TIMER          CC3220SF_LAUNCHXL_TIMER0
-#define Board_MISC_TIMER             CC3220SF_LAUNCHXL_TIMER1
+#define Board_WHEEL_TIMER            CC3220SF_LAUNCHXL_TIMER1
 
 #define Board_UART0                  CC3220SF_LAUNCHXL_UART0
 #define Board_UART1                  CC3220SF_LAUNCHXL_UART1
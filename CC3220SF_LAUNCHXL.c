@@ -68,7 +68,7 @@
  *  driver.
  */
 #ifndef TI_DRIVERS_UART_DMA
-#define TI_DRIVERS_UART_DMA 0
+#define TI_DRIVERS_UART_DMA 1
 #endif
 
 /*
@@ -454,6 +454,9 @@ PWMTimerCC32XX_Object pwmTimerCC3220SObjects[CC3220SF_LAUNCHXL_PWMCOUNT];
 const PWMTimerCC32XX_HWAttrsV2 pwmTimerCC3220SHWAttrs[CC3220SF_LAUNCHXL_PWMCOUNT] = {
     {    /* CC3220SF_LAUNCHXL_PWM_IR_OUTPUT Timer2B (GPIO 9 for IR LED output)*/
         .pwmPin = PWMTimerCC32XX_PIN_64
+    },
+    {    /* CC3220SF_LAUNCHXL_PWM_IR_OUTPUT2 Timer3B (GPIO 11 for a second IR LED output)*/
+        .pwmPin = PWMTimerCC32XX_PIN_02
     }
 };
 
@@ -462,6 +465,11 @@ const PWM_Config PWM_config[CC3220SF_LAUNCHXL_PWMCOUNT] = {
         .fxnTablePtr = &PWMTimerCC32XX_fxnTable,
         .object = &pwmTimerCC3220SObjects[CC3220SF_LAUNCHXL_PWM_IR_OUTPUT],
         .hwAttrs = &pwmTimerCC3220SHWAttrs[CC3220SF_LAUNCHXL_PWM_IR_OUTPUT]
+    },
+    {
+        .fxnTablePtr = &PWMTimerCC32XX_fxnTable,
+        .object = &pwmTimerCC3220SObjects[CC3220SF_LAUNCHXL_PWM_IR_OUTPUT2],
+        .hwAttrs = &pwmTimerCC3220SHWAttrs[CC3220SF_LAUNCHXL_PWM_IR_OUTPUT2]
     }
 };
 
@@ -121,6 +121,7 @@ typedef enum CC3220SF_LAUNCHXL_I2SName {
  */
 typedef enum CC3220SF_LAUNCHXL_PWMName {
     CC3220SF_LAUNCHXL_PWM_IR_OUTPUT = 0,
+    CC3220SF_LAUNCHXL_PWM_IR_OUTPUT2,
 
     CC3220SF_LAUNCHXL_PWMCOUNT
 } CC3220SF_LAUNCHXL_PWMName;
@@ -65,6 +65,7 @@ SECTIONS
 
     .data       : > SRAM
     .bss        : > SRAM
+    .noinit     : > SRAM, type=NOINIT
     .sysmem     : > SRAM
     .stack      : > SRAM(HIGH)
 
@@ -0,0 +1,46 @@
+/**
+ * This header file represents the admission control of received commands. Every client has
+ * two token buckets: one for interactive commands (sends and stopping a repeating send), and
+ * one shared by all other commands, where bulk commands (the button list, learning, deleting,
+ * batches and reports) cost more. A command is dropped if its bucket is empty, so a client
+ * flooding the board with bulk commands cannot hold up anyone's sends, not even its own.
+ * @file Admission.h
+ */
+
+#ifndef INC_ADMISSION_H_
+#define INC_ADMISSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ti/drivers/net/wifi/simplelink.h>
+
+#define ADMISSION_CLIENTS 8              // clients with buckets, the one idle the longest is dropped first
+#define ADMISSION_INTERACTIVE_RATE 20    // interactive tokens added per second
+#define ADMISSION_INTERACTIVE_BURST 20   // most interactive tokens a bucket holds
+#define ADMISSION_REQUEST_RATE 10        // tokens added per second for all other commands
+#define ADMISSION_REQUEST_BURST 20       // most tokens that bucket holds
+#define ADMISSION_BULK_COST 5            // tokens a bulk command takes, a normal one takes 1
+#define ADMISSION_TOKEN_SCALE 1000       // tokens are counted in thousandths, so they refill every millisecond
+
+typedef enum
+{
+    command_class_interactive, // run at once, ahead of anything deferred
+    command_class_normal,      // run at once
+    command_class_bulk,        // deferred until no interactive command is waiting
+    COMMAND_CLASS_COUNT
+} CommandClass;
+
+typedef struct
+{
+    uint32_t admitted[COMMAND_CLASS_COUNT];
+    uint32_t dropped[COMMAND_CLASS_COUNT]; // the bucket of the client was empty
+    uint32_t deferred;                     // bulk commands that waited for the bulk task
+    uint32_t deferDropped;                 // bulk commands dropped because too many were waiting
+} AdmissionStats;
+
+CommandClass admissionClassify(const char* command);
+bool admissionAdmit(const SlSockAddrIn_t* client, CommandClass commandClass);
+void admissionNoteDeferred(bool queued);
+void admissionGetStats(AdmissionStats* stats);
+
+#endif /* INC_ADMISSION_H_ */
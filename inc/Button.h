@@ -9,14 +9,18 @@
 #define INC_BUTTON_H_
 
 #include "Filesystem.h"
+#include "Task_Queue.h"
 
 #define BUTTON_TABLE_FILE "table_of_buttons"
+#define BUTTON_CHANNEL_FILE "button_channels" // one output channel byte per button index
 #define BUTTON_FILE_STRING "Button%d"
 #define BUTTON_TABLE_FILE_MAX_SIZE (_u32)8192
 #define BUTTON_SINGLE_FILE_MAX_SIZE (_u32)1024
 #define BUTTON_NAME_MAX_SIZE 32
 #define BUTTON_FILE_NAME_MAX_SIZE 10 // biggest value is "Button220"
 #define MAX_AMOUNT_OF_BUTTONS 220
+#define MACRO_CARRIER_FREQUENCY 0xFFFF // table entries with this carrier frequency hold a macro instead of an IR signal
+#define MAX_MACRO_STEPS 32
 
 typedef struct
 {
@@ -25,8 +29,16 @@ typedef struct
     _u16 buttonIndex;
 } ButtonTableEntry;
 
+// One step of a macro: the button to send and how long to wait after it before the next step
+typedef struct
+{
+    _u16 buttonIndex;
+    _u32 delay_ms;
+} MacroStep;
+
 void button_init();
 int createButton(const unsigned char* buttonName, _u16 buttonCarrierFrequency, SignalInterval* buttonSequence, _u16 sequenceSize);
+int createMacro(const unsigned char* macroName, MacroStep* steps, _u16 numSteps);
 int deleteButton(_u16 buttonIndex);
 int addButtonTableEntry(const unsigned char* buttonName, _u16 buttonCarrierFrequency);
 int deleteButtonTableEntry(_u16 buttonIndex);
@@ -35,6 +47,15 @@ int getButtonCarrierFrequency(_u16 buttonIndex);
 void getButtonName(_u16 buttonIndex, char* nameBuffer);
 ButtonTableEntry* retrieveButtonTableContents(const unsigned char* fileName, _u32 fileSize);
 SignalInterval* getButtonSignalInterval(_u16 buttonIndex);
+MacroStep* getMacroSteps(_u16 buttonIndex, _u16* numSteps);
+bool isButtonMacro(_u16 buttonIndex);
+int getButtonOutputChannel(_u16 buttonIndex);
+int setButtonOutputChannel(_u16 buttonIndex, _u8 channel);
 void deleteAllButtons();
+void buttonSetTableChangeTask(Task* task);
+_u16 getNumButtons();
+_u32 getButtonTableGeneration();
+void buttonTableBeginBatch();
+int buttonTableEndBatch();
 
 #endif /* INC_BUTTON_H_ */
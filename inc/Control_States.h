@@ -15,6 +15,24 @@
 #define DELETE_BUTTON_STR   "delete_button"
 #define SEND_BUTTON_STR     "send_button"
 #define CLEAR_BUTTONS_STR   "clear_all"
+#define EMITTER_STATS_STR   "emitter_stats"
+#define SET_CHANNEL_STR     "set_channel"
+#define ADD_MACRO_STR       "add_macro"
+#define SEND_MACRO_STR      "send_macro"
+#define SET_TIME_STR        "set_time"
+#define SEND_AT_STR         "send_at"
+#define SEND_AFTER_STR      "send_after"
+#define CANCEL_JOB_STR      "cancel_job"
+#define PROFILE_STATS_STR   "profile_stats"
+#define PROFILE_RESET_ARG   "reset"
+#define TRACE_DUMP_STR      "trace_dump"
+#define TRACE_LEVEL_STR     "trace_level"
+#define GLITCH_FILTER_STR   "glitch_filter"
+#define BOOT_STATS_STR      "boot_stats"
+#define POWER_POLICY_STR    "power_policy"
+#define PING_STR            "ping"
+#define BATCH_STR           "batch"
+#define ADMISSION_STATS_STR "admission_stats"
 
 typedef enum
 {
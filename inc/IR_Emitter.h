@@ -4,20 +4,106 @@
  * Authors: Max Kallenberger, Marcus Mueller
  *
  * Emitter LED is on GPIO 9 (PIN 64) (which is where the PWM timer sends its signal)
+ * A second emitter LED can be driven from GPIO 11 (PIN 2)
  */
 
 #ifndef INC_IR_EMITTER_H_
 #define INC_IR_EMITTER_H_
 
+#include <ti/drivers/PWM.h>
 #include "Signal_Interval.h"
+#include "Task_Queue.h"
 
 // Infrared LED control function shortcuts
 #define IR_LED_OFF() GPIO_write(Board_IR_OUTPUT_PIN, Board_GPIO_LED_OFF)
 #define IR_LED_ON() GPIO_write(Board_IR_OUTPUT_PIN, Board_GPIO_LED_ON)
 
 #define MAX_SEQUENCE_INDEX 128 // 7250
+#define EMITTER_TIMER_BASE TIMERA0_BASE // register base of Board_EMITTER_TIMER
+#define EMITTER_TICKS_PER_US 80 // the timer runs at the 80MHz system clock
+#define EMITTER_SETUP_PERIOD_US 100000 // the timer counts this down while a send is prepared
+#define EMITTER_PRECOMPILED_EDGES 3 // edges compiled before the first one starts, the rest follow while it is sent
+#define EMITTER_MAX_GAP_US 25000000 // longest silent interval, schedule times further apart than 2^31 ticks cannot be compared
+#define EMITTER_GAP_EDGES 4 // trailing gap edges needed for the longest gap allowed after a sequence
+#define EMITTER_EDGE_TABLE_SIZE ((2*MAX_SEQUENCE_INDEX) + EMITTER_GAP_EDGES) // room for a sequence with its repeats expanded and a trailing gap
+#define EMITTER_IDLE_PERIOD_US 100 // longest the timer counts while a channel waits to start or for its next edge to be compiled
+#define EMITTER_MIN_RELOAD_US 20 // shortest interval the timer is loaded with, so the interrupt always queues the next one in time
+#define EMITTER_CHANNEL_COUNT 2 // number of IR LED outputs that can send at the same time
+
+typedef struct
+{
+    uint32_t timerLoad; // interval timer load value (length of the interval in timer ticks)
+    uint32_t pwmMatch;  // PWM match register value that gates the carrier on or off
+} EmitterEdge;
+
+// Accuracy of the last sequence sent. Latencies are measured from the hardware timeout
+// that starts an interval to the moment the carrier is actually gated for it.
+typedef struct
+{
+    uint16_t edges;                 // number of intervals sent
+    uint32_t carrierStartLatency_ns; // time from the send call to the first interval starting
+    uint32_t carrierStopLatency_ns;  // latency of switching the carrier off after the last interval
+    uint32_t maxEdgeLatency_ns;      // worst latency of any interval
+    uint32_t maxIntervalError_ns;    // worst difference between a sent and a requested interval
+    int32_t cumulativeDrift_ns;      // how far the end of the sequence moved compared to its start
+} EmitterStats;
+
+typedef enum
+{
+    channel_idle,      // not sending
+    channel_preparing, // a send was requested and its edge table is being compiled
+    channel_pending,   // waiting for the interval timer to start it at its next timeout
+    channel_active     // sending
+} EmitterChannelState;
+
+// One IR LED output. Every channel has its own PWM carrier and edge table,
+// and all of them are stepped through by the one interval timer.
+typedef struct
+{
+    PWM_Handle pwmHandle;
+    uint32_t pwmMatchRegister;  // address of the PWM match register that gates the carrier
+    uint32_t pwmFrequency;
+    uint32_t pwmMatchOn;
+    uint32_t pwmMatchOff;
+    volatile EmitterChannelState state;
+
+    // Edge table and the schedule time of the edge at edgeIndex
+    EmitterEdge edgeTable[EMITTER_EDGE_TABLE_SIZE];
+    volatile uint16_t edgeCount;
+    volatile uint16_t edgeIndex;
+    volatile bool compiled; // the whole sequence is in the edge table, so running out of edges ends it
+    uint32_t nextEdgeTime;
+    uint64_t emissionTicks; // a sequence with its trailing gap can take longer than 32 bits of ticks
+    uint64_t sentTicks;     // length of the intervals gated so far, the one being sent included
+
+    // Cursor of the stored sequence being compiled into the edge table
+    SignalInterval* outputSequence;
+    uint16_t outputIndex;
+    uint16_t outputEnd;
+    uint16_t repeatStartIndex;
+    uint16_t repeatEndIndex;
+    uint32_t repeatGap;
+    uint32_t repeatsRemaining;
+    uint32_t trailingGap_us;
+
+    // Accuracy measurements and the completion event
+    uint32_t requestTime;
+    uint32_t sendStartLatency;
+    uint32_t firstEdgeLatency;
+    uint32_t lastEdgeLatency;
+    uint32_t maxEdgeLatency;
+    uint32_t maxIntervalError;
+    EmitterStats lastSendStats;
+    volatile bool completionPending;
+    uint32_t completionDuration_us;
+} EmitterChannel;
 
 void IR_Init_Emitter();
-void IRemitterSendButton(SignalInterval* button, uint16_t frequency);
+void IRemitterSendButton(uint8_t channel, SignalInterval* button, uint16_t frequency, uint32_t trailingGap_us);
+void IRgetEmitterStats(uint8_t channel, EmitterStats* stats);
+bool IRemitterBusy(uint8_t channel);
+bool IRemitterCompleted(uint8_t channel, uint32_t* duration_us);
+uint32_t IRemitterGetTimeUntilDone(uint8_t channel);
+void IRemitterSetCompletionTask(Task* task);
 
 #endif /* INC_IR_EMITTER_H_ */
@@ -10,6 +10,7 @@
 #define INC_IR_RECEIVER_H_
 
 #include "IR_Emitter.h"
+#include "Task_Queue.h"
 
 #define CAPTURE_MAX_US 16777215 // (2^24-1)
 #define TIME_PER_TICK 115 // Supposed to be 125E-10s for intervals at 80MHz,
@@ -21,6 +22,12 @@
 #define PWM_GAP 250000 // 25us between PWM edges
 #define E_10S_TO_SEC_SCALAR 10000000000 // E-10 to seconds
 #define E_10S_TO_US_SCALAR 10000 // E-10 to microseconds
+#define GLITCH_MIN_PULSE_US 100 // default shortest mark or silence accepted as part of a signal
+#define GLITCH_MAX_PULSE_US 500 // widest glitch filter allowed, shorter than the marks and spaces of real remotes
+#define GLITCH_MIN_EDGE_INTERVAL 30000 // 3us, edges closer than this are noise within a carrier period
+#define FRAME_GAP_MIN_US 8000 // silences at least this long separate repeated frames
+#define FRAME_MATCH_TOLERANCE_PCT 25 // intervals of two frames within 25% are treated as equal
+#define FRAME_MATCH_MIN_TOLERANCE_US 100
 
 
 typedef enum
@@ -29,6 +36,13 @@ typedef enum
     program
 } Receiver_Mode;
 
+typedef struct
+{
+    uint32_t rejectedMarks;  // carrier bursts too short to be part of a signal
+    uint32_t rejectedSpaces; // carrier dropouts too short to be a real silence
+    uint32_t rejectedEdges;  // edges too close together to be carrier edges
+} GlitchCounters;
+
 void IR_Init_Receiver();
 SignalInterval* getIRsequence(uint16_t* sequenceSize);
 uint16_t getIRcarrierFrequency();
@@ -37,5 +51,8 @@ void IRreceiverSetMode(Receiver_Mode mode);
 void IRstartEdgeDetectGPIO();
 void IRstopEdgeDetectGPIO();
 bool IRbuttonReady();
+void IRreceiverSetCaptureTask(Task* task);
+bool IRsetGlitchFilter(uint32_t minPulse_us);
+void IRgetGlitchCounters(GlitchCounters* counters);
 
 #endif /* INC_IR_RECEIVER_H_ */
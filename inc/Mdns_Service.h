@@ -0,0 +1,21 @@
+/**
+ * This header file represents the mDNS/DNS-SD advertisement of the command socket, so
+ * clients find the board without broadcasting discovering_ncir.
+ * @file Mdns_Service.h
+ */
+
+#ifndef INC_MDNS_SERVICE_H_
+#define INC_MDNS_SERVICE_H_
+
+#include <stdint.h>
+#include "Wifi.h"
+
+#define FIRMWARE_VERSION "1.5.0"
+#define MDNS_SERVICE_TYPE "._ncir._udp.local"
+#define MDNS_SERVICE_NAME_SIZE (DEVICE_NAME_LENGTH + sizeof(MDNS_SERVICE_TYPE))
+#define MDNS_TEXT_SIZE 96
+#define MDNS_SERVICE_TTL 120 // seconds
+
+int mdnsAdvertiseService(uint16_t port, uint16_t buttonCount, uint32_t tableGeneration);
+
+#endif /* INC_MDNS_SERVICE_H_ */
@@ -0,0 +1,101 @@
+/**
+ * This header file represents the timing probes of the firmware. Time is measured with
+ * the Cortex-M4 DWT cycle counter, which is also extended to a 64-bit monotonic clock.
+ * Probes can be used from interrupts and from the main loop.
+ * @file Profiler.h
+ */
+
+#ifndef INC_PROFILER_H_
+#define INC_PROFILER_H_
+
+#include <stdint.h>
+
+#define PROFILER_CYCLES_PER_US 80 // the cycle counter runs at the 80 MHz CPU clock
+#define PROFILER_WRAP_CHECK_MS 10000 // the 32-bit cycle counter wraps every 53.7 seconds
+
+// Cortex-M4 debug registers for the cycle counter
+#define PROFILER_DEMCR 0xE000EDFC
+#define PROFILER_DEMCR_TRCENA 0x01000000
+#define PROFILER_DWT_CTRL 0xE0001000
+#define PROFILER_DWT_CTRL_CYCCNTENA 0x00000001
+#define PROFILER_DWT_CYCCNT 0xE0001004
+
+// The host tests (tests/host) define their own cycle counter
+#ifndef PROFILER_CYCLES
+#define PROFILER_CYCLES() (*(volatile uint32_t*)PROFILER_DWT_CYCCNT)
+#endif
+
+// Time a block of code. Both have to be used in the same scope, with the same probe.
+#define PROFILE_BEGIN(probe) uint32_t probe##_start = PROFILER_CYCLES()
+#define PROFILE_END(probe) profilerRecord(probe, probe##_start)
+
+typedef enum
+{
+    probe_socket_wait,
+    probe_udp_command,
+    probe_button_name,
+    probe_button_carrier,
+    probe_button_channel,
+    probe_button_sequence,
+    probe_emitter_isr,
+    probe_capture_isr,
+    probe_passthru_isr,
+    probe_wheel_tick,
+    probe_task_wait_high,   // time from posting a task to running it, one probe per TaskPriority
+    probe_task_wait_normal,
+    probe_task_wait_low,
+    probe_command_always_on, // udp_command split by the power policy the datagram arrived under
+    probe_command_low_latency,
+    probe_command_normal,
+    probe_command_long_sleep,
+    PROFILER_PROBE_COUNT
+} ProfileProbe;
+
+#define BOOT_RECORD_MAGIC 0x424F4F54 // "BOOT", the retained boot record survived the reset
+#define BOOT_REPORT_SIZE 160
+
+// Start up milestones. Only the first time a phase is reached counts, the network
+// phases may be reached before storage as the NWP connects in the background.
+typedef enum
+{
+    boot_phase_board,        // Board_initGeneral and NoRTOS are done
+    boot_phase_ir,           // passthrough and sends work
+    boot_phase_nwp,          // sl_Start returned
+    boot_phase_storage,      // the buttons and scheduled sends are loaded
+    boot_phase_provisioning, // only reached when the board had to be provisioned
+    boot_phase_connected,    // associated with the AP
+    boot_phase_network,      // IP address acquired
+    boot_phase_serving,      // the command socket is bound
+    BOOT_PHASE_COUNT
+} BootPhase;
+
+// Kept in RAM that is not cleared at start up, so the phases a boot reached are still
+// known after a watchdog or core reset. A power-on or hibernate cycle loses it.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t bootCount;  // boots since the record was lost
+    uint32_t resetCause; // PRCMSysResetCauseGet: 0 power on, 4 MCU, 5 watchdog, 6 SOC, 7 hibernate
+    uint32_t phaseTimes_us[BOOT_PHASE_COUNT]; // 0 for phases not reached
+} BootRecord;
+
+typedef struct
+{
+    uint32_t count;
+    uint64_t totalCycles;
+    uint32_t maxCycles;
+} ProbeStats;
+
+void profilerStartClock();
+void profiler_init();
+uint64_t profilerGetTime_us();
+void profilerRecord(ProfileProbe probe, uint32_t startCycles);
+void profilerGetStats(ProfileProbe probe, ProbeStats* stats);
+void profilerReset();
+char* profilerCreateReport();
+void profilerPrint();
+void profilerBootPhase(BootPhase phase);
+uint32_t profilerGetBootTime_us(BootPhase phase);
+int profilerFormatBootReport(char* buffer, uint16_t size);
+
+#endif /* INC_PROFILER_H_ */
@@ -0,0 +1,45 @@
+/**
+ * This header file represents the cache of recent replies. A client can start a command
+ * with a sequence number ("#<seq>,<command>"), its replies then start with the same number.
+ * A retry of a command that was already received is answered from the cache, so a lost
+ * reply never makes the board run a command, e.g. send a button, twice. Only replies that
+ * fit one datagram are cached, a retry of a command that replied more than once gets
+ * REPLY_NOT_CACHED, and one of a command that ran without replying gets REPLY_COMMAND_DONE.
+ * @file Reply_Cache.h
+ */
+
+#ifndef INC_REPLY_CACHE_H_
+#define INC_REPLY_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ti/drivers/net/wifi/simplelink.h>
+
+#define REPLY_CACHE_CLIENTS 4     // clients with cached replies, the one idle the longest is dropped first
+#define REPLY_CACHE_DEPTH 4       // sequence numbers remembered per client
+#define REPLY_CACHE_REPLY_SIZE 80 // longer replies are not cached, a retry gets REPLY_NOT_CACHED instead
+#define REPLY_SEQ_PREFIX_SIZE 12  // "#4294967295,"
+#define REPLY_NOT_CACHED "reply_not_cached" // the client has to ask again with a new sequence number
+#define REPLY_COMMAND_DONE "command_done"   // the command ran, and had nothing to reply
+
+// Where a reply goes, and the sequence number of the command it answers
+typedef struct
+{
+    SlSockAddrIn_t addr;
+    uint32_t seq;
+    bool hasSeq;
+} ReplyAddr;
+
+typedef enum
+{
+    reply_cache_miss,    // a new command, it was added to the cache and has to be run
+    reply_cache_pending, // a retry of a command that has not replied yet
+    reply_cache_hit      // a retry of a command that has replied, the reply is returned
+} ReplyCacheResult;
+
+bool replyParseSeq(char** command, uint32_t* seq);
+ReplyCacheResult replyCacheCheck(const ReplyAddr* client, const char** reply, uint16_t* length);
+void replyCacheStore(const ReplyAddr* client, const char* reply, uint16_t length);
+void replyCacheComplete(const ReplyAddr* client);
+
+#endif /* INC_REPLY_CACHE_H_ */
@@ -0,0 +1,39 @@
+/**
+ * This header file represents the scheduled button sends. Jobs are kept in a min-heap
+ * ordered by due time, and the clock they are compared against is the timer wheel
+ * uptime. The queue is saved to flash so it survives resets.
+ * @file Scheduler.h
+ */
+
+#ifndef INC_SCHEDULER_H_
+#define INC_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHEDULER_MAX_JOBS 16
+#define SCHEDULER_JOB_FILE "scheduled_jobs"
+#define SCHEDULER_MISSED_GRACE_MS 60000 // one-shot jobs missed by more than this while powered off are dropped
+#define SCHEDULER_ERROR -1
+
+typedef struct
+{
+    uint64_t dueTime_ms; // Unix time of the next send in milliseconds
+    uint32_t period_ms;  // time between sends of a recurring job, 0 for a one-shot job
+    uint32_t jobId;
+    uint16_t buttonIndex;
+} ScheduledJob;
+
+void scheduler_init();
+void schedulerSetTime(uint64_t unixTime_ms);
+bool schedulerClockValid();
+uint64_t schedulerGetTime();
+int schedulerAddJob(uint16_t buttonIndex, uint64_t dueTime_ms, uint32_t period_ms);
+int schedulerCancelJob(uint32_t jobId);
+void schedulerCancelButtonJobs(uint16_t buttonIndex);
+void schedulerCancelAllJobs();
+bool schedulerGetDueJob(ScheduledJob* job);
+uint32_t schedulerGetTimeUntilDue();
+void schedulerJobDone(uint32_t jobId);
+
+#endif /* INC_SCHEDULER_H_ */
@@ -17,4 +17,9 @@ typedef struct {
     bool PWM;
 } SignalInterval;
 
+// A stored sequence may end its first frame with this marker instead of a zero time.
+// The marker is followed by the inter-frame gap, the number of repeats to send and
+// then the repeat code intervals (none if the whole frame repeats), ending with a zero time
+#define FRAME_REPEAT_MARKER 0xFFFFFFFF
+
 #endif /* INC_SIGNAL_INTERVAL_H_ */
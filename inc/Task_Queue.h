@@ -0,0 +1,47 @@
+/**
+ * This header file represents the cooperative tasks of the main loop. A task is a function
+ * that is posted to run once, from the main loop or from an interrupt, and then runs to
+ * completion. Posted tasks run highest priority first, in the order they were posted.
+ * The threaded build (TASK_THREADS) runs every priority from its own thread instead.
+ * @file Task_Queue.h
+ */
+
+#ifndef INC_TASK_QUEUE_H_
+#define INC_TASK_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    task_priority_high,   // IR sends, anything a user is waiting on to the microsecond
+    task_priority_normal, // commands and learning
+    task_priority_low,    // flash writes and reports that can wait for everything else
+    TASK_PRIORITY_COUNT
+} TaskPriority;
+
+struct Task;
+typedef void (*TaskFxn)(struct Task* task);
+
+typedef struct Task
+{
+    struct Task* next;   // next posted task of the same priority
+    TaskFxn function;
+    TaskPriority priority;
+    volatile bool posted;
+    uint32_t postCycles; // cycle counter when the task was posted, for the queueing latency probes
+} Task;
+
+void taskCreate(Task* task, TaskFxn function, TaskPriority priority);
+void taskPost(Task* task);
+bool taskPending();
+#ifdef TASK_THREADS
+void taskQueue_init();
+void taskWaitAndRun(TaskPriority priority);
+void taskLock();
+void taskUnlock();
+#else
+bool taskRunNext();
+#endif
+
+#endif /* INC_TASK_QUEUE_H_ */
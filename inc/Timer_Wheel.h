@@ -0,0 +1,46 @@
+/**
+ * This header file represents the software timers of the board. All timeouts share
+ * one periodic hardware timer, and are kept in a hierarchical timer wheel so that
+ * starting and stopping a timer takes the same time no matter how many are running.
+ * @file Timer_Wheel.h
+ */
+
+#ifndef INC_TIMER_WHEEL_H_
+#define INC_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMER_WHEEL_TICK_US 1000 // one tick per millisecond, timeouts are given in ticks
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+// Longest timeout the wheel can hold (about 4.6 hours), longer ones are shortened to it
+#define TIMER_WHEEL_MAX_MS ((1UL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1)
+
+struct WheelTimer;
+typedef void (*WheelTimerFxn)(struct WheelTimer* timer);
+
+typedef struct WheelLink
+{
+    struct WheelLink* next;
+    struct WheelLink* prev;
+} WheelLink;
+
+typedef struct WheelTimer
+{
+    WheelLink link;         // must stay first, the wheel slots are lists of links
+    uint32_t expiry;        // tick the timer fires on
+    uint32_t period;        // ticks between firings of a periodic timer, 0 for a one-shot timer
+    WheelTimerFxn callback; // called from the timer interrupt, may be NULL
+} WheelTimer;
+
+void timerWheel_init();
+void timerWheelStart(WheelTimer* timer, WheelTimerFxn callback, uint32_t timeout_ms, uint32_t period_ms);
+void timerWheelStop(WheelTimer* timer);
+bool timerWheelActive(WheelTimer* timer);
+uint32_t timerWheelGetTimeUntilNext();
+uint64_t timerWheelGetUptime();
+
+#endif /* INC_TIMER_WHEEL_H_ */
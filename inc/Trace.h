@@ -0,0 +1,91 @@
+/**
+ * This header file represents the binary trace log of the firmware. A trace call records
+ * its module, source file, level, source line, a timestamp and up to three raw arguments
+ * into a RAM ring, without formatting anything on the device. The format string is only
+ * read on the host by tools/trace_decode.py, which finds it in the source by file and
+ * line, so every trace call has to be written on a single line.
+ *
+ * A module can span several files. Every file that traces defines TRACE_FILE to its own
+ * TraceFile before it includes this header.
+ *
+ * Levels above TRACE_COMPILE_LEVEL are compiled out. The levels below it can be
+ * lowered per module at runtime with traceSetLevel.
+ * @file Trace.h
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_LEVEL_OFF   0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN  2
+#define TRACE_LEVEL_INFO  3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef TRACE_COMPILE_LEVEL
+#ifdef DEBUG_SESSION
+#define TRACE_COMPILE_LEVEL TRACE_LEVEL_DEBUG
+#else
+#define TRACE_COMPILE_LEVEL TRACE_LEVEL_INFO
+#endif
+#endif
+
+#define TRACE_BUFFER_WORDS 512 // a power of two, records that do not fit are dropped
+#define TRACE_MAX_ARGS 3
+
+// Header word of a record: module (4 bits), file (5), level (3), argument count (4), source line (16)
+#define TRACE_HEADER(module, level, nargs) \
+    (((uint32_t)(module) << 28) | ((uint32_t)(TRACE_FILE) << 23) | ((uint32_t)(level) << 20) | \
+     ((uint32_t)(nargs) << 16) | ((uint32_t)__LINE__ & 0xFFFF))
+
+// The level test folds away for levels above TRACE_COMPILE_LEVEL, the format string is never stored
+#define TRACE_ENABLED(module, level) (((level) <= TRACE_COMPILE_LEVEL) && ((level) <= traceLevels[(module)]))
+
+#define TRACE0(module, level, format) \
+    do { if (TRACE_ENABLED(module, level)) { traceRecord(TRACE_HEADER(module, level, 0), 0, 0, 0); } } while (0)
+#define TRACE1(module, level, format, a) \
+    do { if (TRACE_ENABLED(module, level)) { traceRecord(TRACE_HEADER(module, level, 1), (uint32_t)(a), 0, 0); } } while (0)
+#define TRACE2(module, level, format, a, b) \
+    do { if (TRACE_ENABLED(module, level)) { traceRecord(TRACE_HEADER(module, level, 2), (uint32_t)(a), (uint32_t)(b), 0); } } while (0)
+#define TRACE3(module, level, format, a, b, c) \
+    do { if (TRACE_ENABLED(module, level)) { traceRecord(TRACE_HEADER(module, level, 3), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); } } while (0)
+
+// The decoder reads the module names from this enum, in this order
+typedef enum
+{
+    trace_module_main,
+    trace_module_button,
+    trace_module_filesystem,
+    trace_module_emitter,
+    trace_module_receiver,
+    trace_module_scheduler,
+    trace_module_wifi,
+    TRACE_MODULE_COUNT // at most 16
+} TraceModule;
+
+// The files that trace, the decoder finds each one by the TRACE_FILE it defines
+typedef enum
+{
+    trace_file_main,
+    trace_file_admission,
+    trace_file_button,
+    trace_file_filesystem,
+    trace_file_mdns_service,
+    trace_file_reply_cache,
+    trace_file_scheduler,
+    trace_file_wifi,
+    TRACE_FILE_COUNT // at most 32
+} TraceFile;
+
+extern uint8_t traceLevels[TRACE_MODULE_COUNT];
+
+void trace_init();
+void traceRecord(uint32_t header, uint32_t a, uint32_t b, uint32_t c);
+bool traceSetLevel(uint8_t module, uint8_t level);
+uint16_t traceRead(uint32_t* words, uint16_t maxWords);
+uint32_t traceGetDropCount();
+
+#endif /* INC_TRACE_H_ */
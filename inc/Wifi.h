@@ -1,7 +1,7 @@
 /**
  * This header file utilizes TI and other custom firmware to implement WiFi provisioning
  * and general WiFi event control flow. wifi_init is called by the main program at
- * startup, and does not return until the board has connected to an AP.
+ * startup, the connection is then managed by the WiFi task in the background.
  * @file wifi.h
  * @date 3/10/2019
  * @author: Marcus Mueller
@@ -10,14 +10,24 @@
 #ifndef INC_WIFI_H_
 #define INC_WIFI_H_
 
+#include <stdint.h>
+#include "Task_Queue.h"
+
 // This is what we think is the error code for the SimpleLink driver is,
 // it is in the documentation, but it is not declared
 #define SL_EAGAIN -11
 #define PROVISIONING_INACTIVITY_TIMEOUT 3600
 #define NWP_STOP_TIMEOUT 1000
+#define PROVISION_TIMEOUT_MS 30000 // the board is reset after 20 of these without a provision
+#define PAIRING_BLINK_MS 1000
 #define DEVICE_NAME_LENGTH 33 // +1 for NULL char
 #define DEVICE_SSID_LENGTH 32
 #define DEFAULT_DEVICE_NAME "mysimplelink"
+#define POWER_POLICY_FILE "power_policy"
+#define POWER_BOOST_IDLE_MS 5000 // go back to the selected power policy after this long without commands
+#define LONG_SLEEP_MAX_MS 800    // longest radio sleep of the long sleep policy
+#define WIFI_BACKOFF_MIN_MS 10000  // first wait for a connection before the NWP is restarted
+#define WIFI_BACKOFF_MAX_MS 300000 // the wait doubles after every restart up to this
 
 // Pairing LED control function shortcuts
 #define PAIRING_LED_OFF() GPIO_write(Board_PAIRING_OUTPUT_PIN, Board_GPIO_LED_OFF)
@@ -26,8 +36,35 @@
 // Uncomment this line to use our SSID for the Access Point
 #define USE_NCIR_SSID
 
+typedef enum
+{
+    wifi_state_connecting,
+    wifi_state_provisioning,
+    wifi_state_connected,
+    wifi_state_reconnecting
+} WifiState;
+
+// Power policies of the radio, from most responsive to least power
+typedef enum
+{
+    power_policy_always_on,
+    power_policy_low_latency,
+    power_policy_normal,
+    power_policy_long_sleep,
+    POWER_POLICY_COUNT
+} PowerPolicy;
+
 void wifi_init();
+void wifiSetNetworkTask(Task* task);
+WifiState wifiGetState();
 int32_t simplelink_init(uint8_t const role);
 void resetBoard();
+void wifiLoadPowerPolicy();
+int wifiSetPowerPolicy(PowerPolicy policy);
+PowerPolicy wifiGetPowerPolicy();
+PowerPolicy wifiGetActivePowerPolicy();
+void wifiNoteActivity();
+int wifiParsePowerPolicy(const char* name);
+const char* wifiPowerPolicyName(PowerPolicy policy);
 
 #endif /* INC_WIFI_H_ */
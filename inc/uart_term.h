@@ -1,12 +1,19 @@
 #ifndef __UART_IF_H__
 #define __UART_IF_H__
 
+// Standard includes
+#include <stdint.h>
+
 // TI-Driver includes
 #include <ti/drivers/UART.h>
 #include "Board.h"
 
 //Defines
 
+#define LOG_BUFFER_SIZE   2048 // bytes waiting for the UART DMA, a power of two
+#define LOG_LINE_SIZE     256  // longest message, longer ones are truncated
+#define LOG_DMA_MAX_WRITE 1024 // longest single uDMA transfer
+
 #define UART_PRINT Report
 #define UART_GET   GetCmd
 #define DBG_PRINT  Report
@@ -34,4 +41,6 @@ char getch(void);
 
 void putch(char ch);
 
+uint32_t LogGetDropCount(void);
+
 #endif // __UART_IF_H__
@@ -0,0 +1,205 @@
+/**
+ * This file represents the admission control of received commands. The buckets refill
+ * with the uptime, so no timer has to run for them. Only used from the main loop.
+ * @file Admission.c
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "Admission.h"
+#include "Control_States.h"
+#include "Timer_Wheel.h"
+#define TRACE_FILE trace_file_admission
+#include "Trace.h"
+
+typedef struct
+{
+    uint32_t ip;
+    uint32_t lastUsed;          // admissionUseCount when the client last sent a command, 0 if the slot is free
+    uint32_t refilled_ms;       // uptime the buckets were last refilled at
+    uint32_t interactiveTokens; // in thousandths of a token
+    uint32_t requestTokens;
+} AdmissionClient;
+
+// Keywords of the interactive and bulk commands, anything else is a normal command
+static const char* interactiveCommands[] = {SEND_BUTTON_STR, SEND_MACRO_STR, CANCEL_JOB_STR};
+static const char* bulkCommands[] = {BUTTON_REFRESH_STR, ADD_BUTTON_STR, DELETE_BUTTON_STR, CLEAR_BUTTONS_STR,
+                                     ADD_MACRO_STR, PROFILE_STATS_STR, TRACE_DUMP_STR, BATCH_STR};
+
+static AdmissionClient admissionClients[ADMISSION_CLIENTS];
+static uint32_t admissionUseCount = 0;
+static AdmissionStats admissionStats = {0};
+
+static AdmissionClient* findClient(const SlSockAddrIn_t* client);
+static uint32_t refillBucket(uint32_t tokens, uint32_t elapsed_ms, uint32_t rate, uint32_t burst);
+static bool matchesCommand(const char* command, const char** keywords, uint8_t numKeywords);
+
+/**
+ * Finds the class of a command from its keyword
+ * @param command The command, without a sequence number
+ * @return The class of the command
+ */
+CommandClass admissionClassify(const char* command)
+{
+    CommandClass RetVal = command_class_normal;
+
+    if (matchesCommand(command, interactiveCommands, sizeof(interactiveCommands) / sizeof(interactiveCommands[0])))
+    {
+        RetVal = command_class_interactive;
+    }
+    else if (matchesCommand(command, bulkCommands, sizeof(bulkCommands) / sizeof(bulkCommands[0])))
+    {
+        RetVal = command_class_bulk;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Takes the tokens of a command from the buckets of its client
+ * @param client The address of the client
+ * @param commandClass The class of the command
+ * @return true if the command may run, false if it has to be dropped
+ */
+bool admissionAdmit(const SlSockAddrIn_t* client, CommandClass commandClass)
+{
+    bool RetVal = false;
+    AdmissionClient* admissionClient = findClient(client);
+
+    // Refill both buckets for the time since the client was last seen
+    uint32_t now_ms = (uint32_t)timerWheelGetUptime();
+    uint32_t elapsed_ms = now_ms - admissionClient->refilled_ms;
+    admissionClient->refilled_ms = now_ms;
+    admissionClient->interactiveTokens = refillBucket(admissionClient->interactiveTokens, elapsed_ms,
+                                                      ADMISSION_INTERACTIVE_RATE, ADMISSION_INTERACTIVE_BURST);
+    admissionClient->requestTokens = refillBucket(admissionClient->requestTokens, elapsed_ms,
+                                                  ADMISSION_REQUEST_RATE, ADMISSION_REQUEST_BURST);
+
+    uint32_t* tokens = (commandClass == command_class_interactive) ? &admissionClient->interactiveTokens : &admissionClient->requestTokens;
+    uint32_t cost = ((commandClass == command_class_bulk) ? ADMISSION_BULK_COST : 1) * ADMISSION_TOKEN_SCALE;
+
+    if (*tokens >= cost)
+    {
+        *tokens -= cost;
+        admissionStats.admitted[commandClass]++;
+        RetVal = true;
+    }
+    else
+    {
+        admissionStats.dropped[commandClass]++;
+        TRACE2(trace_module_main, TRACE_LEVEL_WARN, "command of class %u from %x dropped, no tokens left", commandClass, client->sin_addr.s_addr);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Counts a bulk command that was deferred to the bulk task
+ * @param queued true if it was queued, false if it was dropped because the queue was full
+ */
+void admissionNoteDeferred(bool queued)
+{
+    if (queued)
+    {
+        admissionStats.deferred++;
+    }
+    else
+    {
+        admissionStats.deferDropped++;
+        TRACE0(trace_module_main, TRACE_LEVEL_WARN, "bulk command dropped, the deferred queue is full");
+    }
+}
+
+/**
+ * Gets the admission counters since start up
+ * @param stats Filled with the counters
+ */
+void admissionGetStats(AdmissionStats* stats)
+{
+    *stats = admissionStats;
+}
+
+/**
+ * Finds the buckets of a client. A new client takes over the slot idle the longest, with full buckets.
+ * @param client The address of the client, only its IP counts so a client cannot refill by changing ports
+ * @return The slot of the client
+ */
+static AdmissionClient* findClient(const SlSockAddrIn_t* client)
+{
+    AdmissionClient* RetVal = NULL;
+    AdmissionClient* oldest = &admissionClients[0];
+
+    for (uint8_t i = 0; i < ADMISSION_CLIENTS; i++)
+    {
+        if ((admissionClients[i].lastUsed != 0) && (admissionClients[i].ip == client->sin_addr.s_addr))
+        {
+            RetVal = &admissionClients[i];
+            break;
+        }
+
+        if (admissionClients[i].lastUsed < oldest->lastUsed)
+        {
+            oldest = &admissionClients[i];
+        }
+    }
+
+    if (RetVal == NULL)
+    {
+        RetVal = oldest;
+        RetVal->ip = client->sin_addr.s_addr;
+        RetVal->refilled_ms = (uint32_t)timerWheelGetUptime();
+        RetVal->interactiveTokens = ADMISSION_INTERACTIVE_BURST * ADMISSION_TOKEN_SCALE;
+        RetVal->requestTokens = ADMISSION_REQUEST_BURST * ADMISSION_TOKEN_SCALE;
+    }
+    RetVal->lastUsed = ++admissionUseCount;
+
+    return RetVal;
+}
+
+/**
+ * Adds the tokens of the elapsed time to a bucket
+ * @param tokens The tokens in the bucket, in thousandths
+ * @param elapsed_ms The time since the bucket was last refilled
+ * @param rate The tokens added per second
+ * @param burst The most tokens the bucket holds
+ * @return The tokens in the bucket after the refill, in thousandths
+ */
+static uint32_t refillBucket(uint32_t tokens, uint32_t elapsed_ms, uint32_t rate, uint32_t burst)
+{
+    uint32_t max = burst * ADMISSION_TOKEN_SCALE;
+
+    // Past the time an empty bucket takes to fill, this also keeps the product below from overflowing
+    if (elapsed_ms >= ((burst * 1000) / rate))
+    {
+        tokens = max;
+    }
+    else
+    {
+        tokens += (elapsed_ms * rate * ADMISSION_TOKEN_SCALE) / 1000;
+    }
+
+    return (tokens < max) ? tokens : max;
+}
+
+/**
+ * Checks if a command starts with one of the keywords, in any case as runCommand takes them
+ * @param command The command
+ * @param keywords The keywords
+ * @param numKeywords The number of keywords
+ * @return true if the command starts with one of them
+ */
+static bool matchesCommand(const char* command, const char** keywords, uint8_t numKeywords)
+{
+    bool RetVal = false;
+
+    for (uint8_t i = 0; (i < numKeywords) && (command != NULL); i++)
+    {
+        if (strncasecmp(command, keywords[i], strlen(keywords[i])) == 0)
+        {
+            RetVal = true;
+            break;
+        }
+    }
+
+    return RetVal;
+}
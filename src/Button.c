@@ -11,6 +11,9 @@
 #include "Board.h"
 #include "Button.h"
 #include "Filesystem.h"
+#include "Profiler.h"
+#define TRACE_FILE trace_file_button
+#include "Trace.h"
 
 #ifdef DEBUG_SESSION
 #include "uart_term.h"
@@ -18,8 +21,30 @@
 
 
 static void initializeButtonTable();
+static int writeButtonFile(_u16 buttonIndex, const void* data, _u16 dataSize);
+static void deleteButtonFiles(_u16 buttonIndex);
 static void initNewButtonEntry(ButtonTableEntry* newButton, _u16 buttonNameMaxSize);
 static bool checkIdenticalButtonEntries(const unsigned char* newButtonName, ButtonTableEntry* buttonTableList, _u16 numButtonEntries);
+static void updateButtonTableSummary();
+static int getButtonTableSize();
+static int storeButtonTable(ButtonTableEntry* buttonTableList, _u32 tableSize);
+static bool readButtonTableEntry(_u16 buttonIndex, ButtonTableEntry* buttonEntry);
+
+// Summary of the button table that is advertised to clients, updated whenever the table is written
+static _u16 numButtons = 0;
+static _u32 tableGeneration = 0;
+static Task* tableChangeTask = NULL;
+
+// While a batch runs the table is kept in RAM, and only written to flash when the batch ends
+static bool tableBatch = false;
+static bool tableBatchDirty = false;
+static ButtonTableEntry* batchTable = NULL;
+static _u32 batchTableSize = 0;
+
+// Buttons deleted while a batch runs, one bit each. Their files are kept until the table
+// without them is written, and their indices are not reused before that, so a batch that
+// fails to save leaves every button whole.
+static _u8 batchDeletes[(MAX_AMOUNT_OF_BUTTONS / 8) + 1];
 
 /**
  * Initialize the file system button table
@@ -28,6 +53,35 @@ void button_init()
 {
     // Get button table of contents set up
     initializeButtonTable();
+    updateButtonTableSummary();
+}
+
+/**
+ * Sets the task that is posted whenever the contents of the button table change
+ * @param task The task to post
+ */
+void buttonSetTableChangeTask(Task* task)
+{
+    tableChangeTask = task;
+}
+
+/**
+ * Gets the number of buttons and macros in the button table
+ * @return The number of valid button table entries
+ */
+_u16 getNumButtons()
+{
+    return numButtons;
+}
+
+/**
+ * Gets the generation of the button table. It is a hash of the table contents, so a client
+ * that cached the button list can tell if it is still current, also across restarts.
+ * @return The generation of the button table
+ */
+_u32 getButtonTableGeneration()
+{
+    return tableGeneration;
 }
 
 /**
@@ -45,34 +99,44 @@ int createButton(const unsigned char* buttonName, _u16 buttonCarrierFrequency, S
     if (buttonName != NULL)
     {
         // Make sure the button name and IR sequence are not empty
-        if ((buttonName[0] != NULL) && (buttonSequence != NULL))
+        if ((buttonName[0] != '\0') && (buttonSequence != NULL))
         {
             int buttonIndex = addButtonTableEntry(buttonName, buttonCarrierFrequency);
 
             // Check if a valid index has been returned
             if (buttonIndex >= 0 && buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
             {
-                char sequenceFileName[BUTTON_FILE_NAME_MAX_SIZE];
-                memset(sequenceFileName, NULL, BUTTON_FILE_NAME_MAX_SIZE);
+                RetVal = writeButtonFile(buttonIndex, buttonSequence, sequenceSize);
+            }
+        }
+    }
 
-                // Form the new file name string
-                snprintf(sequenceFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
+    return RetVal;
+}
 
-                int fd = fsCreateFile((const unsigned char*)sequenceFileName, sequenceSize);
+/**
+ * Save a macro to flash. Macros are stored like buttons: an entry in the button table
+ * file, marked with MACRO_CARRIER_FREQUENCY, and a file holding the steps of the macro.
+ * @param macroName the name to save to the button table file
+ * @param steps the buttons and delays to run, in order
+ * @param numSteps the number of steps in the macro
+ * @return button index of the macro if OK, else FILE_IO_ERROR
+ */
+int createMacro(const unsigned char* macroName, MacroStep* steps, _u16 numSteps)
+{
+    int RetVal = FILE_IO_ERROR;
 
-                // Check if the file descriptor is valid
-                if (fd != FILE_IO_ERROR)
-                {
-                    // Write the sequence into storage
-                    fsWriteFile(fd, 0, sequenceSize, buttonSequence);
-                    fsCloseFile(fd);
-                    RetVal = buttonIndex;
-                }
-                // Something went seriously wrong, revert what was written
-                else
-                {
-                    deleteButtonTableEntry(buttonIndex);
-                }
+    if ((macroName != NULL) && (steps != NULL))
+    {
+        // Make sure the macro name and steps are not empty
+        if ((macroName[0] != '\0') && (numSteps > 0) && (numSteps <= MAX_MACRO_STEPS))
+        {
+            int buttonIndex = addButtonTableEntry(macroName, MACRO_CARRIER_FREQUENCY);
+
+            // Check if a valid index has been returned
+            if (buttonIndex >= 0 && buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
+            {
+                RetVal = writeButtonFile(buttonIndex, steps, numSteps * sizeof(MacroStep));
             }
         }
     }
@@ -81,7 +145,8 @@ int createButton(const unsigned char* buttonName, _u16 buttonCarrierFrequency, S
 }
 
 /**
- * Delete an IR sequence file and its corresponding button table entry from the system
+ * Delete an IR sequence file and its corresponding button table entry from the system.
+ * While a batch runs, the file is only deleted once the batch has written the table.
  * @param buttonIndex the button index to delete
  * @return 0 if OK, else FILE_IO_ERROR
  */
@@ -91,17 +156,22 @@ int deleteButton(_u16 buttonIndex)
 
     if (buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
     {
-        // Generate the file to delete
-        char sequenceFileName[BUTTON_FILE_NAME_MAX_SIZE];
-        memset(sequenceFileName, NULL, BUTTON_FILE_NAME_MAX_SIZE);
-
-        // Form the new file name string
-        snprintf(sequenceFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
+        if (tableBatch)
+        {
+            RetVal = deleteButtonTableEntry(buttonIndex);
 
-        fsDeleteFile((const unsigned char*)sequenceFileName);
+            if (RetVal != FILE_IO_ERROR)
+            {
+                batchDeletes[buttonIndex / 8] |= (1 << (buttonIndex % 8));
+            }
+        }
+        else
+        {
+            deleteButtonFiles(buttonIndex);
 
-        // Delete the table entry
-        RetVal = deleteButtonTableEntry(buttonIndex);
+            // Delete the table entry
+            RetVal = deleteButtonTableEntry(buttonIndex);
+        }
     }
 
     return RetVal;
@@ -113,7 +183,7 @@ int deleteButton(_u16 buttonIndex)
 void deleteAllButtons()
 {
     // Get the size of the file so we know how many entries we need to go through
-    int fileSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+    int fileSize = getButtonTableSize();
 
     int numButtons = fileSize/sizeof(ButtonTableEntry);
 
@@ -123,6 +193,13 @@ void deleteAllButtons()
         // Don't check for any errors, as we don't care if a button file doesn't exist at this point
         deleteButton(i-1);
     }
+
+    // Every button is back on the default output channel, in a batch each one is reset
+    // along with its file once the table is written
+    if (!tableBatch)
+    {
+        fsDeleteFile(BUTTON_CHANNEL_FILE);
+    }
 }
 
 /**
@@ -137,7 +214,7 @@ int deleteButtonTableEntry(_u16 buttonIndex)
     int RetVal = FILE_IO_ERROR;
 
     // Get the size of the file so we know how many entries we need to go through
-    int fileSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+    int fileSize = getButtonTableSize();
 
     // Check that the size of the button table file was found
     if (fileSize != FILE_IO_ERROR)
@@ -152,35 +229,34 @@ int deleteButtonTableEntry(_u16 buttonIndex)
             ButtonTableEntry* buttonTableList = retrieveButtonTableContents(BUTTON_TABLE_FILE, fileSize);
 
             // Check that the list is valid
-            if (buttonTableList != NULL && buttonTableList[buttonIndex].buttonName[0] != NULL)
+            if (buttonTableList != NULL && buttonTableList[buttonIndex].buttonName[0] != '\0')
             {
-                int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_write);
-                if (fd != FILE_IO_ERROR)
+                // Check to see if the button being deleted is the last button in the list,
+                // if so, don't even bother writing it to the file
+                if ((numEntries > 1) && (buttonIndex == numEntries-1))
                 {
-                    // Check to see if the button being deleted is the last button in the list,
-                    // if so, don't even bother writing it to the file
-                    if ((numEntries > 1) && (buttonIndex == numEntries-1))
-                    {
-                        fsWriteFile(fd, 0, (sizeof(ButtonTableEntry)*(numEntries-1)), buttonTableList);
-                    }
-                    else
-                    {
-                        // We are clear to erase the button index in memory
-                        memset(&buttonTableList[buttonIndex], NULL, sizeof(ButtonTableEntry));
-                        fsWriteFile(fd, 0, (sizeof(ButtonTableEntry)*numEntries), buttonTableList);
-                    }
-                    // Done writing, close the button table file
-                    fsCloseFile(fd);
-
-                    // Give an OK error condition
-                    RetVal = 0;
+                    RetVal = storeButtonTable(buttonTableList, (sizeof(ButtonTableEntry)*(numEntries-1)));
                 }
+                else
+                {
+                    // We are clear to erase the button index in memory
+                    memset(&buttonTableList[buttonIndex], 0, sizeof(ButtonTableEntry));
+                    RetVal = storeButtonTable(buttonTableList, (sizeof(ButtonTableEntry)*numEntries));
+                }
+            }
 
+            if (buttonTableList != NULL)
+            {
                 free(buttonTableList);
             }
         }
     }
 
+    if ((RetVal != FILE_IO_ERROR) && !tableBatch)
+    {
+        updateButtonTableSummary();
+    }
+
     return RetVal;
 }
 
@@ -202,7 +278,7 @@ int findNumButtonEntries(ButtonTableEntry* entryList, _u32 fileSize)
         for (int i = 0; i < numAllocatedEntries; i++)
         {
             // Check to make sure the first character of the entry button name is not zeroed out
-            if (entryList[i].buttonName[0] != NULL)
+            if (entryList[i].buttonName[0] != '\0')
             {
                 // This is a valid entry, increment the count
                 numValidEntries++;
@@ -228,7 +304,7 @@ int addButtonTableEntry(const unsigned char* buttonName, _u16 buttonCarrierFrequ
     ButtonTableEntry newButton;
 
     // Get the size of the file so we know how many entries we need to go through
-    int fileSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+    int fileSize = getButtonTableSize();
 
     if (fileSize != FILE_IO_ERROR)
     {
@@ -258,8 +334,10 @@ int addButtonTableEntry(const unsigned char* buttonName, _u16 buttonCarrierFrequ
                         // The index is decided automatically based on the position of the blank memory offset (starts at zero)
                         for (buttonIndex = 0; buttonIndex < numAllocatedEntries; buttonIndex++)
                         {
-                            // Check if the first character of the entry button name is NULL or 0xFF (depends on how the chip clears memory)
-                            if ((buttonTableList[buttonIndex].buttonName[0] == NULL) || (buttonTableList[buttonIndex].buttonName[0] == 0xFF))
+                            // Check if the first character of the entry button name is NULL or 0xFF (depends on how the chip clears memory).
+                            // An entry deleted in the running batch still has its file until the batch is written, so it is skipped.
+                            if (((buttonTableList[buttonIndex].buttonName[0] == '\0') || (buttonTableList[buttonIndex].buttonName[0] == 0xFF)) &&
+                                !(batchDeletes[buttonIndex / 8] & (1 << (buttonIndex % 8))))
                             {
                                 // We have found a valid place to put the new button! Break out
                                 break;
@@ -272,42 +350,42 @@ int addButtonTableEntry(const unsigned char* buttonName, _u16 buttonCarrierFrequ
                         newButton.irCarrierFrequency = buttonCarrierFrequency;
                         newButton.buttonIndex = buttonIndex;
 
-                        // At this point we have the full list of button entries and their locations. Opening a file for write means
-                        // we need to completely rewrite the entire file, but this is OK since we have all of the data
-                        int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_write);
-                        if (fd != FILE_IO_ERROR)
+                        // At this point we have the full list of button entries and their locations. Writing the table
+                        // means we need to completely rewrite the entire file, but this is OK since we have all of the data
+                        int status = FILE_IO_ERROR;
+
+                        // Create the new list in memory before writing it to storage
+                        // Check if the list has a blank spot and can stay the same size
+                        if (buttonIndex < numAllocatedEntries)
                         {
-                            // Create the new list in memory before writing it to storage
-                            // Check if the list has a blank spot and can stay the same size
-                            if (buttonIndex < numAllocatedEntries)
-                            {
-                                memcpy(&buttonTableList[buttonIndex], &newButton, sizeof(ButtonTableEntry));
+                            memcpy(&buttonTableList[buttonIndex], &newButton, sizeof(ButtonTableEntry));
 
-                                // Write the updated list
-                                fsWriteFile(fd, 0, (sizeof(ButtonTableEntry)*numAllocatedEntries), buttonTableList);
-                            }
-                            // We must make the list one button table entry larger
-                            else
-                            {
-                                ButtonTableEntry* newTable = malloc(sizeof(ButtonTableEntry)*(numAllocatedEntries+1));
+                            // Write the updated list
+                            status = storeButtonTable(buttonTableList, (sizeof(ButtonTableEntry)*numAllocatedEntries));
+                        }
+                        // We must make the list one button table entry larger, unless the entries deleted
+                        // in the batch leave no index for the button until the batch ends
+                        else if (buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
+                        {
+                            ButtonTableEntry* newTable = malloc(sizeof(ButtonTableEntry)*(numAllocatedEntries+1));
 
-                                if (newTable != NULL)
-                                {
-                                    // Copy the entire existing button table list into the new list
-                                    memcpy(newTable, buttonTableList, sizeof(ButtonTableEntry)*numAllocatedEntries);
+                            if (newTable != NULL)
+                            {
+                                // Copy the entire existing button table list into the new list
+                                memcpy(newTable, buttonTableList, sizeof(ButtonTableEntry)*numAllocatedEntries);
 
-                                    // Copy the new button entry to the end of the new list
-                                    memcpy(&newTable[buttonIndex], &newButton, sizeof(ButtonTableEntry));
+                                // Copy the new button entry to the end of the new list
+                                memcpy(&newTable[buttonIndex], &newButton, sizeof(ButtonTableEntry));
 
-                                    // Write the new list
-                                    fsWriteFile(fd, 0, (sizeof(ButtonTableEntry)*(numAllocatedEntries+1)), newTable);
+                                // Write the new list
+                                status = storeButtonTable(newTable, (sizeof(ButtonTableEntry)*(numAllocatedEntries+1)));
 
-                                    free(newTable);
-                                }
+                                free(newTable);
                             }
-                            // Done writing, close the button table file
-                            fsCloseFile(fd);
+                        }
 
+                        if (status != FILE_IO_ERROR)
+                        {
                             RetVal = buttonIndex;
                         }
                     }
@@ -328,20 +406,19 @@ int addButtonTableEntry(const unsigned char* buttonName, _u16 buttonCarrierFrequ
             newButton.irCarrierFrequency = buttonCarrierFrequency;
             newButton.buttonIndex = buttonIndex;
 
-            int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_write);
-            if (fd != FILE_IO_ERROR)
+            // Write the new entry
+            if (storeButtonTable(&newButton, sizeof(ButtonTableEntry)) != FILE_IO_ERROR)
             {
-                // Write the new entry
-                fsWriteFile(fd, 0, sizeof(ButtonTableEntry), (void*)&newButton);
-
-                // Done writing, close the button table file
-                fsCloseFile(fd);
-
                 RetVal = buttonIndex;
             }
         }
     }
 
+    if ((RetVal != FILE_IO_ERROR) && !tableBatch)
+    {
+        updateButtonTableSummary();
+    }
+
     return RetVal;
 }
 
@@ -362,8 +439,14 @@ ButtonTableEntry* retrieveButtonTableContents(const unsigned char* fileName, _u3
     {
         buttonTableList = malloc(fileSize);
 
+        // A batch keeps the current table in RAM, the file is not up to date until it ends
+        if ((buttonTableList != NULL) && tableBatch && (strcmp((const char*)fileName, BUTTON_TABLE_FILE) == 0))
+        {
+            memset(buttonTableList, 0, fileSize);
+            memcpy(buttonTableList, batchTable, (fileSize < batchTableSize) ? fileSize : batchTableSize);
+        }
         // Check if the memory was successfully reserved
-        if (buttonTableList != NULL)
+        else if (buttonTableList != NULL)
         {
             // Open the file for reading
             int fd = fsOpenFile(fileName, flash_read);
@@ -392,13 +475,14 @@ ButtonTableEntry* retrieveButtonTableContents(const unsigned char* fileName, _u3
  */
 SignalInterval* getButtonSignalInterval(_u16 buttonIndex)
 {
+    PROFILE_BEGIN(probe_button_sequence);
     SignalInterval* irSignal = NULL;
 
     if (buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
     {
         // Generate the file to delete
         char sequenceFileName[BUTTON_FILE_NAME_MAX_SIZE];
-        memset(sequenceFileName, NULL, BUTTON_FILE_NAME_MAX_SIZE);
+        memset(sequenceFileName, 0, BUTTON_FILE_NAME_MAX_SIZE);
 
         // Form the new file name string
         snprintf(sequenceFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
@@ -423,9 +507,68 @@ SignalInterval* getButtonSignalInterval(_u16 buttonIndex)
         }
     }
 
+    PROFILE_END(probe_button_sequence);
     return irSignal;
 }
 
+/**
+ * This function gets the steps of the macro at the given index
+ * @param buttonIndex the index of the macro
+ * @param numSteps filled with the number of steps read
+ * @return the allocated steps if OK (must be freed by the caller), else NULL
+ */
+MacroStep* getMacroSteps(_u16 buttonIndex, _u16* numSteps)
+{
+    MacroStep* steps = NULL;
+    *numSteps = 0;
+
+    if (isButtonMacro(buttonIndex))
+    {
+        char macroFileName[BUTTON_FILE_NAME_MAX_SIZE];
+        memset(macroFileName, 0, BUTTON_FILE_NAME_MAX_SIZE);
+
+        // Form the file name string
+        snprintf(macroFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
+
+        int fileSize = fsGetFileSizeInBytes((const unsigned char*)macroFileName);
+
+        if ((fileSize != FILE_IO_ERROR) && (fileSize >= sizeof(MacroStep)))
+        {
+            steps = malloc(fileSize);
+
+            if (steps != NULL)
+            {
+                // Open the file to read the macro steps
+                int fd = fsOpenFile((const unsigned char*)macroFileName, flash_read);
+
+                if (fd != FILE_IO_ERROR)
+                {
+                    fsReadFile(fd, steps, 0, fileSize);
+                    fsCloseFile(fd);
+                    *numSteps = fileSize / sizeof(MacroStep);
+                }
+                else
+                {
+                    free(steps);
+                    steps = NULL;
+                }
+            }
+        }
+    }
+
+    return steps;
+}
+
+/**
+ * This function checks if the button table entry at the given index holds a macro
+ * @param buttonIndex the index to check
+ * @return true if it is a macro, false if it is an IR button or empty
+ */
+bool isButtonMacro(_u16 buttonIndex)
+{
+    return (getButtonCarrierFrequency(buttonIndex) == MACRO_CARRIER_FREQUENCY);
+}
+
 /**
  * This function gets the IR carrier frequency of the button at the given index
  * @param buttonIndex the index to get the carrier frequency out of
@@ -433,84 +576,191 @@ SignalInterval* getButtonSignalInterval(_u16 buttonIndex)
  */
 int getButtonCarrierFrequency(_u16 buttonIndex)
 {
+    PROFILE_BEGIN(probe_button_carrier);
+    int RetVal = FILE_IO_ERROR;
+
+    ButtonTableEntry buttonEntry;
+
+    // Read in the button entry at that index
+    if (readButtonTableEntry(buttonIndex, &buttonEntry))
+    {
+        if (buttonEntry.irCarrierFrequency != 0)
+        {
+            RetVal = buttonEntry.irCarrierFrequency;
+        }
+    }
+
+    PROFILE_END(probe_button_carrier);
+    return RetVal;
+}
+
+/**
+ * This function gets the IR output channel the button at the given index is sent on.
+ * Buttons that were never bound to a channel are sent on channel 0.
+ * @param buttonIndex the index to get the output channel of
+ * @return the output channel if OK, else FILE_IO_ERROR
+ */
+int getButtonOutputChannel(_u16 buttonIndex)
+{
+    PROFILE_BEGIN(probe_button_channel);
     int RetVal = FILE_IO_ERROR;
 
     if (buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
     {
-        int tableSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+        RetVal = 0;
+        int fileSize = fsGetFileSizeInBytes(BUTTON_CHANNEL_FILE);
 
-        // Make sure the button table file contains valid data at this offset
-        if (tableSize >= ((buttonIndex+1)*sizeof(ButtonTableEntry)))
+        // Make sure the channel file contains an entry for this button
+        if ((fileSize != FILE_IO_ERROR) && (fileSize > buttonIndex))
         {
-            // Open the button table file for reading
-            int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_read);
+            int fd = fsOpenFile(BUTTON_CHANNEL_FILE, flash_read);
 
             if (fd != FILE_IO_ERROR)
             {
-                _u16 offset = (buttonIndex*sizeof(ButtonTableEntry));
-                ButtonTableEntry buttonEntry;
-                initNewButtonEntry(&buttonEntry, BUTTON_NAME_MAX_SIZE);
-
-                // Read in the button entry at that index
-                fsReadFile(fd, &buttonEntry, offset, sizeof(ButtonTableEntry));
+                _u8 channel = 0;
+                fsReadFile(fd, &channel, buttonIndex, sizeof(channel));
                 fsCloseFile(fd);
-
-                if (buttonEntry.irCarrierFrequency != 0)
-                {
-                    RetVal = buttonEntry.irCarrierFrequency;
-                }
+                RetVal = channel;
             }
         }
     }
 
+    PROFILE_END(probe_button_channel);
     return RetVal;
 }
 
 /**
- * This function gets the name of the IR button at the given index
- * @param buttonIndex the index to get the button name out of
- * @param nameBuffer the buffer to fill with the button name
+ * This function binds the button at the given index to an IR output channel
+ * @param buttonIndex the index of the button to bind
+ * @param channel the output channel to send the button on
+ * @return 0 if OK, else FILE_IO_ERROR
  */
-void getButtonName(_u16 buttonIndex, char* nameBuffer)
+int setButtonOutputChannel(_u16 buttonIndex, _u8 channel)
 {
-    bool error = true;
+    int RetVal = FILE_IO_ERROR;
 
-    if ((buttonIndex <= MAX_AMOUNT_OF_BUTTONS) && (nameBuffer != NULL))
+    if (buttonIndex <= MAX_AMOUNT_OF_BUTTONS)
     {
-        int tableSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+        _u8 channelList[MAX_AMOUNT_OF_BUTTONS+1];
+        memset(channelList, 0, sizeof(channelList));
 
-        // Make sure the button table file contains valid data at this offset
-        if (tableSize >= ((buttonIndex+1)*sizeof(ButtonTableEntry)))
+        // Keep the channels of all other buttons, the file is rewritten as a whole
+        int fileSize = fsGetFileSizeInBytes(BUTTON_CHANNEL_FILE);
+        if (fileSize != FILE_IO_ERROR)
         {
-            // Open the button table file for reading
-            int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_read);
+            int fd = fsOpenFile(BUTTON_CHANNEL_FILE, flash_read);
 
             if (fd != FILE_IO_ERROR)
             {
-                _u16 offset = (buttonIndex*sizeof(ButtonTableEntry));
-                ButtonTableEntry buttonEntry;
-                initNewButtonEntry(&buttonEntry, BUTTON_NAME_MAX_SIZE);
-
-                // Read in the button entry at that index
-                fsReadFile(fd, &buttonEntry, offset, sizeof(ButtonTableEntry));
+                fsReadFile(fd, channelList, 0, (fileSize < sizeof(channelList)) ? fileSize : sizeof(channelList));
                 fsCloseFile(fd);
+            }
+        }
 
-                // Make sure the button name is valid
-                if (buttonEntry.buttonName[0] != NULL)
-                {
-                    strncpy(nameBuffer, (char *)(buttonEntry.buttonName), BUTTON_NAME_MAX_SIZE);
+        channelList[buttonIndex] = channel;
 
-                    // Set OK error condition
-                    error = false;
-                }
-            }
+        int fd = fsCreateFile(BUTTON_CHANNEL_FILE, sizeof(channelList));
+
+        if (fd != FILE_IO_ERROR)
+        {
+            fsWriteFile(fd, 0, sizeof(channelList), channelList);
+            fsCloseFile(fd);
+            RetVal = 0;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * This function gets the name of the IR button at the given index
+ * @param buttonIndex the index to get the button name out of
+ * @param nameBuffer the buffer to fill with the button name
+ */
+void getButtonName(_u16 buttonIndex, char* nameBuffer)
+{
+    PROFILE_BEGIN(probe_button_name);
+    bool error = true;
+
+    ButtonTableEntry buttonEntry;
+
+    // Read in the button entry at that index
+    if ((nameBuffer != NULL) && readButtonTableEntry(buttonIndex, &buttonEntry))
+    {
+        // Make sure the button name is valid
+        if (buttonEntry.buttonName[0] != '\0')
+        {
+            strncpy(nameBuffer, (char *)(buttonEntry.buttonName), BUTTON_NAME_MAX_SIZE);
+
+            // Set OK error condition
+            error = false;
         }
     }
     // Check if the method did not finish correctly
     if (error)
     {
         // Make sure the first char in the input buffer is set to NULL to indicate failure
-        nameBuffer[0] = NULL;
+        nameBuffer[0] = '\0';
+    }
+
+    PROFILE_END(probe_button_name);
+}
+
+/**
+ * Writes the IR sequence or macro steps of a new button table entry to its own file.
+ * If the file cannot be created the table entry is removed again.
+ * @param buttonIndex the index of the new table entry
+ * @param data the data to store
+ * @param dataSize the size of the data in bytes
+ * @return button index if OK, else FILE_IO_ERROR
+ */
+static int writeButtonFile(_u16 buttonIndex, const void* data, _u16 dataSize)
+{
+    int RetVal = FILE_IO_ERROR;
+    char sequenceFileName[BUTTON_FILE_NAME_MAX_SIZE];
+    memset(sequenceFileName, 0, BUTTON_FILE_NAME_MAX_SIZE);
+
+    // Form the new file name string
+    snprintf(sequenceFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
+
+    int fd = fsCreateFile((const unsigned char*)sequenceFileName, dataSize);
+
+    // Check if the file descriptor is valid
+    if (fd != FILE_IO_ERROR)
+    {
+        // Write the data into storage
+        fsWriteFile(fd, 0, dataSize, data);
+        fsCloseFile(fd);
+        RetVal = buttonIndex;
+    }
+    // Something went seriously wrong, revert what was written
+    else
+    {
+        deleteButtonTableEntry(buttonIndex);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Deletes the IR sequence file of a button, and puts its index back on the default output channel
+ * @param buttonIndex the button index to delete the files of
+ */
+static void deleteButtonFiles(_u16 buttonIndex)
+{
+    // Generate the file to delete
+    char sequenceFileName[BUTTON_FILE_NAME_MAX_SIZE];
+    memset(sequenceFileName, 0, BUTTON_FILE_NAME_MAX_SIZE);
+
+    // Form the new file name string
+    snprintf(sequenceFileName, BUTTON_FILE_NAME_MAX_SIZE, BUTTON_FILE_STRING, buttonIndex);
+
+    fsDeleteFile((const unsigned char*)sequenceFileName);
+
+    // A new button at this index starts out on the default output channel
+    if (getButtonOutputChannel(buttonIndex) > 0)
+    {
+        setButtonOutputChannel(buttonIndex, 0);
     }
 }
 
@@ -534,6 +784,209 @@ static void initializeButtonTable()
     }
 }
 
+/**
+ * Starts a batch of button table changes. Until the batch ends, the table is only
+ * changed in RAM, so a batch of changes costs a single rewrite of the table file.
+ */
+void buttonTableBeginBatch()
+{
+    if (!tableBatch)
+    {
+        int fileSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+
+        batchTableSize = 0;
+        batchTable = NULL;
+        tableBatchDirty = false;
+        memset(batchDeletes, 0, sizeof(batchDeletes));
+
+        if ((fileSize == FILE_IO_ERROR) || (fileSize < (int)sizeof(ButtonTableEntry)))
+        {
+            // An empty table, it gets allocated with the first button
+            tableBatch = true;
+        }
+        else
+        {
+            batchTable = retrieveButtonTableContents(BUTTON_TABLE_FILE, fileSize);
+
+            // Without the RAM copy every change is written on its own, as outside of a batch
+            if (batchTable != NULL)
+            {
+                batchTableSize = fileSize;
+                tableBatch = true;
+            }
+        }
+    }
+}
+
+/**
+ * Ends a batch of button table changes and writes the table file if it changed. The files
+ * of the buttons the batch deleted are only deleted once the table was written.
+ * @return 0 if OK, else FILE_IO_ERROR
+ */
+int buttonTableEndBatch()
+{
+    int RetVal = 0;
+
+    if (tableBatch)
+    {
+        tableBatch = false;
+
+        if (tableBatchDirty)
+        {
+            RetVal = storeButtonTable(batchTable, batchTableSize);
+
+            for (_u16 i = 0; (RetVal == 0) && (i <= MAX_AMOUNT_OF_BUTTONS); i++)
+            {
+                if (batchDeletes[i / 8] & (1 << (i % 8)))
+                {
+                    deleteButtonFiles(i);
+                }
+            }
+            updateButtonTableSummary();
+        }
+
+        if (batchTable != NULL)
+        {
+            free(batchTable);
+            batchTable = NULL;
+        }
+        batchTableSize = 0;
+        memset(batchDeletes, 0, sizeof(batchDeletes));
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets the size of the button table, in RAM while a batch runs
+ * @return The size of the table in bytes, else FILE_IO_ERROR
+ */
+static int getButtonTableSize()
+{
+    return tableBatch ? (int)batchTableSize : fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+}
+
+/**
+ * Rewrites the button table file with the given list. While a batch runs, the list
+ * replaces the RAM copy instead, and the file is written when the batch ends.
+ * @param buttonTableList The new table
+ * @param tableSize The size of the table in bytes
+ * @return 0 if OK, else FILE_IO_ERROR
+ */
+static int storeButtonTable(ButtonTableEntry* buttonTableList, _u32 tableSize)
+{
+    int RetVal = FILE_IO_ERROR;
+
+    if (tableBatch)
+    {
+        ButtonTableEntry* newTable = (tableSize > batchTableSize) ? realloc(batchTable, tableSize) : batchTable;
+
+        if (newTable != NULL)
+        {
+            memcpy(newTable, buttonTableList, tableSize);
+            batchTable = newTable;
+            batchTableSize = tableSize;
+            tableBatchDirty = true;
+            RetVal = 0;
+        }
+    }
+    else
+    {
+        // Opening a file for write means the entire file is rewritten
+        int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_write);
+
+        if (fd != FILE_IO_ERROR)
+        {
+            fsWriteFile(fd, 0, tableSize, buttonTableList);
+
+            // Done writing, close the button table file
+            fsCloseFile(fd);
+            RetVal = 0;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Reads one entry of the button table, from RAM while a batch runs
+ * @param buttonIndex The index of the entry
+ * @param buttonEntry Filled with the entry
+ * @return true if the table holds an entry at the index
+ */
+static bool readButtonTableEntry(_u16 buttonIndex, ButtonTableEntry* buttonEntry)
+{
+    bool RetVal = false;
+    initNewButtonEntry(buttonEntry, BUTTON_NAME_MAX_SIZE);
+
+    // Make sure the button table contains valid data at this offset
+    if ((buttonIndex <= MAX_AMOUNT_OF_BUTTONS) && (getButtonTableSize() >= (int)((buttonIndex+1)*sizeof(ButtonTableEntry))))
+    {
+        if (tableBatch)
+        {
+            memcpy(buttonEntry, &batchTable[buttonIndex], sizeof(ButtonTableEntry));
+            RetVal = true;
+        }
+        else
+        {
+            // Open the button table file for reading
+            int fd = fsOpenFile(BUTTON_TABLE_FILE, flash_read);
+
+            if (fd != FILE_IO_ERROR)
+            {
+                _u16 offset = (buttonIndex*sizeof(ButtonTableEntry));
+
+                // Read in the button entry at that index
+                fsReadFile(fd, buttonEntry, offset, sizeof(ButtonTableEntry));
+                fsCloseFile(fd);
+                RetVal = true;
+            }
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Counts the buttons in the button table file and hashes its contents (FNV-1a) into the
+ * table generation. The table change task is posted if the generation changed.
+ */
+static void updateButtonTableSummary()
+{
+    _u16 count = 0;
+    _u32 generation = 2166136261u;
+
+    int fileSize = fsGetFileSizeInBytes(BUTTON_TABLE_FILE);
+
+    if ((fileSize != FILE_IO_ERROR) && (fileSize >= (int)sizeof(ButtonTableEntry)))
+    {
+        ButtonTableEntry* buttonTableList = retrieveButtonTableContents(BUTTON_TABLE_FILE, fileSize);
+
+        if (buttonTableList != NULL)
+        {
+            count = findNumButtonEntries(buttonTableList, fileSize);
+
+            const _u8* tableBytes = (const _u8*)buttonTableList;
+            for (int i = 0; i < fileSize; i++)
+            {
+                generation = (generation ^ tableBytes[i]) * 16777619u;
+            }
+
+            free(buttonTableList);
+        }
+    }
+
+    numButtons = count;
+    if (generation != tableGeneration)
+    {
+        tableGeneration = generation;
+        if (tableChangeTask != NULL)
+        {
+            taskPost(tableChangeTask);
+        }
+    }
+}
+
 /**
  * Helper function to set the memory of a new button entry all to 0
  * @param newButton the button table entry to initialize
@@ -541,7 +994,7 @@ static void initializeButtonTable()
  */
 static void initNewButtonEntry(ButtonTableEntry* newButton, _u16 buttonNameMaxSize)
 {
-    memset(newButton->buttonName, NULL, buttonNameMaxSize);
+    memset(newButton->buttonName, 0, buttonNameMaxSize);
     newButton->irCarrierFrequency = 0;
     newButton->buttonIndex = 0;
 }
@@ -564,6 +1017,7 @@ static bool checkIdenticalButtonEntries(const unsigned char* newButtonName, Butt
         {
             // We found a match, no need to keep looking through the list
             RetVal = true;
+            TRACE1(trace_module_button, TRACE_LEVEL_WARN, "add button: name already used by button %d", i);
 #ifdef DEBUG_SESSION
             UART_PRINT("Add button: the button name '%s' already exists in the button table. Abandoning add button...\r\n", newButtonName);
 #endif
@@ -34,6 +34,8 @@
 #include "Board.h"
 #include "Wifi.h"
 #include "Filesystem.h"
+#define TRACE_FILE trace_file_filesystem
+#include "Trace.h"
 
 #ifdef DEBUG_SESSION
 #include "uart_term.h"
@@ -268,6 +270,7 @@ int fsCreateFile(const unsigned char* fileName, _u32 maxFileSize)
     if(fd < 0)
     {
         // could not create file
+        TRACE1(trace_module_filesystem, TRACE_LEVEL_ERROR, "sl_FsOpen (Creation) error: %d", fd);
 #ifdef DEBUG_SESSION
         UART_PRINT("sl_FsOpen (Creation) error: %d\n\r", fd);
 #endif
@@ -301,6 +304,7 @@ int fsOpenFile(const unsigned char* fileName, flashOperation fileOp)
     if(fd < 0)
     {
         // could not open file
+        TRACE1(trace_module_filesystem, TRACE_LEVEL_WARN, "sl_FsOpen error: %d", fd);
 #ifdef DEBUG_SESSION
         UART_PRINT("sl_FsOpen error: %d\n\r", fd);
 #endif
@@ -333,6 +337,7 @@ int fsWriteFile(_i32 fileHandle, _u32 offset, _u32 length, const void* buffer)
                          length);
         if (RetVal <= 0)
         {
+            TRACE1(trace_module_filesystem, TRACE_LEVEL_ERROR, "sl_FsWrite error: %d", RetVal);
 #ifdef DEBUG_SESSION
             UART_PRINT("sl_FsWrite error:  %d\n\r" ,RetVal);
 #endif
@@ -458,9 +463,6 @@ bool fsCheckFileExists(const unsigned char* fileName)
  */
 void filesystem_init()
 {
-    GPIO_init();
-    SPI_init();
-
     // Initialization of the NWP needed for the file system
     simplelink_init(0);
 }
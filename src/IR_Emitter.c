@@ -3,7 +3,18 @@
  *
  * This is the control mechanism for repeating IR commands
  *
+ * Sequences are compiled into an edge table of timer loads and PWM match values. The
+ * timer reloads itself in hardware, but the interval timer interrupt copies the table
+ * into the registers: at every timeout it writes the match register of each channel with
+ * an edge due, which gates the carrier as late as the interrupt runs, and queues the next
+ * timer load. Every interval costs one interrupt.
+ * The table is not fed by uDMA. Peripheral scatter-gather could write both registers
+ * from one timeout, with a task list of the two writes for every edge, but the list
+ * would have to be built ahead for the merged schedule of both channels, and the
+ * interrupt is also what starts a pending channel and measures the edge latencies.
+ *
  * Emitter LED is on GPIO 9 (PIN 64) (which is where the PWM timer sends its signal)
+ * A second emitter LED can be driven from GPIO 11 (PIN 2)
  */
 
 #include <stdlib.h>
@@ -13,93 +24,617 @@
 #include <ti/drivers/PWM.h>
 // Timer Driver files
 #include <ti/drivers/Timer.h>
+// Interrupt masking while the thread and the interval timer hand channels over
+#include <ti/drivers/dpl/HwiP.h>
+// Timer register access (the SDK timer driver cannot change the period of a running timer)
+#include <ti/devices/cc32xx/inc/hw_types.h>
+#include <ti/devices/cc32xx/inc/hw_memmap.h>
+#include <ti/devices/cc32xx/inc/hw_timer.h>
 // Board Header file
 #include "Board.h"
 #include "IR_Emitter.h"
+#include "Profiler.h"
+#include "Task_Queue.h"
+
+// PWM output and carrier gating register of every channel
+static const uint_least8_t channelPWM[EMITTER_CHANNEL_COUNT] = {Board_PWM_IR_OUTPUT, Board_PWM_IR_OUTPUT2};
+static const uint32_t channelMatchRegister[EMITTER_CHANNEL_COUNT] =
+{
+    TIMERA2_BASE + TIMER_O_TBMATCHR, // Timer2B
+    TIMERA3_BASE + TIMER_O_TBMATCHR  // Timer3B
+};
 
-static PWM_Handle pwmHandle;
 static PWM_Params pwmParams;
-static Timer_Handle oneShotHandle;
-static Timer_Params oneShotParams;
-static SignalInterval* currentOutputSequence = 0;
-static uint16_t currentOutputIndex = 0;
-
-static void IRsetPWMperiod(uint32_t period);
-static void IRinitOneShotTimer();
-static void IRstartOneShotTimer();
+static Timer_Handle intervalTimerHandle;
+static Timer_Params intervalTimerParams;
+static EmitterChannel channels[EMITTER_CHANNEL_COUNT];
+static Task* completionTask = NULL;
+
+// The interval timer keeps one schedule for all channels. Times are in timer ticks
+// since the timer was started and only ever compared as differences, so they can wrap.
+static volatile bool scheduleRunning = false;
+static uint32_t scheduleEnd = 0;    // end of the interval the timer is counting down
+static uint32_t scheduleQueued = 0; // end of the interval queued up after it
+
+static void IRsetPWMperiod(EmitterChannel* ch, uint32_t period);
+static void IRinitIntervalTimer();
+static void IRstartIntervalTimer();
+static void IRstartFirstEdge(EmitterChannel* ch);
+static void IRqueueNextInterval();
+static void IRshortenInterval();
+static void IRserviceChannel(EmitterChannel* ch, uint32_t now, uint32_t latency);
 static void IRinitPWMtimer();
-static void IRstartPWMtimer();
-static void IRstopPWMtimer();
-static void IRsetOneShotTimeout(uint32_t time_in_us);
+static void IRstartPWMtimer(EmitterChannel* ch);
+static void IRstopPWMtimer(EmitterChannel* ch);
+static void IRloadRepeatInfo(EmitterChannel* ch, SignalInterval* sequence);
+static bool IRgetNextInterval(EmitterChannel* ch, SignalInterval* interval);
+static void IRstartEdgeTable(EmitterChannel* ch, SignalInterval* sequence);
+static void IRcompileEdges(EmitterChannel* ch, uint16_t limit);
+static uint32_t IRticksToNs(uint32_t ticks);
+static void IRsignalCompletion(EmitterChannel* ch, uint64_t ticks);
 
-void IRoneShotTimerHandler(Timer_Handle handle);
+void IRintervalTimerHandler(Timer_Handle handle);
 
 /**
- * Initialize PWM and one-shot timers to recreate stored IR signals
+ * Initialize the PWM and interval timers to recreate stored IR signals
  */
 void IR_Init_Emitter()
 {
     IRinitPWMtimer();
-    IRinitOneShotTimer();
+    IRinitIntervalTimer();
     // Set the IR LED off just to be sure it wasn't left on
     IR_LED_OFF();
 }
 
 /**
  * Start the send sequence needed to output a valid IR
- * command using a PWM output and a one-shot timer
+ * command using a PWM output and the interval timer.
+ * If other channels are already sending, the sequence starts at the next
+ * timeout of the interval timer so their timing is not disturbed.
+ * @param channel The output channel to send the IR signal on
  * @param button The SignalInterval that represents the IR signal to send
  * @param frequency The carrier frequency of the IR signal to send
+ * @param trailingGap_us Silence to keep the channel busy for after the signal, the completion event follows it
  */
-void IRemitterSendButton(SignalInterval* button, uint16_t frequency)
+void IRemitterSendButton(uint8_t channel, SignalInterval* button, uint16_t frequency, uint32_t trailingGap_us)
 {
-    currentOutputIndex = 0;
-    currentOutputSequence = button;
-    IRsetPWMperiod((uint32_t)frequency);
-    // set a default timeout to start the IR sequence outside of any interrupt
-    IRsetOneShotTimeout(50);
-    IRstartOneShotTimer();
+    if ((channel >= EMITTER_CHANNEL_COUNT) || (channels[channel].state != channel_idle))
+    {
+        free(button);
+        return;
+    }
+
+    EmitterChannel* ch = &channels[channel];
+    bool startTimer = false;
+
+    // Claim the channel, and the interval timer if no other channel is using it
+    uintptr_t key = HwiP_disable();
+    ch->state = channel_preparing;
+    ch->completionPending = false;
+    ch->compiled = false;
+    if (scheduleRunning == false)
+    {
+        // Start counting right away so the time until the first edge can be measured
+        scheduleRunning = true;
+        startTimer = true;
+        IRstartIntervalTimer();
+    }
+    else
+    {
+        ch->requestTime = scheduleEnd - HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV);
+    }
+    HwiP_restore(key);
+
+    // The PWM gating values depend on the carrier, so set it before compiling the table
+    IRsetPWMperiod(ch, (uint32_t)frequency);
+
+    // Only compile the first few edges before starting, the rest of the
+    // table is compiled while those are being sent
+    IRstartEdgeTable(ch, button);
+    ch->trailingGap_us = (trailingGap_us < (EMITTER_GAP_EDGES * EMITTER_MAX_GAP_US)) ? trailingGap_us : (EMITTER_GAP_EDGES * EMITTER_MAX_GAP_US);
+    IRcompileEdges(ch, EMITTER_PRECOMPILED_EDGES);
+    ch->sendStartLatency = 0;
+    ch->firstEdgeLatency = 0;
+    ch->maxEdgeLatency = 0;
+    ch->maxIntervalError = 0;
+    ch->lastEdgeLatency = 0;
+
+    if (ch->edgeCount > 0)
+    {
+        // The carrier runs for the whole sequence and is gated on and off through its duty cycle
+        IRstartPWMtimer(ch);
+        if (startTimer)
+        {
+            IRstartFirstEdge(ch);
+        }
+        else
+        {
+            // Start at the next timeout, and bring it forward if the timer is counting down a
+            // long interval of another channel. If the timer has just timed out, the interrupt
+            // that is about to run does that instead.
+            key = HwiP_disable();
+            ch->state = channel_pending;
+            if ((HWREG(EMITTER_TIMER_BASE + TIMER_O_RIS) & TIMER_RIS_TATORIS) == 0)
+            {
+                IRshortenInterval();
+                IRqueueNextInterval();
+            }
+            HwiP_restore(key);
+        }
+
+        IRcompileEdges(ch, EMITTER_EDGE_TABLE_SIZE);
+        ch->compiled = true;
+    }
+    else
+    {
+        // Nothing to send, so the emission is over before it started
+        key = HwiP_disable();
+        ch->state = channel_idle;
+        if (startTimer)
+        {
+            Timer_stop(intervalTimerHandle);
+            scheduleRunning = false;
+        }
+        HwiP_restore(key);
+        IRsignalCompletion(ch, 0);
+    }
+
+    // Everything the interrupt needs is in the edge table now
+    free(button);
 }
 
 /**
- *  ======== IRoneShotTimerHandler ========
- *  Callback function for the one-shot timer signal sending interrupt
+ *  ======== IRintervalTimerHandler ========
+ *  Callback function for the interval timer signal sending interrupt
  *  Loops through and IR timing sequence to output an IR signal through the IR emitter
+ *
+ *  The timer runs continuously and reloads itself in hardware at every timeout, so
+ *  each interval starts exactly when the previous one ends no matter how long this
+ *  interrupt takes to run. Every timeout is an edge of at least one channel: gate the
+ *  carrier of those channels for the interval that just started, then queue up the
+ *  time until the earliest edge of any channel after the one already loaded.
+ *  A channel waiting to start cuts the interval that just started short, so it does
+ *  not have to wait for a long interval of another channel.
  */
-void IRoneShotTimerHandler(Timer_Handle handle)
+void IRintervalTimerHandler(Timer_Handle handle)
 {
-    // need to close the timer to set the delay to a different value
-    Timer_close(oneShotHandle);
+    PROFILE_BEGIN(probe_emitter_isr);
+    uint32_t now = scheduleEnd;
+    uint32_t end = scheduleQueued;
 
-    // Check to make sure we have not reached the end of the output sequence buffer
-    if ((currentOutputSequence[currentOutputIndex].time_us != 0) && (currentOutputIndex < MAX_SEQUENCE_INDEX))
+    // The timer counts down from the length of the interval that just started,
+    // so the ticks already counted are how late this interrupt is
+    uint32_t latency = (end - now) - HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV);
+
+    scheduleEnd = end;
+
+    for (uint8_t i = 0; i < EMITTER_CHANNEL_COUNT; i++)
     {
-        IRsetOneShotTimeout(currentOutputSequence[currentOutputIndex].time_us);
+        if (channels[i].state == channel_pending)
+        {
+            IRshortenInterval();
+            break;
+        }
+    }
 
-        if (currentOutputSequence[currentOutputIndex].PWM == true)
+    bool inUse = false;
+    for (uint8_t i = 0; i < EMITTER_CHANNEL_COUNT; i++)
+    {
+        IRserviceChannel(&channels[i], now, latency);
+        if (channels[i].state != channel_idle)
         {
-            IRstartPWMtimer();
+            inUse = true;
         }
-        else
+    }
+
+    if (inUse)
+    {
+        IRqueueNextInterval();
+    }
+    else
+    {
+        Timer_stop(intervalTimerHandle);
+        scheduleRunning = false;
+    }
+
+    PROFILE_END(probe_emitter_isr);
+}
+
+/**
+ * Sets the task that is posted from the interval timer interrupt whenever a channel
+ * completes, so the completion can be picked up with IRemitterCompleted right away
+ * @param task The task to post, or NULL to poll IRemitterCompleted instead
+ */
+void IRemitterSetCompletionTask(Task* task)
+{
+    completionTask = task;
+}
+
+/**
+ * Gets the accuracy measurements of the last sequence that finished sending on a channel
+ * @param channel The output channel to get the measurements of
+ * @param stats The structure to fill with the measurements
+ */
+void IRgetEmitterStats(uint8_t channel, EmitterStats* stats)
+{
+    if ((stats != NULL) && (channel < EMITTER_CHANNEL_COUNT))
+    {
+        *stats = channels[channel].lastSendStats;
+    }
+}
+
+/**
+ * Checks if a sequence is still being sent on a channel
+ * @param channel The output channel to check
+ * @return true while the IR LED of the channel is in use
+ */
+bool IRemitterBusy(uint8_t channel)
+{
+    return (channel < EMITTER_CHANNEL_COUNT) && (channels[channel].state != channel_idle);
+}
+
+/**
+ * Checks for the completion event of the last IR sequence sent on a channel.
+ * The event is only reported once.
+ * @param channel The output channel to check
+ * @param duration_us Filled with the time from the first edge until the carrier was switched off
+ * @return true if a sequence finished sending since the last call
+ */
+bool IRemitterCompleted(uint8_t channel, uint32_t* duration_us)
+{
+    if ((channel >= EMITTER_CHANNEL_COUNT) || (channels[channel].completionPending == false))
+    {
+        return false;
+    }
+
+    if (duration_us != NULL)
+    {
+        *duration_us = channels[channel].completionDuration_us;
+    }
+    channels[channel].completionPending = false;
+    return true;
+}
+
+/**
+ * Gets how long a channel has left to send, its trailing gap included. The completion
+ * is posted from the interrupt, so this is when to come back for it instead of polling.
+ * @param channel The output channel to check
+ * @return The time in microseconds, rounded up, until the channel completes. 0 if it is
+ * idle, the idle period if it has not started yet.
+ */
+uint32_t IRemitterGetTimeUntilDone(uint8_t channel)
+{
+    uint64_t RetVal = 0;
+
+    if (channel < EMITTER_CHANNEL_COUNT)
+    {
+        EmitterChannel* ch = &channels[channel];
+        uintptr_t key = HwiP_disable();
+
+        if (ch->state == channel_active)
         {
-            IRstopPWMtimer();
+            // The interval being sent ends at the next edge, the ones not gated yet follow it.
+            // Edges still being compiled are not counted, which only brings the time forward.
+            int32_t current = (int32_t)(ch->nextEdgeTime - (scheduleEnd - HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV)));
+            RetVal = ((current > 0) ? (uint32_t)current : 0) + (ch->emissionTicks - ch->sentTicks);
+        }
+        else if (ch->state != channel_idle)
+        {
+            RetVal = EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US;
         }
 
-        currentOutputIndex++;
-        IRstartOneShotTimer();
+        HwiP_restore(key);
+    }
 
+    return (uint32_t)((RetVal + EMITTER_TICKS_PER_US - 1) / EMITTER_TICKS_PER_US);
+}
+
+/**
+ * Handles one timeout of the interval timer for a channel: starts a pending
+ * channel, gates the carrier if one of its edges is due, or ends its sequence.
+ * An edge the thread has not compiled yet stays due and is gated late at a later timeout.
+ * @param ch The channel to service
+ * @param now The schedule time of the timeout
+ * @param latency How late the interrupt is in timer ticks
+ */
+static void IRserviceChannel(EmitterChannel* ch, uint32_t now, uint32_t latency)
+{
+    if (ch->state == channel_pending)
+    {
+        // Start with the interval after the one that is already loaded in the timer
+        ch->nextEdgeTime = scheduleEnd;
+        ch->state = channel_active;
     }
-    else
+    else if ((ch->state == channel_active) && ((int32_t)(now - ch->nextEdgeTime) >= 0))
+    {
+        uint16_t index = ch->edgeIndex;
+
+        // An edge that had to wait for the compiler is late by the time it waited as well
+        latency += now - ch->nextEdgeTime;
+
+        if (index < ch->edgeCount)
+        {
+            // Gate the carrier for the interval that just started
+            HWREG(ch->pwmMatchRegister) = ch->edgeTable[index].pwmMatch;
+
+            // Keep track of how much each interval was stretched or shortened
+            if (index == 0)
+            {
+                ch->sendStartLatency = (now - ch->requestTime) + latency;
+                ch->firstEdgeLatency = latency;
+            }
+            else
+            {
+                uint32_t error = (latency > ch->lastEdgeLatency) ? (latency - ch->lastEdgeLatency) : (ch->lastEdgeLatency - latency);
+                if (error > ch->maxIntervalError)
+                {
+                    ch->maxIntervalError = error;
+                }
+            }
+            if (latency > ch->maxEdgeLatency)
+            {
+                ch->maxEdgeLatency = latency;
+            }
+            ch->lastEdgeLatency = latency;
+
+            ch->nextEdgeTime += ch->edgeTable[index].timerLoad;
+            ch->sentTicks += ch->edgeTable[index].timerLoad;
+            ch->edgeIndex = index + 1;
+        }
+        else if (ch->compiled)
+        {
+            // Leave the carrier gated off so the next send does not start with a stray pulse
+            HWREG(ch->pwmMatchRegister) = ch->pwmMatchOff;
+            IRstopPWMtimer(ch);
+
+            ch->lastSendStats.edges = ch->edgeCount;
+            ch->lastSendStats.carrierStartLatency_ns = IRticksToNs(ch->sendStartLatency);
+            ch->lastSendStats.carrierStopLatency_ns = IRticksToNs(latency);
+            ch->lastSendStats.maxEdgeLatency_ns = IRticksToNs(ch->maxEdgeLatency);
+            ch->lastSendStats.maxIntervalError_ns = IRticksToNs(ch->maxIntervalError);
+            ch->lastSendStats.cumulativeDrift_ns = (int32_t)IRticksToNs(latency) - (int32_t)IRticksToNs(ch->firstEdgeLatency);
+
+            // The carrier went off just now, after every interval plus the stop latency
+            ch->state = channel_idle;
+            IRsignalCompletion(ch, ch->emissionTicks + latency);
+        }
+    }
+}
+
+/**
+ * Queues the length of the interval after the one the timer is counting down.
+ * It ends at the earliest edge of any channel after the end of the current one, but
+ * never less than the minimum reload after it: an edge of another channel closer than
+ * that is gated a little late, at the end of the minimum reload. The timer only
+ * comes back after the idle period when no channel has an edge to wait for, or while
+ * a channel waits to start or for its next edge to be compiled.
+ */
+static void IRqueueNextInterval()
+{
+    uint32_t end = scheduleEnd;
+    uint32_t interval = 0; // stays 0 until a channel has an edge after the current interval
+    bool waiting = false;
+
+    for (uint8_t i = 0; i < EMITTER_CHANNEL_COUNT; i++)
+    {
+        EmitterChannel* ch = &channels[i];
+        if (ch->state == channel_pending)
+        {
+            waiting = true;
+        }
+        if (ch->state != channel_active)
+        {
+            continue;
+        }
+
+        uint32_t edgeTime = ch->nextEdgeTime;
+        if ((int32_t)(edgeTime - end) <= 0)
+        {
+            // This channel has an edge due when the current interval ends, so look one past it
+            if (ch->edgeIndex >= ch->edgeCount)
+            {
+                // Unless the sequence ends there, the thread is still compiling that edge
+                waiting = waiting || !ch->compiled;
+                continue;
+            }
+            edgeTime += ch->edgeTable[ch->edgeIndex].timerLoad;
+        }
+
+        int32_t distance = (int32_t)(edgeTime - end);
+        if (distance < (EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US))
+        {
+            distance = EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US;
+        }
+        if ((interval == 0) || ((uint32_t)distance < interval))
+        {
+            interval = (uint32_t)distance;
+        }
+    }
+
+    if ((interval == 0) || (waiting && (interval > (EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US))))
+    {
+        interval = EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US;
+    }
+
+    HWREG(EMITTER_TIMER_BASE + TIMER_O_TAILR) = interval;
+    scheduleQueued = end + interval;
+}
+
+/**
+ * Cuts the interval the timer is counting down to the idle period if more than that
+ * is left of it, so a channel waiting to start gets its timeout soon. The edges of the
+ * other channels keep their schedule, apart from the few ticks the counter runs while
+ * it is rewritten. The caller queues the next interval again afterwards.
+ * Only called with interrupts disabled or from the interval timer interrupt.
+ */
+static void IRshortenInterval()
+{
+    uint32_t remaining = HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV);
+
+    if (remaining > (EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US))
+    {
+        uint32_t cut = remaining - (EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US);
+        HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV) = HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV) - cut;
+        scheduleEnd -= cut;
+    }
+}
+
+/**
+ * Empties the edge table of a channel and points its compiler at a new stored sequence
+ * @param ch The channel to compile for
+ * @param sequence The IR sequence to compile
+ */
+static void IRstartEdgeTable(EmitterChannel* ch, SignalInterval* sequence)
+{
+    ch->edgeCount = 0;
+    ch->edgeIndex = 0;
+    ch->emissionTicks = 0;
+    ch->sentTicks = 0;
+    ch->outputIndex = 0;
+    ch->outputSequence = sequence;
+    IRloadRepeatInfo(ch, sequence);
+}
+
+/**
+ * Compiles the stored sequence into the edge table, expanding any repeats and converting
+ * every interval into the timer load and PWM match values the interrupt writes directly
+ * @param ch The channel to compile for
+ * @param limit Stop once the table holds this many edges
+ */
+static void IRcompileEdges(EmitterChannel* ch, uint16_t limit)
+{
+    SignalInterval interval;
+    uint16_t count = ch->edgeCount;
+
+    if (limit > EMITTER_EDGE_TABLE_SIZE)
+    {
+        limit = EMITTER_EDGE_TABLE_SIZE;
+    }
+
+    while ((count < limit) && IRgetNextInterval(ch, &interval))
+    {
+        ch->edgeTable[count].timerLoad = interval.time_us * EMITTER_TICKS_PER_US;
+        ch->edgeTable[count].pwmMatch = (interval.PWM == true) ? ch->pwmMatchOn : ch->pwmMatchOff;
+        ch->emissionTicks += ch->edgeTable[count].timerLoad;
+        // The interrupt may already be reading the table, so only count the edge once it is written
+        count++;
+        ch->edgeCount = count;
+    }
+}
+
+/**
+ * Records that the emission of a channel has ended and raises its completion event
+ * @param ch The channel that finished
+ * @param ticks The time the emission took in timer ticks
+ */
+static void IRsignalCompletion(EmitterChannel* ch, uint64_t ticks)
+{
+    ch->completionDuration_us = (uint32_t)(ticks / EMITTER_TICKS_PER_US);
+    ch->completionPending = true;
+
+    if (completionTask != NULL)
     {
-        IRstopPWMtimer();
+        taskPost(completionTask);
+    }
+}
+
+/**
+ * Moves the output cursor along the sequence, stepping into the inter-frame gap
+ * and the repeat code when a frame ends and repeats are left to send, and into
+ * the trailing gap once the whole sequence has been sent
+ * @param ch The channel the cursor belongs to
+ * @param interval The interval to fill with the next timing to output
+ * @return true if there is another interval to output, false at the end of the sequence
+ */
+static bool IRgetNextInterval(EmitterChannel* ch, SignalInterval* interval)
+{
+    bool RetVal = false;
+
+    // At the end of a frame, send the gap and start over with the repeat code if any repeats are left
+    if ((ch->outputIndex >= ch->outputEnd) && (ch->repeatsRemaining > 0))
+    {
+        interval->time_us = ch->repeatGap;
+        interval->PWM = false;
+
+        ch->repeatsRemaining--;
+        ch->outputIndex = ch->repeatStartIndex;
+        ch->outputEnd = ch->repeatEndIndex;
+        RetVal = true;
+    }
+    // Check to make sure we have not reached the end of the output sequence buffer
+    else if ((ch->outputIndex < ch->outputEnd) && (ch->outputIndex < MAX_SEQUENCE_INDEX))
+    {
+        *interval = ch->outputSequence[ch->outputIndex];
+        ch->outputIndex++;
+        RetVal = true;
+    }
+    // Split the trailing gap into intervals the timer can count
+    else if (ch->trailingGap_us > 0)
+    {
+        interval->time_us = (ch->trailingGap_us < EMITTER_MAX_GAP_US) ? ch->trailingGap_us : EMITTER_MAX_GAP_US;
+        interval->PWM = false;
 
-        // Need to free the output sequence
-        free(currentOutputSequence);
+        ch->trailingGap_us -= interval->time_us;
+        RetVal = true;
     }
+
+    return RetVal;
 }
 
 /**
- * Sets up the PWM output for IR output - 50% duty cycle
+ * Converts interval timer ticks to nanoseconds
+ * @param ticks The number of timer ticks
+ * @return The time in nanoseconds
+ */
+static uint32_t IRticksToNs(uint32_t ticks)
+{
+    // Wider than the ticks, which only fit 53.7ms once they are in nanoseconds
+    return (uint32_t)(((uint64_t)ticks * 1000) / EMITTER_TICKS_PER_US);
+}
+
+/**
+ * Finds where the first frame of a sequence ends and, if the sequence was stored
+ * with a repeat marker, loads the gap, repeat count and repeat code bounds
+ * @param ch The channel that is about to send the sequence
+ * @param sequence The IR sequence that is about to be sent
+ */
+static void IRloadRepeatInfo(EmitterChannel* ch, SignalInterval* sequence)
+{
+    uint16_t i = 0;
+
+    // Find the end of the first frame
+    while ((i < MAX_SEQUENCE_INDEX) && (sequence[i].time_us != 0) && (sequence[i].time_us != FRAME_REPEAT_MARKER))
+    {
+        i++;
+    }
+
+    ch->outputEnd = i;
+    ch->repeatsRemaining = 0;
+
+    // Make sure the repeat information fits in the buffer before reading it
+    if ((i + 2 < MAX_SEQUENCE_INDEX) && (sequence[i].time_us == FRAME_REPEAT_MARKER))
+    {
+        ch->repeatGap = sequence[i+1].time_us;
+        ch->repeatsRemaining = sequence[i+2].time_us;
+        ch->repeatStartIndex = i + 3;
+        ch->repeatEndIndex = ch->repeatStartIndex;
+
+        while ((ch->repeatEndIndex < MAX_SEQUENCE_INDEX) && (sequence[ch->repeatEndIndex].time_us != 0))
+        {
+            ch->repeatEndIndex++;
+        }
+
+        // No repeat code was stored, so the whole frame is repeated
+        if (ch->repeatEndIndex == ch->repeatStartIndex)
+        {
+            ch->repeatStartIndex = 0;
+            ch->repeatEndIndex = ch->outputEnd;
+        }
+    }
+}
+
+/**
+ * Sets up the PWM output of every channel for IR output - 50% duty cycle
  */
 static void IRinitPWMtimer()
 {
@@ -113,67 +648,123 @@ static void IRinitPWMtimer()
     pwmParams.periodValue = 38000;           // Default to 38kHz (typical consumer IR frequency)
     pwmParams.dutyUnits = PWM_DUTY_FRACTION; // Duty is in fractional percentage
     pwmParams.dutyValue = 0;                 // 0% initial duty cycle
-    // Open the PWM instance
-    pwmHandle = PWM_open(Board_PWM_IR_OUTPUT, &pwmParams);
 
     dutyValue = (uint32_t) (((uint64_t) PWM_DUTY_FRACTION_MAX * 50) / 100);
-    PWM_setDuty(pwmHandle, dutyValue);  // set duty cycle to 50%
+
+    for (uint8_t i = 0; i < EMITTER_CHANNEL_COUNT; i++)
+    {
+        // Open the PWM instance
+        channels[i].pwmHandle = PWM_open(channelPWM[i], &pwmParams);
+        channels[i].pwmMatchRegister = channelMatchRegister[i];
+        channels[i].state = channel_idle;
+
+        PWM_setDuty(channels[i].pwmHandle, dutyValue);  // set duty cycle to 50%
+    }
 }
 
 /**
- * Sets up the one-shot timer to loop through the timings of the IR signal
+ * Sets up the interval timer that steps through the timings of the IR signals.
+ * The timer is opened once and left open; it only runs while a sequence is being sent.
  */
-static void IRinitOneShotTimer()
+static void IRinitIntervalTimer()
 {
     Timer_init();
 
-    Timer_Params_init(&oneShotParams);
-    oneShotParams.periodUnits = Timer_PERIOD_US;
-    oneShotParams.timerMode  = Timer_ONESHOT_CALLBACK;
-    oneShotParams.timerCallback = IRoneShotTimerHandler;
+    Timer_Params_init(&intervalTimerParams);
+    intervalTimerParams.periodUnits = Timer_PERIOD_US;
+    intervalTimerParams.timerMode  = Timer_CONTINUOUS_CALLBACK;
+    intervalTimerParams.timerCallback = IRintervalTimerHandler;
+    intervalTimerParams.period = EMITTER_SETUP_PERIOD_US;
+    intervalTimerHandle = Timer_open(Board_EMITTER_TIMER, &intervalTimerParams);
 }
 
 /**
- * Starts the PWM timer output
+ * Starts the PWM timer output of a channel
+ * @param ch The channel to start
  */
-static void IRstartPWMtimer()
+static void IRstartPWMtimer(EmitterChannel* ch)
 {
-    PWM_start(pwmHandle);
+    PWM_start(ch->pwmHandle);
 }
 
 /**
- * Stops the PWM timer output
+ * Stops the PWM timer output of a channel
+ * @param ch The channel to stop
  */
-static void IRstopPWMtimer()
+static void IRstopPWMtimer(EmitterChannel* ch)
 {
-    PWM_stop(pwmHandle);
+    PWM_stop(ch->pwmHandle);
 }
 
 /**
- * Sets the period (IR carrier frequency) of the PWM output
+ * Sets the period (IR carrier frequency) of the PWM output and records the match
+ * register values the driver uses for a 50% and a 0% duty cycle at that period.
+ * The PWM is left at 0% so it stays low until the first mark is gated on.
+ * Nothing is reconfigured if the carrier is the same as the last one.
+ * @param ch The channel to set the carrier of
  * @param period The period to set the PWM output to
  */
-static void IRsetPWMperiod(uint32_t period)
+static void IRsetPWMperiod(EmitterChannel* ch, uint32_t period)
 {
-    PWM_setPeriod(pwmHandle, period);
+    if (period == ch->pwmFrequency)
+    {
+        return;
+    }
+    ch->pwmFrequency = period;
+
+    PWM_setPeriod(ch->pwmHandle, period);
     uint32_t dutyValue = (uint32_t) (((uint64_t) PWM_DUTY_FRACTION_MAX * 50) / 100);
-    PWM_setDuty(pwmHandle, dutyValue);  // set duty cycle to 50%
+    PWM_setDuty(ch->pwmHandle, dutyValue);  // set duty cycle to 50%
+    ch->pwmMatchOn = HWREG(ch->pwmMatchRegister);
+
+    PWM_setDuty(ch->pwmHandle, 0);
+    ch->pwmMatchOff = HWREG(ch->pwmMatchRegister);
 }
 
 /**
- * Starts the one-shot timer
+ * Starts the interval timer counting down the setup period while a send is prepared
  */
-static void IRstartOneShotTimer()
+static void IRstartIntervalTimer()
 {
-    Timer_start(oneShotHandle);
+    // Let load values take effect right away until the first edge is started
+    HWREG(EMITTER_TIMER_BASE + TIMER_O_TAMR) &= ~TIMER_TAMR_TAILD;
+    Timer_start(intervalTimerHandle);
 }
 
 /**
- * Sets the one-shot timer timeout
- * @param time_in_us The timeout in microseconds
+ * Starts the first interval of a channel straight from the calling thread and
+ * queues up the second one for the timer. Only used when no other channel is sending.
+ * Interrupts are masked throughout, so the setup period timing out in the middle cannot
+ * run the interrupt on a half started schedule.
+ * @param ch The channel to start
  */
-static void IRsetOneShotTimeout(uint32_t time_in_us)
+static void IRstartFirstEdge(EmitterChannel* ch)
 {
-    oneShotParams.period = time_in_us;
-    oneShotHandle = Timer_open(Board_EMITTER_TIMER, &oneShotParams);
+    uintptr_t key = HwiP_disable();
+
+    // Everything since the timer started counting the setup period is start latency
+    ch->sendStartLatency = (EMITTER_SETUP_PERIOD_US * EMITTER_TICKS_PER_US) - HWREG(EMITTER_TIMER_BASE + TIMER_O_TAV);
+
+    // Reload the timer with the first interval and gate the carrier for it at the same moment.
+    // A first interval shorter than the minimum reload makes the second edge late instead.
+    uint32_t load = ch->edgeTable[0].timerLoad;
+    if (load < (EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US))
+    {
+        load = EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US;
+    }
+    HWREG(EMITTER_TIMER_BASE + TIMER_O_TAILR) = load;
+    HWREG(ch->pwmMatchRegister) = ch->edgeTable[0].pwmMatch;
+
+    // The schedule starts over with this channel's first edge
+    scheduleEnd = load;
+    ch->nextEdgeTime = ch->edgeTable[0].timerLoad;
+    ch->sentTicks = ch->edgeTable[0].timerLoad;
+    ch->edgeIndex = 1;
+    ch->state = channel_active;
+
+    // From here on a new load value only takes effect when the current interval times out
+    HWREG(EMITTER_TIMER_BASE + TIMER_O_TAMR) |= TIMER_TAMR_TAILD;
+    IRqueueNextInterval();
+
+    HwiP_restore(key);
 }
@@ -17,6 +17,8 @@
 #include "Signal_Interval.h"
 #include "IR_Emitter.h"
 #include "IR_Receiver.h"
+#include "Profiler.h"
+#include "Task_Queue.h"
 
 Receiver_Mode receiverState;
 static Capture_Handle captureHandle;
@@ -30,12 +32,21 @@ static int32_t seqIndex = -1;
 static uint32_t totalCaptureTime = 0;
 static bool irGapDetected = false;
 static bool buttonCaptured = false;
+static bool captureConverted = true;
+static uint16_t capturedLength = 0;
+static bool captureTruncated = false;
+static Task* captureTask = NULL;
+static uint32_t minPulseTime = GLITCH_MIN_PULSE_US * E_10S_TO_US_SCALAR;
+static GlitchCounters glitchCounters = {0};
 
 static void IRinitSignalCapture();
 static void IRstartSignalCapture();
 static void IRstopSignalCapture();
 static void IRinitEdgeDetectGPIO();
 static void ConvertToUs(SignalInterval *seq, uint32_t length);
+static uint16_t FoldRepeatFrames(SignalInterval *seq, uint16_t length, bool truncated);
+static bool IntervalsMatch(uint32_t first, uint32_t second);
+static bool FramesMatch(const SignalInterval *first, const SignalInterval *second, uint16_t length);
 
 void IRedgeDetectionPassthrough(uint_least8_t index);
 void IRedgeProgramButton(Capture_Handle handle, uint32_t interval);
@@ -63,6 +74,8 @@ void IR_Init_Receiver()
  */
 void IRedgeDetectionPassthrough(uint_least8_t index)
 {
+    PROFILE_BEGIN(probe_passthru_isr);
+
     // Clear the GPIO interrupt and set the IR out to match the interrupt edge
     if (GPIO_read(Board_IR_EDGE_DETECT_PIN))
     {
@@ -72,6 +85,8 @@ void IRedgeDetectionPassthrough(uint_least8_t index)
     {
         IR_LED_ON();
     }
+
+    PROFILE_END(probe_passthru_isr);
 }
 
 /**
@@ -84,12 +99,15 @@ void IRedgeDetectionPassthrough(uint_least8_t index)
  *  assumes a maximum signal length of 125ms. It also assumes no signal will have a
  *  pulse of silence greater than 20ms. Times are recorded in 1E-10 seconds and
  *  later converted to microseconds. The maximum period between edges during
- *  PWM pulses is assumed to be less than 25us.
+ *  PWM pulses is assumed to be less than 25us. Pulses shorter than the glitch filter
+ *  minimum (see IRsetGlitchFilter) are treated as noise and merged into their neighbours.
  *
  *  @param interval     This is the period between edges in clock ticks
  */
 void IRedgeProgramButton(Capture_Handle handle, uint32_t interval)
 {
+    PROFILE_BEGIN(probe_capture_isr);
+
     // Interval is in clock ticks, and each tick is 125E-10s
     interval = interval * TIME_PER_TICK;
 
@@ -108,17 +126,17 @@ void IRedgeProgramButton(Capture_Handle handle, uint32_t interval)
     else if((totalCaptureTime >= MAXIMUM_SEQUENCE_TIME) || (seqIndex >= MAX_SEQUENCE_INDEX) || (irGapDetected == true)){
         IRstopSignalCapture();
 
-        // Update the sequence size so we know how large the IR sequence buffer is when storing
-        irSequenceSize = seqIndex;
-
         // Since the final index recorded is guaranteed to be a silence,
         // update the time to 0us to prevent the IR Emitter from outputting it
         // unnecessarily.
         seqIndex--;
         (irSequence[seqIndex]).time_us = 0;
 
-        // Convert the 1E-10s that were recorded to microseconds
-        ConvertToUs(irSequence, seqIndex);
+        // Converting and folding the sequence is left to getIRsequence, outside of the interrupt.
+        // Only a capture that ended on a long silence is guaranteed to hold whole frames
+        capturedLength = seqIndex;
+        captureTruncated = (irGapDetected == false);
+        captureConverted = false;
 
         // Reset variables for next capture
         seqIndex = RESET_INDEX;
@@ -126,24 +144,67 @@ void IRedgeProgramButton(Capture_Handle handle, uint32_t interval)
         edgeCnt = 0;
         irGapDetected = false;
         buttonCaptured = true;
+
+        if (captureTask != NULL)
+        {
+            taskPost(captureTask);
+        }
     }
 
     // Either need add accumulated time or record the data
     else{
+        // Record the total capture time to ensure maximum signal length is not exceeded
+        totalCaptureTime += interval;
+
+        // Edges closer together than any carrier half period are noise, keep the time
+        // but do not count the edge towards the carrier frequency
+        if(interval < GLITCH_MIN_EDGE_INTERVAL){
+            glitchCounters.rejectedEdges++;
+            currentInt.time_us += interval;
+            PROFILE_END(probe_capture_isr);
+            return;
+        }
+
         // If a frequency has not been calculated, count the number of edges detected
         if(frequency == 0){
             edgeCnt++;
         }
 
-        // Record the total capture time to ensure maximum signal length is not exceeded
-        totalCaptureTime += interval;
-
         // If the time between edges is less than the maximum PWM half period
         // add the time to calculate the PWM pulse length
         if(interval <= PWM_GAP){
             currentInt.time_us += interval;
         }
 
+        // A silence too short to be real is a dropout in the carrier, keep it in the PWM pulse
+        else if(interval < minPulseTime){
+            glitchCounters.rejectedSpaces++;
+            currentInt.time_us += interval;
+        }
+
+        // A PWM pulse too short to be real is a burst of ambient light. Fold it and the silence
+        // after it into the previous silence, or drop it if the signal has not started yet.
+        else if(currentInt.time_us < minPulseTime){
+            glitchCounters.rejectedMarks++;
+
+            if(seqIndex > 0){
+                irSequence[seqIndex-1].time_us += currentInt.time_us + interval;
+
+                if(irSequence[seqIndex-1].time_us >= END_SEQUENCE_TIME){
+                    irGapDetected = true;
+                }
+            }
+            else{
+                totalCaptureTime = 0;
+            }
+
+            // Start counting carrier edges over again on the next PWM pulse
+            if(frequency == 0){
+                edgeCnt = 0;
+            }
+            currentInt.time_us = 0;
+        }
+
         // Otherwise, a silent pulse has been detected, and both pulses
         // must be recorded
         else{
@@ -176,6 +237,8 @@ void IRedgeProgramButton(Capture_Handle handle, uint32_t interval)
             }
         }
     }
+
+    PROFILE_END(probe_capture_isr);
 }
 
 /**
@@ -191,6 +254,8 @@ void IRreceiverSetMode(Receiver_Mode mode)
         receiverState = passthru;
         break;
     case program:
+        // The glitch counters are reported for each button learned
+        memset(&glitchCounters, 0, sizeof(glitchCounters));
         IRstopEdgeDetectGPIO();
         IRstartSignalCapture();
         receiverState = program;
@@ -222,6 +287,17 @@ void IRstopEdgeDetectGPIO()
  */
 SignalInterval* getIRsequence(uint16_t* sequenceSize)
 {
+    if (captureConverted == false)
+    {
+        // Convert the 1E-10s that were recorded to microseconds
+        ConvertToUs(irSequence, capturedLength);
+
+        // Update the sequence size so we know how large the IR sequence buffer is when storing
+        // (+1 for the zero time that ends the sequence)
+        irSequenceSize = FoldRepeatFrames(irSequence, capturedLength, captureTruncated) + 1;
+        captureConverted = true;
+    }
+
     *sequenceSize = (uint16_t)(irSequenceSize*sizeof(SignalInterval));
     return &irSequence[0];
 }
@@ -237,6 +313,15 @@ uint16_t getIRcarrierFrequency()
     return RetVal;
 }
 
+/**
+ * Sets the task that is posted from the capture interrupt once a button has been captured
+ * @param task The task to post, or NULL to poll IRbuttonReady instead
+ */
+void IRreceiverSetCaptureTask(Task* task)
+{
+    captureTask = task;
+}
+
 /**
  * Report if a button has been captures and is ready to be stored
  * @return True it a button is ready, false if not
@@ -253,6 +338,37 @@ bool IRbuttonReady()
     return RetVal;
 }
 
+/**
+ * Set the shortest PWM pulse or silence the receiver will accept while learning.
+ * Anything shorter is treated as noise and merged into the pulses around it.
+ * @param minPulse_us The shortest accepted pulse in microseconds, at most GLITCH_MAX_PULSE_US
+ * @return true if the filter was set, false if it is too wide
+ */
+bool IRsetGlitchFilter(uint32_t minPulse_us)
+{
+    bool RetVal = false;
+
+    if (minPulse_us <= GLITCH_MAX_PULSE_US)
+    {
+        minPulseTime = minPulse_us * E_10S_TO_US_SCALAR;
+        RetVal = true;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Get the number of pulses and edges the glitch filter has rejected since learning last started
+ * @param counters The structure to fill with the rejected pulse and edge counts
+ */
+void IRgetGlitchCounters(GlitchCounters* counters)
+{
+    if (counters != NULL)
+    {
+        *counters = glitchCounters;
+    }
+}
+
 /**
  * Start the input capture timer interrupt to learn IR codes
  */
@@ -315,3 +431,147 @@ static void ConvertToUs(SignalInterval *seq, uint32_t length){
         (seq[i]).time_us = ((seq[i]).time_us / E_10S_TO_US_SCALAR);
     }
 }
+
+/**
+ * This function looks for a frame that repeats within a captured IR sequence and folds
+ * the sequence down to one canonical frame, the gap between frames and the repeat code.
+ * Any partial frame left at the end of the capture is dropped so it is never sent.
+ * The folded layout is described next to FRAME_REPEAT_MARKER in Signal_Interval.h
+ *
+ * @param seq This is the captured sequence in microseconds, ended by a zero time.
+ * @param length This is the amount of pulses in the sequence (not counting the zero time).
+ * @param truncated This is true if the capture was cut off in the middle of a frame.
+ * @return The new amount of pulses in the sequence (the zero time is rewritten after it)
+ */
+static uint16_t FoldRepeatFrames(SignalInterval *seq, uint16_t length, bool truncated){
+    uint16_t gapIndex[MAX_SEQUENCE_INDEX/2];
+    uint16_t numGaps = 0;
+
+    // Find every silence long enough to separate two frames
+    for(uint16_t i = 0; i < length; i++){
+        if((seq[i].PWM == false) && (seq[i].time_us >= FRAME_GAP_MIN_US)){
+            gapIndex[numGaps] = i;
+            numGaps++;
+        }
+    }
+
+    // A single frame has nothing to fold
+    if(numGaps == 0){
+        return length;
+    }
+
+    // Every frame must be spaced the same way for the gap to be regenerated
+    uint32_t frameGap = seq[gapIndex[0]].time_us;
+    for(uint16_t i = 1; i < numGaps; i++){
+        if(!IntervalsMatch(seq[gapIndex[i]].time_us, frameGap)){
+            return length;
+        }
+    }
+
+    uint16_t frameLength = gapIndex[0];
+    uint16_t repeatStart = gapIndex[0] + 1;
+    uint16_t repeatLength = ((numGaps > 1) ? gapIndex[1] : length) - repeatStart;
+    uint16_t tailStart = gapIndex[numGaps-1] + 1;
+    uint16_t tailLength = length - tailStart;
+
+    // The segment after the last gap only counts as a repeat if the capture ended cleanly
+    uint32_t repeatCount = numGaps - 1;
+    if((truncated == false) && (tailLength > 0)){
+        repeatCount++;
+    }
+
+    if(repeatCount == 0){
+        // All that follows the frame is a partial copy of it, so keep the frame alone
+        if((tailLength > frameLength) || !FramesMatch(&seq[0], &seq[tailStart], tailLength)){
+            return length;
+        }
+        repeatLength = 0;
+    }
+    else{
+        // Every whole repeat must look like the first one
+        for(uint16_t i = 1; i < repeatCount; i++){
+            uint16_t start = gapIndex[i] + 1;
+            uint16_t end = (i+1 < numGaps) ? gapIndex[i+1] : length;
+
+            if(((end - start) != repeatLength) || !FramesMatch(&seq[repeatStart], &seq[start], repeatLength)){
+                return length;
+            }
+        }
+
+        // A partial repeat at the end of the capture must match the start of a whole one
+        if((truncated == true) && (numGaps > 1)){
+            if((tailLength > repeatLength) || !FramesMatch(&seq[repeatStart], &seq[tailStart], tailLength)){
+                return length;
+            }
+        }
+
+        // If the repeat is the frame itself there is no need to store it twice
+        if((repeatLength == frameLength) && FramesMatch(&seq[0], &seq[repeatStart], frameLength)){
+            repeatLength = 0;
+        }
+    }
+
+    uint16_t foldedLength = frameLength;
+    if(repeatCount > 0){
+        // Room for the marker, the gap and the repeat count
+        foldedLength += 3 + repeatLength;
+    }
+
+    // Only fold the sequence if doing so makes it shorter
+    if(foldedLength >= length){
+        return length;
+    }
+
+    if(repeatCount > 0){
+        // Move the repeat code to its place after the repeat information (the regions can overlap)
+        memmove(&seq[frameLength+3], &seq[repeatStart], repeatLength*sizeof(SignalInterval));
+
+        seq[frameLength].time_us = FRAME_REPEAT_MARKER;
+        seq[frameLength].PWM = false;
+        seq[frameLength+1].time_us = frameGap;
+        seq[frameLength+1].PWM = false;
+        seq[frameLength+2].time_us = repeatCount;
+        seq[frameLength+2].PWM = false;
+    }
+
+    seq[foldedLength].time_us = 0;
+    seq[foldedLength].PWM = false;
+
+    return foldedLength;
+}
+
+/**
+ * This function checks if two pulse times are close enough to come from the same frame
+ *
+ * @param first This is the first pulse time in microseconds.
+ * @param second This is the second pulse time in microseconds.
+ * @return true if the times match, false if not
+ */
+static bool IntervalsMatch(uint32_t first, uint32_t second){
+    uint32_t difference = (first > second) ? (first - second) : (second - first);
+    uint32_t tolerance = (first * FRAME_MATCH_TOLERANCE_PCT) / 100;
+
+    if(tolerance < FRAME_MATCH_MIN_TOLERANCE_US){
+        tolerance = FRAME_MATCH_MIN_TOLERANCE_US;
+    }
+
+    return (difference <= tolerance);
+}
+
+/**
+ * This function compares two runs of pulses
+ *
+ * @param first This is the first run of pulses.
+ * @param second This is the second run of pulses.
+ * @param length This is the amount of pulses to compare.
+ * @return true if every pulse matches, false if not
+ */
+static bool FramesMatch(const SignalInterval *first, const SignalInterval *second, uint16_t length){
+    for(uint16_t i = 0; i < length; i++){
+        if((first[i].PWM != second[i].PWM) || !IntervalsMatch(first[i].time_us, second[i].time_us)){
+            return false;
+        }
+    }
+
+    return true;
+}
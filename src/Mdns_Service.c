@@ -0,0 +1,73 @@
+/**
+ * This file represents the mDNS/DNS-SD advertisement of the command socket. The NWP runs
+ * the mDNS responder, the board only registers its service record with it.
+ * @file Mdns_Service.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ti/drivers/net/wifi/simplelink.h>
+#include "Mdns_Service.h"
+#define TRACE_FILE trace_file_mdns_service
+#include "Trace.h"
+
+#ifdef DEBUG_SESSION
+#include "uart_term.h"
+#endif
+
+// Name of the registered mDNS service, empty until it was registered
+static char serviceName[MDNS_SERVICE_NAME_SIZE] = {0};
+
+/**
+ * Advertises the command port as an mDNS/DNS-SD service, so clients find the board without
+ * broadcasting discovering_ncir. The service is named after the device name, and its text
+ * record carries the device name, firmware version, button count and button table generation.
+ * Called again whenever one of them changes, the previous record is replaced.
+ * @param port The UDP port of the command socket
+ * @param buttonCount The number of stored buttons
+ * @param tableGeneration The generation of the button table
+ * @return 0 if the service was registered, else the SimpleLink error code
+ */
+int mdnsAdvertiseService(uint16_t port, uint16_t buttonCount, uint32_t tableGeneration)
+{
+    uint16_t devNameLen = DEVICE_NAME_LENGTH;
+    char deviceName[DEVICE_NAME_LENGTH];
+    memset(deviceName, 0, DEVICE_NAME_LENGTH);
+    uint16_t devNameOpt = SL_WLAN_P2P_OPT_DEV_NAME;
+    sl_WlanGet(SL_WLAN_CFG_P2P_PARAM_ID, &devNameOpt, &devNameLen, (uint8_t*)deviceName);
+
+    char serviceText[MDNS_TEXT_SIZE];
+    snprintf(serviceText, MDNS_TEXT_SIZE, "name=%s;fw=%s;buttons=%u;gen=%08lx",
+             deviceName, FIRMWARE_VERSION, buttonCount, (unsigned long)tableGeneration);
+
+    // The mDNS responder may already run, that is fine
+    sl_NetAppStart(SL_NETAPP_MDNS_ID);
+
+    // Drop the last record, it has an old text or the device was renamed
+    if (serviceName[0] != '\0')
+    {
+        sl_NetAppMDNSUnRegisterService((const signed char*)serviceName, strlen(serviceName), 0);
+    }
+    snprintf(serviceName, MDNS_SERVICE_NAME_SIZE, "%s%s", deviceName, MDNS_SERVICE_TYPE);
+
+    // Not persistent: the record is registered again after every connection
+    int RetVal = sl_NetAppMDNSRegisterService((const signed char*)serviceName, strlen(serviceName),
+                                              (const signed char*)serviceText, strlen(serviceText),
+                                              port, MDNS_SERVICE_TTL,
+                                              SL_NETAPP_MDNS_OPTIONS_IS_UNIQUE_BIT | SL_NETAPP_MDNS_OPTIONS_IS_NOT_PERSISTENT);
+
+    if (RetVal < 0)
+    {
+        TRACE1(trace_module_wifi, TRACE_LEVEL_ERROR, "mDNS register failed %d", RetVal);
+#ifdef DEBUG_SESSION
+        UART_PRINT("\r\nmDNS service registration failed: %d\r\n", RetVal);
+#endif
+    }
+    else
+    {
+        RetVal = 0;
+        TRACE2(trace_module_wifi, TRACE_LEVEL_INFO, "mDNS service registered, %u buttons, generation %x", buttonCount, tableGeneration);
+    }
+
+    return RetVal;
+}
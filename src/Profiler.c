@@ -0,0 +1,305 @@
+/**
+ * This file represents the timing probes of the firmware. Each probe keeps a count, the
+ * total and the longest time of the code it surrounds, so hot paths can be compared on
+ * the device without a debugger attached.
+ * @file Profiler.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// Interrupt masking while probes are updated from both interrupts and the main loop
+#include <ti/drivers/dpl/HwiP.h>
+// Reset cause of the boot record
+#include <ti/devices/cc32xx/inc/hw_types.h>
+#include <ti/devices/cc32xx/driverlib/prcm.h>
+#include "Timer_Wheel.h"
+#include "Profiler.h"
+
+#ifdef DEBUG_SESSION
+#include "uart_term.h"
+#endif
+
+#define PROFILER_REPORT_LINE_SIZE 64
+
+// Names of the probes, in the order of ProfileProbe
+static const char* probeNames[PROFILER_PROBE_COUNT] =
+{
+    "socket_wait",
+    "udp_command",
+    "button_name",
+    "button_carrier",
+    "button_channel",
+    "button_sequence",
+    "emitter_isr",
+    "capture_isr",
+    "passthru_isr",
+    "wheel_tick",
+    "task_wait_high",
+    "task_wait_normal",
+    "task_wait_low",
+    "command_always_on",
+    "command_low_latency",
+    "command_normal",
+    "command_long_sleep"
+};
+
+// Names of the boot phases, in the order of BootPhase
+static const char* bootPhaseNames[BOOT_PHASE_COUNT] =
+{
+    "board",
+    "ir",
+    "nwp",
+    "storage",
+    "provisioning",
+    "connected",
+    "network",
+    "serving"
+};
+
+static ProbeStats probes[PROFILER_PROBE_COUNT];
+
+// The record of this boot is placed in the .noinit section of the linker command file
+#pragma DATA_SECTION(bootRecord, ".noinit")
+static BootRecord bootRecord;
+static BootRecord previousBoot;
+static WheelTimer wrapTimer;
+static uint32_t lastCycles = 0;
+static uint64_t cycleHigh = 0;
+
+static void profilerWrapHandler(WheelTimer* timer);
+
+/**
+ * Start the cycle counter and a new boot record. Called first thing in main,
+ * so boot phases are timed from the reset.
+ */
+void profilerStartClock()
+{
+    *(volatile uint32_t*)PROFILER_DEMCR |= PROFILER_DEMCR_TRCENA;
+    *(volatile uint32_t*)PROFILER_DWT_CYCCNT = 0;
+    *(volatile uint32_t*)PROFILER_DWT_CTRL |= PROFILER_DWT_CTRL_CYCCNTENA;
+
+    // Keep what the last boot reached, it tells where a boot that was reset got stuck
+    if (bootRecord.magic == BOOT_RECORD_MAGIC)
+    {
+        previousBoot = bootRecord;
+    }
+    else
+    {
+        memset(&previousBoot, 0, sizeof(previousBoot));
+        bootRecord.bootCount = 0;
+    }
+
+    bootRecord.magic = BOOT_RECORD_MAGIC;
+    bootRecord.bootCount++;
+    bootRecord.resetCause = PRCMSysResetCauseGet();
+    memset(bootRecord.phaseTimes_us, 0, sizeof(bootRecord.phaseTimes_us));
+}
+
+/**
+ * Start the timing probes. The clock has to be started with profilerStartClock, and
+ * the timer wheel has to be running, it keeps the monotonic clock from missing a
+ * wrap of the cycle counter.
+ */
+void profiler_init()
+{
+    profilerReset();
+    timerWheelStart(&wrapTimer, profilerWrapHandler, PROFILER_WRAP_CHECK_MS, PROFILER_WRAP_CHECK_MS);
+}
+
+/**
+ * Gets the monotonic clock
+ * @return The time since the profiler was started in microseconds
+ */
+uint64_t profilerGetTime_us()
+{
+    uintptr_t key = HwiP_disable();
+
+    uint32_t cycles = PROFILER_CYCLES();
+    if (cycles < lastCycles)
+    {
+        cycleHigh += (1ULL << 32);
+    }
+    lastCycles = cycles;
+    uint64_t now = cycleHigh + cycles;
+
+    HwiP_restore(key);
+
+    return now / PROFILER_CYCLES_PER_US;
+}
+
+/**
+ * Adds one measurement to a probe, see PROFILE_BEGIN and PROFILE_END
+ * @param probe The probe to add the measurement to
+ * @param startCycles The cycle counter at the start of the measured code
+ */
+void profilerRecord(ProfileProbe probe, uint32_t startCycles)
+{
+    uint32_t cycles = PROFILER_CYCLES() - startCycles;
+
+    if (probe < PROFILER_PROBE_COUNT)
+    {
+        uintptr_t key = HwiP_disable();
+
+        probes[probe].count++;
+        probes[probe].totalCycles += cycles;
+        if (cycles > probes[probe].maxCycles)
+        {
+            probes[probe].maxCycles = cycles;
+        }
+
+        HwiP_restore(key);
+    }
+}
+
+/**
+ * Gets a copy of the measurements of a probe
+ * @param probe The probe to get
+ * @param stats Filled with the measurements
+ */
+void profilerGetStats(ProfileProbe probe, ProbeStats* stats)
+{
+    if ((probe < PROFILER_PROBE_COUNT) && (stats != NULL))
+    {
+        uintptr_t key = HwiP_disable();
+        *stats = probes[probe];
+        HwiP_restore(key);
+    }
+}
+
+/**
+ * Clears the measurements of every probe
+ */
+void profilerReset()
+{
+    uintptr_t key = HwiP_disable();
+    memset(probes, 0, sizeof(probes));
+    HwiP_restore(key);
+}
+
+/**
+ * Creates a report of every probe that has been hit, one line per probe:
+ * <name>,<count>,<total us>,<max us>
+ * @return the report, or NULL if it could not be allocated
+ * @note THE RETURNED BUFFER NEEDS TO BE FREED BY THE CALLER
+ */
+char* profilerCreateReport()
+{
+    char* report = malloc((PROFILER_PROBE_COUNT * PROFILER_REPORT_LINE_SIZE) + 1);
+
+    if (report != NULL)
+    {
+        char* offset = report;
+        report[0] = '\0';
+
+        for (uint8_t i = 0; i < PROFILER_PROBE_COUNT; i++)
+        {
+            ProbeStats stats;
+            profilerGetStats((ProfileProbe)i, &stats);
+
+            if (stats.count > 0)
+            {
+                offset += snprintf(offset, PROFILER_REPORT_LINE_SIZE, "%s,%u,%u,%u\r\n",
+                                   probeNames[i],
+                                   stats.count,
+                                   (uint32_t)(stats.totalCycles / PROFILER_CYCLES_PER_US),
+                                   stats.maxCycles / PROFILER_CYCLES_PER_US);
+            }
+        }
+    }
+
+    return report;
+}
+
+/**
+ * Prints the probe report to the console
+ */
+void profilerPrint()
+{
+#ifdef DEBUG_SESSION
+    char* report = profilerCreateReport();
+
+    if (report != NULL)
+    {
+        UART_PRINT("\r\nProbe,count,total us,max us\r\n%s", report);
+        free(report);
+    }
+#endif
+}
+
+/**
+ * Records the time a boot phase was first reached, and prints it to the console
+ * @param phase The phase that was reached
+ */
+void profilerBootPhase(BootPhase phase)
+{
+    if ((phase < BOOT_PHASE_COUNT) && (bootRecord.phaseTimes_us[phase] == 0))
+    {
+        // Never 0, that marks a phase that was not reached
+        bootRecord.phaseTimes_us[phase] = (uint32_t)profilerGetTime_us() | 1;
+#ifdef DEBUG_SESSION
+        UART_PRINT("\r\nBoot phase %s reached after %u ms\r\n", bootPhaseNames[phase], bootRecord.phaseTimes_us[phase] / 1000);
+#endif
+    }
+}
+
+/**
+ * Gets when a boot phase was reached
+ * @param phase The phase to get
+ * @return The time since the profiler was started in microseconds, 0 if not reached yet
+ */
+uint32_t profilerGetBootTime_us(BootPhase phase)
+{
+    uint32_t RetVal = 0;
+
+    if (phase < BOOT_PHASE_COUNT)
+    {
+        RetVal = bootRecord.phaseTimes_us[phase];
+    }
+
+    return RetVal;
+}
+
+/**
+ * Creates the boot report:
+ * boot_report,<boot count>,<reset cause>,<furthest phase of the previous boot>,<us of every phase>
+ * The furthest phase of the previous boot is -1 if it is not known.
+ * @param buffer Filled with the report
+ * @param size The size of buffer
+ * @return The length of the report
+ */
+int profilerFormatBootReport(char* buffer, uint16_t size)
+{
+    int lastPhase = -1;
+    for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+    {
+        if (previousBoot.phaseTimes_us[phase] != 0)
+        {
+            lastPhase = phase;
+        }
+    }
+
+    int length = snprintf(buffer, size, "\r\nboot_report,%u,%u,%d",
+                          bootRecord.bootCount, bootRecord.resetCause, lastPhase);
+
+    for (uint8_t phase = 0; (phase < BOOT_PHASE_COUNT) && (length < size); phase++)
+    {
+        length += snprintf(&buffer[length], size - length, ",%u", bootRecord.phaseTimes_us[phase]);
+    }
+
+    if (length < size)
+    {
+        length += snprintf(&buffer[length], size - length, "\r\n");
+    }
+
+    return (length < size) ? length : (size - 1);
+}
+
+/**
+ * Reads the clock often enough that every wrap of the cycle counter is seen
+ * @param timer The wrap timer (not used, but necessary for the timer callback)
+ */
+static void profilerWrapHandler(WheelTimer* timer)
+{
+    profilerGetTime_us();
+}
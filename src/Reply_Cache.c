@@ -0,0 +1,208 @@
+/**
+ * This file represents the cache of recent replies. Every client keeps the replies of its
+ * last few sequence numbers, the oldest one is replaced by the next new command. Only used
+ * from the main loop.
+ * @file Reply_Cache.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Reply_Cache.h"
+#define TRACE_FILE trace_file_reply_cache
+#include "Trace.h"
+
+typedef struct
+{
+    uint32_t seq;
+    bool used;
+    uint16_t length; // 0 until the command replied
+    char reply[REPLY_CACHE_REPLY_SIZE];
+} ReplyCacheEntry;
+
+typedef struct
+{
+    uint32_t ip;
+    uint16_t port;
+    uint32_t lastUsed; // cacheUseCount when the client last sent a command, 0 if the slot is free
+    uint8_t nextEntry; // oldest entry, replaced by the next new command
+    ReplyCacheEntry entries[REPLY_CACHE_DEPTH];
+} ReplyCacheClient;
+
+static ReplyCacheClient cacheClients[REPLY_CACHE_CLIENTS];
+static uint32_t cacheUseCount = 0;
+
+static ReplyCacheClient* findClient(const ReplyAddr* client, bool create);
+static ReplyCacheEntry* findEntry(ReplyCacheClient* cacheClient, uint32_t seq);
+
+/**
+ * Takes the sequence number off the front of a command, if it has one
+ * @param command The received command, moved past the sequence number if it has one
+ * @param seq Set to the sequence number
+ * @return true if the command has a sequence number
+ */
+bool replyParseSeq(char** command, uint32_t* seq)
+{
+    bool RetVal = false;
+    char* end;
+
+    if ((*command)[0] == '#')
+    {
+        *seq = strtoul(&(*command)[1], &end, 10);
+        if ((end != &(*command)[1]) && (*end == ','))
+        {
+            *command = end + 1;
+            RetVal = true;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Checks if a command with a sequence number was received before. A new command is added
+ * to the cache, so retries of it that arrive while it still runs are not run again either.
+ * @param client The client and sequence number of the command
+ * @param reply Set to the cached reply on a hit
+ * @param length Set to the length of the cached reply on a hit
+ * @return reply_cache_miss if the command has to be run, else if it is a retry
+ */
+ReplyCacheResult replyCacheCheck(const ReplyAddr* client, const char** reply, uint16_t* length)
+{
+    ReplyCacheResult RetVal = reply_cache_miss;
+    ReplyCacheClient* cacheClient = findClient(client, true);
+    ReplyCacheEntry* entry = findEntry(cacheClient, client->seq);
+
+    if (entry == NULL)
+    {
+        entry = &cacheClient->entries[cacheClient->nextEntry];
+        cacheClient->nextEntry = (cacheClient->nextEntry + 1) % REPLY_CACHE_DEPTH;
+
+        entry->seq = client->seq;
+        entry->used = true;
+        entry->length = 0;
+    }
+    else if (entry->length == 0)
+    {
+        RetVal = reply_cache_pending;
+        TRACE1(trace_module_main, TRACE_LEVEL_INFO, "retry of pending command %u ignored", client->seq);
+    }
+    else
+    {
+        *reply = entry->reply;
+        *length = entry->length;
+        RetVal = reply_cache_hit;
+        TRACE1(trace_module_main, TRACE_LEVEL_INFO, "retry of command %u answered from the cache", client->seq);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Keeps a reply for retries of its command. A reply too long for the cache, or a second
+ * reply of the same command, e.g. a macro reporting its steps or a batch sent in parts,
+ * is replaced by REPLY_NOT_CACHED, as a retry could not be answered with all of it. The
+ * command is still never run twice.
+ * @param client The client and sequence number the reply goes to
+ * @param reply The reply as sent, with the sequence number
+ * @param length The length of the reply
+ */
+void replyCacheStore(const ReplyAddr* client, const char* reply, uint16_t length)
+{
+    ReplyCacheClient* cacheClient = findClient(client, false);
+    ReplyCacheEntry* entry = (cacheClient != NULL) ? findEntry(cacheClient, client->seq) : NULL;
+
+    if (entry != NULL)
+    {
+        if ((entry->length == 0) && (length <= REPLY_CACHE_REPLY_SIZE))
+        {
+            memcpy(entry->reply, reply, length);
+            entry->length = length;
+        }
+        else
+        {
+            entry->length = snprintf(entry->reply, REPLY_CACHE_REPLY_SIZE, "#%lu,\r\n%s\r\n", (unsigned long)client->seq, REPLY_NOT_CACHED);
+        }
+    }
+}
+
+/**
+ * Marks a command as run. If it did not reply, and no reply follows from a task later on,
+ * its retries get REPLY_COMMAND_DONE, instead of being ignored as still pending.
+ * @param client The client and sequence number of the command
+ */
+void replyCacheComplete(const ReplyAddr* client)
+{
+    ReplyCacheClient* cacheClient = findClient(client, false);
+    ReplyCacheEntry* entry = (cacheClient != NULL) ? findEntry(cacheClient, client->seq) : NULL;
+
+    if ((entry != NULL) && (entry->length == 0))
+    {
+        entry->length = snprintf(entry->reply, REPLY_CACHE_REPLY_SIZE, "#%lu,\r\n%s\r\n", (unsigned long)client->seq, REPLY_COMMAND_DONE);
+    }
+}
+
+/**
+ * Finds the cache slot of a client
+ * @param client The address of the client
+ * @param create true to take over the slot idle the longest if the client has none
+ * @return The slot of the client, NULL if it has none and create is false
+ */
+static ReplyCacheClient* findClient(const ReplyAddr* client, bool create)
+{
+    ReplyCacheClient* RetVal = NULL;
+    ReplyCacheClient* oldest = &cacheClients[0];
+
+    for (uint8_t i = 0; i < REPLY_CACHE_CLIENTS; i++)
+    {
+        if ((cacheClients[i].lastUsed != 0) &&
+            (cacheClients[i].ip == client->addr.sin_addr.s_addr) &&
+            (cacheClients[i].port == client->addr.sin_port))
+        {
+            RetVal = &cacheClients[i];
+            break;
+        }
+
+        if (cacheClients[i].lastUsed < oldest->lastUsed)
+        {
+            oldest = &cacheClients[i];
+        }
+    }
+
+    if ((RetVal == NULL) && create)
+    {
+        memset(oldest, 0, sizeof(ReplyCacheClient));
+        oldest->ip = client->addr.sin_addr.s_addr;
+        oldest->port = client->addr.sin_port;
+        RetVal = oldest;
+    }
+
+    if ((RetVal != NULL) && create)
+    {
+        RetVal->lastUsed = ++cacheUseCount;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Finds the entry of a sequence number
+ * @param cacheClient The slot of the client
+ * @param seq The sequence number
+ * @return The entry, NULL if the sequence number is not cached
+ */
+static ReplyCacheEntry* findEntry(ReplyCacheClient* cacheClient, uint32_t seq)
+{
+    ReplyCacheEntry* RetVal = NULL;
+
+    for (uint8_t i = 0; i < REPLY_CACHE_DEPTH; i++)
+    {
+        if (cacheClient->entries[i].used && (cacheClient->entries[i].seq == seq))
+        {
+            RetVal = &cacheClient->entries[i];
+            break;
+        }
+    }
+
+    return RetVal;
+}
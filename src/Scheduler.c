@@ -0,0 +1,434 @@
+/**
+ * This file represents the scheduled button sends. The earliest job is always at the
+ * top of a min-heap, so the main loop only has to compare one due time per pass.
+ * @file Scheduler.c
+ */
+
+#include <stddef.h>
+#include "Filesystem.h"
+#include "Timer_Wheel.h"
+#include "Task_Queue.h"
+#define TRACE_FILE trace_file_scheduler
+#include "Trace.h"
+#include "Scheduler.h"
+
+#ifdef DEBUG_SESSION
+#include "uart_term.h"
+#endif
+
+static uint64_t clockOffset_ms = 0;
+static bool clockValid = false;
+static ScheduledJob jobHeap[SCHEDULER_MAX_JOBS];
+static uint16_t numJobs = 0;
+static uint32_t nextJobId = 1;
+static Task saveTask;
+
+static void heapSiftUp(uint16_t index);
+static void heapSiftDown(uint16_t index);
+static void heapRemove(uint16_t index);
+static void heapInsert(ScheduledJob* job);
+static void heapRebuild();
+static void loadJobs();
+static void saveJobs();
+static void saveJobsTask(Task* task);
+static void catchUpJobs();
+
+/**
+ * Restore the saved jobs. The scheduler clock runs off the timer wheel uptime.
+ */
+void scheduler_init()
+{
+    taskCreate(&saveTask, saveJobsTask, task_priority_low);
+    loadJobs();
+}
+
+/**
+ * Sets the scheduler clock. Jobs are only run once the clock has been set, as
+ * their due times are absolute.
+ * @param unixTime_ms The current Unix time in milliseconds
+ */
+void schedulerSetTime(uint64_t unixTime_ms)
+{
+    clockOffset_ms = unixTime_ms - timerWheelGetUptime();
+
+    // Jobs restored from flash may have come due while the board was off
+    if (clockValid == false)
+    {
+        clockValid = true;
+        catchUpJobs();
+    }
+}
+
+/**
+ * Checks if the scheduler clock has been set since the last reset
+ * @return true if the clock is valid
+ */
+bool schedulerClockValid()
+{
+    return clockValid;
+}
+
+/**
+ * Gets the scheduler clock
+ * @return The current Unix time in milliseconds, or the uptime if the clock was never set
+ */
+uint64_t schedulerGetTime()
+{
+    return timerWheelGetUptime() + clockOffset_ms;
+}
+
+/**
+ * Adds a job that sends a button at the given time
+ * @param buttonIndex The button to send
+ * @param dueTime_ms Unix time of the first send in milliseconds
+ * @param period_ms Time between sends of a recurring job, 0 to only send once
+ * @return The job ID if OK, else SCHEDULER_ERROR
+ */
+int schedulerAddJob(uint16_t buttonIndex, uint64_t dueTime_ms, uint32_t period_ms)
+{
+    int RetVal = SCHEDULER_ERROR;
+
+    if ((clockValid == true) && (numJobs < SCHEDULER_MAX_JOBS))
+    {
+        ScheduledJob job;
+        job.dueTime_ms = dueTime_ms;
+        job.period_ms = period_ms;
+        job.jobId = nextJobId++;
+        job.buttonIndex = buttonIndex;
+
+        heapInsert(&job);
+        saveJobs();
+        RetVal = job.jobId;
+        TRACE3(trace_module_scheduler, TRACE_LEVEL_INFO, "job %u added for button %u, period %u ms", job.jobId, buttonIndex, period_ms);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Removes a job from the queue
+ * @param jobId The ID of the job to cancel
+ * @return 0 if OK, else SCHEDULER_ERROR
+ */
+int schedulerCancelJob(uint32_t jobId)
+{
+    int RetVal = SCHEDULER_ERROR;
+
+    for (uint16_t i = 0; i < numJobs; i++)
+    {
+        if (jobHeap[i].jobId == jobId)
+        {
+            heapRemove(i);
+            saveJobs();
+            RetVal = 0;
+            TRACE1(trace_module_scheduler, TRACE_LEVEL_INFO, "job %u cancelled", jobId);
+            break;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Removes every job that sends the given button, for when the button is deleted
+ * @param buttonIndex The index of the button
+ */
+void schedulerCancelButtonJobs(uint16_t buttonIndex)
+{
+    bool changed = false;
+    uint16_t i = 0;
+
+    while (i < numJobs)
+    {
+        if (jobHeap[i].buttonIndex == buttonIndex)
+        {
+            // Check the job that is moved into this slot next
+            numJobs--;
+            jobHeap[i] = jobHeap[numJobs];
+            changed = true;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (changed)
+    {
+        heapRebuild();
+        saveJobs();
+    }
+}
+
+/**
+ * Removes every job, for when all buttons are deleted
+ */
+void schedulerCancelAllJobs()
+{
+    numJobs = 0;
+    fsDeleteFile(SCHEDULER_JOB_FILE);
+}
+
+/**
+ * Checks if the earliest job is due. The job stays at the top of the queue
+ * until schedulerJobDone is called, so a send that has to wait is not lost.
+ * @param job Filled with the due job
+ * @return true if a job is due
+ */
+bool schedulerGetDueJob(ScheduledJob* job)
+{
+    bool RetVal = false;
+
+    if ((clockValid == true) && (numJobs > 0) && (jobHeap[0].dueTime_ms <= schedulerGetTime()))
+    {
+        *job = jobHeap[0];
+        RetVal = true;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets how long the main loop can wait before the earliest job is due
+ * @return The time until the earliest job in milliseconds, 0 if it is already due,
+ *         or UINT32_MAX if no job can become due
+ */
+uint32_t schedulerGetTimeUntilDue()
+{
+    uint32_t RetVal = UINT32_MAX;
+
+    if ((clockValid == true) && (numJobs > 0))
+    {
+        uint64_t now = schedulerGetTime();
+
+        if (jobHeap[0].dueTime_ms <= now)
+        {
+            RetVal = 0;
+        }
+        else if ((jobHeap[0].dueTime_ms - now) < UINT32_MAX)
+        {
+            RetVal = jobHeap[0].dueTime_ms - now;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Finishes the due job returned by schedulerGetDueJob. Recurring jobs are
+ * moved to their next due time, one-shot jobs are removed.
+ * @param jobId The ID of the job that was run
+ */
+void schedulerJobDone(uint32_t jobId)
+{
+    if ((numJobs > 0) && (jobHeap[0].jobId == jobId))
+    {
+        TRACE2(trace_module_scheduler, TRACE_LEVEL_DEBUG, "job %u ran for button %u", jobId, jobHeap[0].buttonIndex);
+
+        if (jobHeap[0].period_ms > 0)
+        {
+            // Step from the last due time rather than from now so the job does not drift.
+            // The saved copy is left alone to save flash writes, catchUpJobs fixes it after a reset
+            jobHeap[0].dueTime_ms += jobHeap[0].period_ms;
+            heapSiftDown(0);
+        }
+        else
+        {
+            heapRemove(0);
+            saveJobs();
+        }
+    }
+}
+
+/**
+ * Brings jobs restored from flash up to date once the clock is known. Recurring
+ * jobs skip the sends they missed, one-shot jobs missed by too long are dropped.
+ */
+static void catchUpJobs()
+{
+    uint64_t now = schedulerGetTime();
+    bool changed = false;
+    uint16_t i = 0;
+
+    while (i < numJobs)
+    {
+        ScheduledJob* job = &jobHeap[i];
+
+        if ((job->period_ms == 0) && ((job->dueTime_ms + SCHEDULER_MISSED_GRACE_MS) < now))
+        {
+            // Check the job that is moved into this slot next
+            numJobs--;
+            jobHeap[i] = jobHeap[numJobs];
+            changed = true;
+            continue;
+        }
+
+        if ((job->period_ms > 0) && (job->dueTime_ms < now))
+        {
+            uint64_t missedPeriods = ((now - job->dueTime_ms) / job->period_ms) + 1;
+            job->dueTime_ms += missedPeriods * job->period_ms;
+        }
+        i++;
+    }
+
+    // Due times changed all over the heap, so rebuild it
+    heapRebuild();
+
+    if (changed)
+    {
+        saveJobs();
+    }
+}
+
+/**
+ * Moves a job up the heap until its parent is due earlier
+ * @param index The heap index of the job
+ */
+static void heapSiftUp(uint16_t index)
+{
+    while (index > 0)
+    {
+        uint16_t parent = (index - 1) / 2;
+
+        if (jobHeap[parent].dueTime_ms <= jobHeap[index].dueTime_ms)
+        {
+            break;
+        }
+
+        ScheduledJob temp = jobHeap[parent];
+        jobHeap[parent] = jobHeap[index];
+        jobHeap[index] = temp;
+        index = parent;
+    }
+}
+
+/**
+ * Moves a job down the heap until both children are due later
+ * @param index The heap index of the job
+ */
+static void heapSiftDown(uint16_t index)
+{
+    while (true)
+    {
+        uint16_t earliest = index;
+        uint16_t left = (2 * index) + 1;
+        uint16_t right = left + 1;
+
+        if ((left < numJobs) && (jobHeap[left].dueTime_ms < jobHeap[earliest].dueTime_ms))
+        {
+            earliest = left;
+        }
+        if ((right < numJobs) && (jobHeap[right].dueTime_ms < jobHeap[earliest].dueTime_ms))
+        {
+            earliest = right;
+        }
+        if (earliest == index)
+        {
+            break;
+        }
+
+        ScheduledJob temp = jobHeap[earliest];
+        jobHeap[earliest] = jobHeap[index];
+        jobHeap[index] = temp;
+        index = earliest;
+    }
+}
+
+/**
+ * Removes the job at a heap index by moving the last job into its place
+ * @param index The heap index of the job
+ */
+static void heapRemove(uint16_t index)
+{
+    numJobs--;
+
+    if (index < numJobs)
+    {
+        jobHeap[index] = jobHeap[numJobs];
+        heapSiftDown(index);
+        heapSiftUp(index);
+    }
+}
+
+/**
+ * Restores the heap order after jobs were changed or removed in place
+ */
+static void heapRebuild()
+{
+    for (uint16_t i = numJobs / 2; i > 0; i--)
+    {
+        heapSiftDown(i - 1);
+    }
+}
+
+/**
+ * Adds a job to the heap
+ * @param job The job to add
+ */
+static void heapInsert(ScheduledJob* job)
+{
+    jobHeap[numJobs] = *job;
+    numJobs++;
+    heapSiftUp(numJobs - 1);
+}
+
+/**
+ * Reads the saved job queue from flash
+ */
+static void loadJobs()
+{
+    int fileSize = fsGetFileSizeInBytes(SCHEDULER_JOB_FILE);
+
+    if ((fileSize != FILE_IO_ERROR) && (fileSize <= sizeof(jobHeap)))
+    {
+        int fd = fsOpenFile(SCHEDULER_JOB_FILE, flash_read);
+
+        if (fd != FILE_IO_ERROR)
+        {
+            fsReadFile(fd, jobHeap, 0, fileSize);
+            fsCloseFile(fd);
+            numJobs = fileSize / sizeof(ScheduledJob);
+
+            // Keep job IDs unique across resets
+            for (uint16_t i = 0; i < numJobs; i++)
+            {
+                if (jobHeap[i].jobId >= nextJobId)
+                {
+                    nextJobId = jobHeap[i].jobId + 1;
+                }
+            }
+
+#ifdef DEBUG_SESSION
+            UART_PRINT("Restored %d scheduled jobs\n\r", numJobs);
+#endif
+        }
+    }
+}
+
+/**
+ * Queues the job queue to be written to flash once nothing more urgent is left to do.
+ * Changes made before the write runs are saved together.
+ */
+static void saveJobs()
+{
+    taskPost(&saveTask);
+}
+
+/**
+ * Writes the job queue to flash. The heap is saved as it is, it is still a valid heap when read back.
+ * @param task The save task (not used, but necessary for the task function)
+ */
+static void saveJobsTask(Task* task)
+{
+    int fd = fsCreateFile(SCHEDULER_JOB_FILE, sizeof(jobHeap));
+
+    if (fd != FILE_IO_ERROR)
+    {
+        fsWriteFile(fd, 0, numJobs * sizeof(ScheduledJob), jobHeap);
+        fsCloseFile(fd);
+    }
+    else
+    {
+        TRACE1(trace_module_scheduler, TRACE_LEVEL_ERROR, "could not save %u jobs", numJobs);
+    }
+}
@@ -0,0 +1,269 @@
+/**
+ * This file represents the cooperative tasks of the main loop. Every priority has its own
+ * queue of posted tasks, linked through the tasks themselves, so posting never allocates
+ * and is safe from interrupts. A task that is posted again before it runs only runs once.
+ *
+ * In the threaded build (TASK_THREADS) every priority is run by its own thread, which
+ * waits on a semaphore counting the tasks in its queue. The tasks still share the state
+ * of the main loop, so they run one at a time under the task lock, and a task of a higher
+ * priority does not preempt one that is running: a send posted during a flash write waits
+ * for the write to finish. What the priorities do guarantee is the order: once the running
+ * task is done, the highest priority task posted runs next, the same order the main loop
+ * runs them in, whichever thread gets the lock first. The lock inherits the priority of
+ * the threads waiting for it, so the running task is not held up by the threads in between.
+ * @file Task_Queue.c
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+// Interrupt masking while tasks are posted from interrupts
+#include <ti/drivers/dpl/HwiP.h>
+#ifdef TASK_THREADS
+// POSIX threads of the SDK, sem_post can be called from interrupts
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include "Profiler.h"
+#include "Task_Queue.h"
+
+static Task* queueHead[TASK_PRIORITY_COUNT] = {NULL};
+static Task* queueTail[TASK_PRIORITY_COUNT] = {NULL};
+
+#ifdef TASK_THREADS
+static sem_t queueSemaphore[TASK_PRIORITY_COUNT]; // counts the posted tasks of each priority
+static pthread_mutex_t runMutex;
+static pthread_cond_t turnChanged; // signalled when a task is done, for threads that let a higher priority go first
+#endif
+
+static Task* takeTask(uint8_t priority);
+#ifdef TASK_THREADS
+static bool higherPriorityPending(uint8_t priority);
+#endif
+static void runTask(Task* task);
+
+/**
+ * Sets up a task before it is posted for the first time
+ * @param task The task, owned by the caller
+ * @param function The function the task runs
+ * @param priority The queue the task is posted to
+ */
+void taskCreate(Task* task, TaskFxn function, TaskPriority priority)
+{
+    task->next = NULL;
+    task->function = function;
+    task->priority = (priority < TASK_PRIORITY_COUNT) ? priority : task_priority_low;
+    task->posted = false;
+    task->postCycles = 0;
+}
+
+/**
+ * Queues a task to run once from the main loop. Can be called from interrupts.
+ * @param task The task to run
+ */
+void taskPost(Task* task)
+{
+    bool queued = false;
+    uintptr_t key = HwiP_disable();
+
+    if (task->posted == false)
+    {
+        queued = true;
+        task->posted = true;
+        task->next = NULL;
+        task->postCycles = PROFILER_CYCLES();
+
+        if (queueTail[task->priority] == NULL)
+        {
+            queueHead[task->priority] = task;
+        }
+        else
+        {
+            queueTail[task->priority]->next = task;
+        }
+        queueTail[task->priority] = task;
+    }
+
+    HwiP_restore(key);
+
+#ifdef TASK_THREADS
+    // Wake the thread of the priority, once for every task queued
+    if (queued)
+    {
+        sem_post(&queueSemaphore[task->priority]);
+    }
+#else
+    (void)queued;
+#endif
+}
+
+#ifdef TASK_THREADS
+/**
+ * Sets up the semaphores and the task lock of the threads. Called once, before any task is posted.
+ */
+void taskQueue_init()
+{
+    pthread_mutexattr_t attrs;
+
+    for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+        sem_init(&queueSemaphore[priority], 0, 0);
+    }
+
+    pthread_mutexattr_init(&attrs);
+    pthread_mutexattr_setprotocol(&attrs, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&runMutex, &attrs);
+    pthread_mutexattr_destroy(&attrs);
+    pthread_cond_init(&turnChanged, NULL);
+}
+
+/**
+ * Waits for a task of one priority to be posted and runs it. Called in a loop by the thread
+ * of the priority.
+ * @param priority The queue the thread runs
+ */
+void taskWaitAndRun(TaskPriority priority)
+{
+    Task* task = NULL;
+
+    while (sem_wait(&queueSemaphore[priority]) != 0)
+    {
+        // Interrupted by a signal on the host, wait again
+    }
+
+    taskLock();
+
+    // The thread of a higher priority may be waiting for the lock too, let its tasks run first
+    while (higherPriorityPending(priority))
+    {
+        pthread_cond_wait(&turnChanged, &runMutex);
+    }
+
+    uintptr_t key = HwiP_disable();
+    task = takeTask(priority);
+    HwiP_restore(key);
+
+    if (task != NULL)
+    {
+        runTask(task);
+    }
+
+    pthread_cond_broadcast(&turnChanged);
+    taskUnlock();
+}
+
+/**
+ * Keeps the tasks from running, for threads that are not tasks but touch the state of the main loop
+ */
+void taskLock()
+{
+    pthread_mutex_lock(&runMutex);
+}
+
+/**
+ * Lets the tasks run again after taskLock
+ */
+void taskUnlock()
+{
+    pthread_mutex_unlock(&runMutex);
+}
+#else
+/**
+ * Runs the posted task with the highest priority. Called from the main loop only.
+ * @return true if a task was run, false if nothing is posted
+ */
+bool taskRunNext()
+{
+    Task* task = NULL;
+    uintptr_t key = HwiP_disable();
+
+    for (uint8_t priority = 0; (priority < TASK_PRIORITY_COUNT) && (task == NULL); priority++)
+    {
+        task = takeTask(priority);
+    }
+
+    HwiP_restore(key);
+
+    if (task != NULL)
+    {
+        runTask(task);
+    }
+
+    return (task != NULL);
+}
+#endif
+
+/**
+ * Checks if any task is waiting to run
+ * @return true if a task is posted
+ */
+bool taskPending()
+{
+    bool RetVal = false;
+
+    for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+        if (queueHead[priority] != NULL)
+        {
+            RetVal = true;
+        }
+    }
+
+    return RetVal;
+}
+
+#ifdef TASK_THREADS
+/**
+ * Checks if a task of a higher priority than a thread's is waiting to run
+ * @param priority The priority of the thread
+ * @return true if a task of a higher priority is posted
+ */
+static bool higherPriorityPending(uint8_t priority)
+{
+    bool RetVal = false;
+
+    for (uint8_t higher = 0; higher < priority; higher++)
+    {
+        if (queueHead[higher] != NULL)
+        {
+            RetVal = true;
+        }
+    }
+
+    return RetVal;
+}
+#endif
+
+/**
+ * Takes the oldest posted task of a priority off its queue. Called with interrupts disabled.
+ * @param priority The queue to take the task from
+ * @return The task, NULL if none of the priority is posted
+ */
+static Task* takeTask(uint8_t priority)
+{
+    Task* RetVal = queueHead[priority];
+
+    if (RetVal != NULL)
+    {
+        queueHead[priority] = RetVal->next;
+        if (queueHead[priority] == NULL)
+        {
+            queueTail[priority] = NULL;
+        }
+
+        // Clear the flag before running, so the task can be posted again while it runs
+        RetVal->posted = false;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Runs a task taken off its queue
+ * @param task The task to run
+ */
+static void runTask(Task* task)
+{
+    // How long the task waited behind other tasks, and behind the network wait
+    profilerRecord((ProfileProbe)(probe_task_wait_high + task->priority), task->postCycles);
+    task->function(task);
+}
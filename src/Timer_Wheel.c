@@ -0,0 +1,300 @@
+/**
+ * This file represents the software timers of the board. Level 0 of the wheel holds the
+ * timers due within the next 64 ticks, one slot per tick. Each level above covers 64 times
+ * the range of the one below, and its slots are moved down a level as the lower level wraps.
+ * @file Timer_Wheel.c
+ */
+
+#include <stddef.h>
+// Timer Driver files
+#include <ti/drivers/Timer.h>
+// Interrupt masking for changing the wheel outside of the tick interrupt
+#include <ti/drivers/dpl/HwiP.h>
+// Board Header file
+#include "Board.h"
+#include "Timer_Wheel.h"
+#include "Profiler.h"
+
+static Timer_Handle tickTimerHandle;
+static Timer_Params tickTimerParams;
+static WheelLink wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+// Number of ticks processed, the low 32 bits are the tick the wheel is at
+static volatile uint64_t uptime_ms = 0;
+
+static void timerWheelTickHandler(Timer_Handle handle);
+static void wheelInsert(WheelTimer* timer, uint32_t now);
+static void wheelCascade(uint8_t level, uint32_t now);
+static void listAppend(WheelLink* head, WheelLink* link);
+static void listUnlink(WheelLink* link);
+static void listMove(WheelLink* from, WheelLink* to);
+
+/**
+ * Empty the wheel and start the hardware timer that drives it
+ */
+void timerWheel_init()
+{
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        for (uint8_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+        {
+            wheel[level][slot].next = &wheel[level][slot];
+            wheel[level][slot].prev = &wheel[level][slot];
+        }
+    }
+
+    Timer_init();
+
+    Timer_Params_init(&tickTimerParams);
+    tickTimerParams.periodUnits = Timer_PERIOD_US;
+    tickTimerParams.timerMode  = Timer_CONTINUOUS_CALLBACK;
+    tickTimerParams.timerCallback = timerWheelTickHandler;
+    tickTimerParams.period = TIMER_WHEEL_TICK_US;
+    tickTimerHandle = Timer_open(Board_WHEEL_TIMER, &tickTimerParams);
+
+    if (tickTimerHandle != NULL)
+    {
+        Timer_start(tickTimerHandle);
+    }
+}
+
+/**
+ * Starts a timer, or restarts it if it is already running. This can also be called
+ * from a timer callback, e.g. to restart the timer with a different timeout.
+ * @param timer The timer, owned by the caller and left in place while it runs
+ * @param callback Called from the timer interrupt when the timer fires, may be NULL
+ * @param timeout_ms Time until the timer fires
+ * @param period_ms Time between firings after the first one, 0 to only fire once
+ */
+void timerWheelStart(WheelTimer* timer, WheelTimerFxn callback, uint32_t timeout_ms, uint32_t period_ms)
+{
+    uintptr_t key = HwiP_disable();
+
+    if (timer->link.next != NULL)
+    {
+        listUnlink(&timer->link);
+    }
+
+    timer->callback = callback;
+    timer->period = (period_ms > TIMER_WHEEL_MAX_MS) ? TIMER_WHEEL_MAX_MS : period_ms;
+    timer->expiry = (uint32_t)uptime_ms + ((timeout_ms > TIMER_WHEEL_MAX_MS) ? TIMER_WHEEL_MAX_MS : timeout_ms);
+    wheelInsert(timer, (uint32_t)uptime_ms);
+
+    HwiP_restore(key);
+}
+
+/**
+ * Stops a timer so it does not fire. Stopping a timer that is not running does nothing.
+ * @param timer The timer to stop
+ */
+void timerWheelStop(WheelTimer* timer)
+{
+    uintptr_t key = HwiP_disable();
+
+    if (timer->link.next != NULL)
+    {
+        listUnlink(&timer->link);
+    }
+
+    HwiP_restore(key);
+}
+
+/**
+ * Checks if a timer is running. A one-shot timer stops running once it has fired.
+ * @param timer The timer to check
+ * @return true if the timer is still going to fire
+ */
+bool timerWheelActive(WheelTimer* timer)
+{
+    return (timer->link.next != NULL);
+}
+
+/**
+ * Gets how long it is until the next timer fires, e.g. to know how long the main loop
+ * can block for. Interrupts are only disabled while one level is searched.
+ * @return The time in milliseconds, 0 if a timer fires on the next tick,
+ *         or UINT32_MAX if no timer is running
+ */
+uint32_t timerWheelGetTimeUntilNext()
+{
+    uint32_t RetVal = UINT32_MAX;
+
+    // Timers are only ever cascaded down, so searching from the top level down finds
+    // every timer even if the tick interrupt cascades some between two levels
+    for (int8_t level = TIMER_WHEEL_LEVELS - 1; level >= 0; level--)
+    {
+        uintptr_t key = HwiP_disable();
+        uint32_t now = (uint32_t)uptime_ms;
+
+        for (uint8_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+        {
+            WheelLink* head = &wheel[level][slot];
+            for (WheelLink* link = head->next; link != head; link = link->next)
+            {
+                int32_t delta = (int32_t)(((WheelTimer*)link)->expiry - now);
+                uint32_t wait = (delta > 0) ? (uint32_t)delta : 0;
+                if (wait < RetVal)
+                {
+                    RetVal = wait;
+                }
+            }
+        }
+
+        HwiP_restore(key);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets the time since the wheel was started
+ * @return The uptime in milliseconds
+ */
+uint64_t timerWheelGetUptime()
+{
+    uintptr_t key = HwiP_disable();
+    uint64_t now = uptime_ms;
+    HwiP_restore(key);
+
+    return now;
+}
+
+/**
+ *  ======== timerWheelTickHandler ========
+ *  Callback function for the wheel timer, fires the timers that are due this tick
+ */
+static void timerWheelTickHandler(Timer_Handle handle)
+{
+    PROFILE_BEGIN(probe_wheel_tick);
+    uint32_t now = (uint32_t)uptime_ms;
+
+    // Each time a level wraps, the next slot of the level above is spread out over it
+    for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if ((now & ((1UL << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) != 0)
+        {
+            break;
+        }
+        wheelCascade(level, now);
+    }
+
+    // Take the due timers off the wheel before moving on, so a callback that
+    // restarts its timer with no timeout is not fired again in this tick
+    WheelLink expired;
+    listMove(&wheel[0][now & TIMER_WHEEL_SLOT_MASK], &expired);
+    uptime_ms++;
+
+    while (expired.next != &expired)
+    {
+        WheelTimer* timer = (WheelTimer*)expired.next;
+        listUnlink(&timer->link);
+
+        if (timer->period > 0)
+        {
+            // Step from the expiry rather than from now so a periodic timer does not drift
+            timer->expiry += timer->period;
+            wheelInsert(timer, now + 1);
+        }
+
+        if (timer->callback != NULL)
+        {
+            timer->callback(timer);
+        }
+    }
+
+    PROFILE_END(probe_wheel_tick);
+}
+
+/**
+ * Puts a timer in the wheel slot for its expiry. The level is picked from how far away
+ * the expiry is, so the timer is cascaded down to level 0 before it is due.
+ * @param timer The timer to insert, not in any list
+ * @param now The tick the wheel is at
+ */
+static void wheelInsert(WheelTimer* timer, uint32_t now)
+{
+    uint32_t delta = timer->expiry - now;
+    WheelLink* slot;
+
+    if ((int32_t)delta < 0)
+    {
+        // Already due, fire it on the next tick
+        slot = &wheel[0][now & TIMER_WHEEL_SLOT_MASK];
+    }
+    else
+    {
+        uint8_t level = 0;
+        while ((level < (TIMER_WHEEL_LEVELS - 1)) && (delta >= (1UL << ((level + 1) * TIMER_WHEEL_SLOT_BITS))))
+        {
+            level++;
+        }
+        slot = &wheel[level][(timer->expiry >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK];
+    }
+
+    listAppend(slot, &timer->link);
+}
+
+/**
+ * Moves the timers of the current slot of a level down into the levels below it
+ * @param level The level to cascade, 1 or above
+ * @param now The tick the wheel is at
+ */
+static void wheelCascade(uint8_t level, uint32_t now)
+{
+    WheelLink cascading;
+    listMove(&wheel[level][(now >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK], &cascading);
+
+    while (cascading.next != &cascading)
+    {
+        WheelTimer* timer = (WheelTimer*)cascading.next;
+        listUnlink(&timer->link);
+        wheelInsert(timer, now);
+    }
+}
+
+/**
+ * Adds a link to the end of a list
+ * @param head The list head
+ * @param link The link to add
+ */
+static void listAppend(WheelLink* head, WheelLink* link)
+{
+    link->next = head;
+    link->prev = head->prev;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+/**
+ * Removes a link from the list it is in and marks it as not in any list
+ * @param link The link to remove
+ */
+static void listUnlink(WheelLink* link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = NULL;
+    link->prev = NULL;
+}
+
+/**
+ * Moves all links of one list to another, empty list head
+ * @param from The list to empty
+ * @param to The head to move the links to
+ */
+static void listMove(WheelLink* from, WheelLink* to)
+{
+    if (from->next == from)
+    {
+        to->next = to;
+        to->prev = to;
+    }
+    else
+    {
+        to->next = from->next;
+        to->prev = from->prev;
+        to->next->prev = to;
+        to->prev->next = to;
+        from->next = from;
+        from->prev = from;
+    }
+}
@@ -0,0 +1,128 @@
+/**
+ * This file represents the binary trace log of the firmware. Records are kept in a ring of
+ * 32-bit words: the header word, the uptime in milliseconds and the raw arguments. The ring
+ * is read out, oldest record first, by the trace_dump command.
+ * @file Trace.c
+ */
+
+#include <stddef.h>
+// Interrupt masking while records are added from both interrupts and the main loop
+#include <ti/drivers/dpl/HwiP.h>
+#include "Timer_Wheel.h"
+#include "Trace.h"
+
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_WORDS - 1)
+#define TRACE_RECORD_WORDS(header) (2 + (((header) >> 16) & 0x0F))
+
+// Runtime level of every module, the compile-time level still applies on top of it
+uint8_t traceLevels[TRACE_MODULE_COUNT];
+
+static uint32_t traceBuffer[TRACE_BUFFER_WORDS];
+static uint32_t traceHead = 0;
+static uint32_t traceTail = 0;
+static uint32_t traceDropped = 0;
+
+/**
+ * Lets every module record up to the compile-time level
+ */
+void trace_init()
+{
+    for (uint8_t module = 0; module < TRACE_MODULE_COUNT; module++)
+    {
+        traceLevels[module] = TRACE_COMPILE_LEVEL;
+    }
+}
+
+/**
+ * Adds a record to the ring, see the TRACE macros. Can be called from interrupts.
+ * @param header The header word of the record, see TRACE_HEADER
+ * @param a The first argument, only stored if the header counts it
+ * @param b The second argument, only stored if the header counts it
+ * @param c The third argument, only stored if the header counts it
+ */
+void traceRecord(uint32_t header, uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t args[TRACE_MAX_ARGS] = {a, b, c};
+    uint32_t words = TRACE_RECORD_WORDS(header);
+    uint32_t now = (uint32_t)timerWheelGetUptime();
+    uintptr_t key = HwiP_disable();
+
+    if ((TRACE_BUFFER_WORDS - (traceHead - traceTail)) >= words)
+    {
+        traceBuffer[traceHead++ & TRACE_BUFFER_MASK] = header;
+        traceBuffer[traceHead++ & TRACE_BUFFER_MASK] = now;
+        for (uint32_t i = 0; i < (words - 2); i++)
+        {
+            traceBuffer[traceHead++ & TRACE_BUFFER_MASK] = args[i];
+        }
+    }
+    else
+    {
+        traceDropped++;
+    }
+
+    HwiP_restore(key);
+}
+
+/**
+ * Sets the runtime level of a module. Levels above the compile-time level have no effect.
+ * @param module The module to set, see TraceModule
+ * @param level The most detailed level to record, TRACE_LEVEL_OFF to record nothing
+ * @return true if the level was set, false if the module or level does not exist
+ */
+bool traceSetLevel(uint8_t module, uint8_t level)
+{
+    bool RetVal = false;
+
+    if ((module < TRACE_MODULE_COUNT) && (level <= TRACE_LEVEL_DEBUG))
+    {
+        traceLevels[module] = level;
+        RetVal = true;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Moves the oldest whole records out of the ring. Interrupts are only held off
+ * for one record at a time, so reading the ring does not delay the IR interrupts.
+ * @param words Filled with the records
+ * @param maxWords The size of words
+ * @return The number of words that were read
+ */
+uint16_t traceRead(uint32_t* words, uint16_t maxWords)
+{
+    uint16_t RetVal = 0;
+    bool done = false;
+
+    while (!done)
+    {
+        uintptr_t key = HwiP_disable();
+
+        uint32_t recordWords = TRACE_RECORD_WORDS(traceBuffer[traceTail & TRACE_BUFFER_MASK]);
+        if ((traceTail == traceHead) || ((RetVal + recordWords) > maxWords))
+        {
+            done = true;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < recordWords; i++)
+            {
+                words[RetVal++] = traceBuffer[traceTail++ & TRACE_BUFFER_MASK];
+            }
+        }
+
+        HwiP_restore(key);
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets how many records were dropped because the ring was full
+ * @return The count of dropped records since start up
+ */
+uint32_t traceGetDropCount()
+{
+    return traceDropped;
+}
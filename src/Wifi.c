@@ -1,7 +1,7 @@
 /**
  * This file utilizes TI and other custom firmware to implement WiFi provisioning
  * and general WiFi event control flow. wifi_init is called by the main program at
- * startup, and does not return until the board has connected to an AP.
+ * startup, the connection is then managed by the WiFi task in the background.
  * @file Wifi.c
  * @date 3/10/2019
  * @author: Marcus Mueller
@@ -18,42 +18,72 @@
 #include <ti/drivers/net/wifi/simplelink.h>
 #include "Wifi.h"
 #include "Board.h"
-#include "Misc_Timer.h"
+#include "Filesystem.h"
+#include "Timer_Wheel.h"
+#include "Task_Queue.h"
+#define TRACE_FILE trace_file_wifi
+#include "Trace.h"
+#include "Profiler.h"
 
 #ifdef DEBUG_SESSION
 #include "uart_term.h"
 #endif
 
 static int initSlDevice = 1;
-static int wlanConnectToRouter = 1;
 
 // Flag to signal user (phone app) provisioning
 static int wlanNeedUserProvision = 0;
 static int wlanConnectedToAP = 0;
 
+// Connection state, changed by the SimpleLink event handlers and acted on by the WiFi task
+static volatile WifiState wifiState = wifi_state_connecting;
+static uint32_t reconnectBackoff_ms = WIFI_BACKOFF_MIN_MS;
+static WheelTimer reconnectTimer;
+static Task wifiTask;
+static Task* networkTask = NULL;
+
 // Flag to signal if board is undergoing a reset cycle - this cannot be interrupted!
 static int boardRestarting = 0;
 static uint8_t timeoutCount = 0;
 static uint8_t timeoutMax = 20;
 static uint8_t pairingLEDblink = 0;
-static Timer_Handle pairingOneShotHandle;
-static Timer_Params pairingOneShotParams;
+static WheelTimer pairingBlinkTimer;
+static WheelTimer provisionTimer;
 
-static void wifiStartWLANProvisioning();
-static void pairingTimerInit();
+// Names of the power policies, in the order of PowerPolicy
+static const char* powerPolicyNames[POWER_POLICY_COUNT] =
+{
+    "always_on",
+    "low_latency",
+    "normal",
+    "long_sleep"
+};
+
+// The selected policy is used while idle, bursts of commands run always on
+static PowerPolicy selectedPolicy = power_policy_always_on;
+static PowerPolicy activePolicy = power_policy_always_on;
+static bool powerPolicyApplied = false;
+static WheelTimer powerBoostTimer;
+static Task powerIdleTask;
+
+static void wifiTaskFxn(Task* task);
+static void wifiReconnectTimeoutHandler(WheelTimer* timer);
 static int32_t wifiProvisioning();
+static void wifiEnableFastConnect();
+static void wifiApplyPowerPolicy(PowerPolicy policy);
+static void wifiPowerIdleTask(Task* task);
+static void wifiPowerBoostTimeoutHandler(WheelTimer* timer);
 
-void WiFiProvisionTimeoutHandler(Timer_Handle handle);
-void WiFiPairingTimeoutHandler(Timer_Handle handle);
+void WiFiProvisionTimeoutHandler(WheelTimer* timer);
+void WiFiPairingTimeoutHandler(WheelTimer* timer);
 
 /**
- * Initialize the WiFi subsystem and ensure a connection before returning
+ * Initialize the WiFi subsystem. The NWP connects to the last AP in the background,
+ * the WiFi task takes it from there: it starts user provisioning if the board has no
+ * AP yet, and restarts the NWP with a growing backoff while the connection is lost.
  */
 void wifi_init()
 {
-    GPIO_init();
-    SPI_init();
-
     PAIRING_LED_ON();
 
     // The NWP has not been initialized yet, do it now
@@ -62,73 +92,311 @@ void wifi_init()
         simplelink_init(0);
     }
 
-    wlanConnectToRouter = 1;
+    wifiEnableFastConnect();
+
+    taskCreate(&wifiTask, wifiTaskFxn, task_priority_normal);
     wlanNeedUserProvision = 0;
+    wifiState = wifi_state_connecting;
+    reconnectBackoff_ms = WIFI_BACKOFF_MIN_MS;
+    timerWheelStart(&reconnectTimer, wifiReconnectTimeoutHandler, reconnectBackoff_ms, 0);
+}
+
+/**
+ * Sets the task that is posted whenever an IP address is acquired, the
+ * command socket has to be opened again then
+ * @param task The task to post
+ */
+void wifiSetNetworkTask(Task* task)
+{
+    networkTask = task;
+}
+
+/**
+ * Gets the connection state
+ * @return The state of the connection to the AP
+ */
+WifiState wifiGetState()
+{
+    return wifiState;
+}
+
+/**
+ * The connection state machine, posted by the SimpleLink event handlers and the
+ * reconnect timer. Provisioning and NWP restarts are started from here.
+ *
+ * STATE MACHINE:
+ * 1) connecting: the NWP connects to a stored AP on its own
+ * 2) provisioning: the board has no AP yet, the user provisions it through the board's AP
+ * 3) connected: an IP address was acquired, the command socket is opened again
+ * 4) reconnecting: the connection was lost, the NWP is restarted every time the
+ *    backoff runs out, and the backoff doubles up to WIFI_BACKOFF_MAX_MS
+ * @param task The WiFi task (not used, but necessary for the task function)
+ */
+static void wifiTaskFxn(Task* task)
+{
+    // If the WiFi subsystem determines that the board needs to be user provisioned, it is started here
+    if (wlanNeedUserProvision)
+    {
+        timerWheelStop(&reconnectTimer);
+        wifiState = wifi_state_provisioning;
+        wifiProvisioning();
+
+        // Start blinking the pairing LED
+        timerWheelStart(&pairingBlinkTimer, WiFiPairingTimeoutHandler, PAIRING_BLINK_MS, PAIRING_BLINK_MS);
+        pairingLEDblink = 1;
+    }
+    else if (wifiState == wifi_state_connected)
+    {
+        timerWheelStop(&reconnectTimer);
+        reconnectBackoff_ms = WIFI_BACKOFF_MIN_MS;
+
+        // If we needed to provision, stop the pairing LED from blinking when we finish
+        if (pairingLEDblink)
+        {
+            timerWheelStop(&pairingBlinkTimer);
+            pairingLEDblink = 0;
+        }
+        PAIRING_LED_OFF();
+
+        // The NWP forgets the power policy when it is restarted
+        wifiApplyPowerPolicy(activePolicy);
+
+        if (networkTask != NULL)
+        {
+            taskPost(networkTask);
+        }
+    }
+    else if ((wifiState != wifi_state_provisioning) && !timerWheelActive(&reconnectTimer))
+    {
+        // Still no connection once the backoff ran out, start the NWP over so it connects again
+        TRACE1(trace_module_wifi, TRACE_LEVEL_WARN, "restarting the NWP after %u ms without a connection", reconnectBackoff_ms);
+        sl_Stop(NWP_STOP_TIMEOUT);
+        simplelink_init(0);
+        powerPolicyApplied = false;
 
-    wifiStartWLANProvisioning();
+        reconnectBackoff_ms *= 2;
+        if (reconnectBackoff_ms > WIFI_BACKOFF_MAX_MS)
+        {
+            reconnectBackoff_ms = WIFI_BACKOFF_MAX_MS;
+        }
+        timerWheelStart(&reconnectTimer, wifiReconnectTimeoutHandler, reconnectBackoff_ms, 0);
+    }
+}
 
-    // If we needed to provision, stop the pairing LED from blinking when we finish
-    if (pairingLEDblink)
+/**
+ * Gives the NWP another chance to connect once the backoff ran out. The NWP cannot
+ * be called from the timer interrupt, so the WiFi task does it.
+ * @param timer The reconnect timer (not used, but necessary for the timer callback)
+ */
+static void wifiReconnectTimeoutHandler(WheelTimer* timer)
+{
+    taskPost(&wifiTask);
+}
+
+/**
+ * The connection was lost, start counting down the backoff
+ */
+static void wifiConnectionLost()
+{
+    if (wifiState == wifi_state_connected)
     {
-        Timer_stop(pairingOneShotHandle);
-        Timer_close(pairingOneShotHandle);
-        pairingLEDblink = 0;
+        wifiState = wifi_state_reconnecting;
+        timerWheelStart(&reconnectTimer, wifiReconnectTimeoutHandler, reconnectBackoff_ms, 0);
     }
+}
+
+/**
+ * Makes the NWP reconnect to the last AP it was connected to on its cached channel and
+ * BSSID, rather than scanning for every stored profile first. The policy is kept by
+ * the NWP, so it is only written when it is not set yet.
+ */
+static void wifiEnableFastConnect()
+{
+    uint8_t policy = 0;
+    uint8_t fastPolicy = SL_WLAN_CONNECTION_POLICY(0, 1, 0, 0);
 
-    PAIRING_LED_OFF();
+    if ((sl_WlanPolicyGet(SL_WLAN_POLICY_CONNECTION, &policy, NULL, NULL) >= 0) && ((policy & fastPolicy) == 0))
+    {
+        sl_WlanPolicySet(SL_WLAN_POLICY_CONNECTION, policy | fastPolicy, NULL, 0);
+    }
 }
 
 /**
- * Initialize the pairing timer using TI's timer API
+ * Reads the selected power policy from flash and applies it. The radio stays always on
+ * if no policy was ever selected, UDP reception is most consistent that way.
  */
-static void pairingTimerInit()
+void wifiLoadPowerPolicy()
 {
-    Timer_init();
+    taskCreate(&powerIdleTask, wifiPowerIdleTask, task_priority_low);
+
+    uint8_t policy = power_policy_always_on;
+    int fd = fsOpenFile(POWER_POLICY_FILE, flash_read);
+
+    if (fd != FILE_IO_ERROR)
+    {
+        fsReadFile(fd, &policy, 0, sizeof(policy));
+        fsCloseFile(fd);
+    }
 
-    Timer_Params_init(&pairingOneShotParams);
-    pairingOneShotParams.periodUnits = Timer_PERIOD_US;
-    pairingOneShotParams.timerMode  = Timer_ONESHOT_CALLBACK;
-    pairingOneShotParams.timerCallback = WiFiPairingTimeoutHandler;
-    // Set a 1 second timeout (2 Hz period for pairing LED)
-    pairingOneShotParams.period = 1000000;
-    pairingOneShotHandle = Timer_open(Board_EMITTER_TIMER, &pairingOneShotParams);
+    selectedPolicy = (policy < POWER_POLICY_COUNT) ? (PowerPolicy)policy : power_policy_always_on;
+    wifiApplyPowerPolicy(selectedPolicy);
 }
 
 /**
- * A simple state machine that allows user provisioning or immediate
- * connection to an AP, depending on startup conditions
- *
- * STATE MACHINE:
- * 1) Initialize the WiFi subsystem
- * 2) If a connection is available, establish a connection
- * 3) If a connection is not available, start user provisioning by creating an AP on the board
+ * Selects the power policy used while no commands are coming in, and saves it to flash
+ * @param policy The policy to select
+ * @return 0 if OK, else FILE_IO_ERROR
+ */
+int wifiSetPowerPolicy(PowerPolicy policy)
+{
+    int RetVal = FILE_IO_ERROR;
+
+    if (policy < POWER_POLICY_COUNT)
+    {
+        uint8_t savedPolicy = policy;
+        int fd = fsCreateFile(POWER_POLICY_FILE, sizeof(savedPolicy));
+
+        if (fd != FILE_IO_ERROR)
+        {
+            if (fsWriteFile(fd, 0, sizeof(savedPolicy), &savedPolicy) != FILE_IO_ERROR)
+            {
+                RetVal = 0;
+            }
+            fsCloseFile(fd);
+        }
+
+        selectedPolicy = policy;
+
+        // A burst keeps its policy until it is over
+        if (!timerWheelActive(&powerBoostTimer))
+        {
+            wifiApplyPowerPolicy(selectedPolicy);
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets the power policy used while no commands are coming in
+ * @return The selected policy
+ */
+PowerPolicy wifiGetPowerPolicy()
+{
+    return selectedPolicy;
+}
+
+/**
+ * Gets the power policy the radio is running right now
+ * @return The active policy
  */
-static void wifiStartWLANProvisioning()
+PowerPolicy wifiGetActivePowerPolicy()
 {
-    while (wlanConnectToRouter || wlanNeedUserProvision)
+    return activePolicy;
+}
+
+/**
+ * Keeps the radio always on while commands keep coming in, a command is usually
+ * followed by more. The selected policy is restored once the commands stop.
+ */
+void wifiNoteActivity()
+{
+    if (selectedPolicy != power_policy_always_on)
     {
-        //The SimpleLink host driver architecture mandate calling 'sl_task' in
-        //a NO-RTOS application's main loop.
-        //The purpose of this call, is to handle asynchronous events and get
-        //flow control information sent from the NWP.
-        //Every event is classified and later handled by the host driver
-        //event handlers.
-        sl_Task(NULL);
+        wifiApplyPowerPolicy(power_policy_always_on);
+        timerWheelStart(&powerBoostTimer, wifiPowerBoostTimeoutHandler, POWER_BOOST_IDLE_MS, 0);
+    }
+}
 
-        // If the WiFi subsystem determines that the board needs to be user provisioned, it is started here
-        if (wlanNeedUserProvision)
+/**
+ * Gets the power policy with the given name
+ * @param name The name of the policy, see powerPolicyNames
+ * @return The policy, else -1
+ */
+int wifiParsePowerPolicy(const char* name)
+{
+    int RetVal = -1;
+
+    for (uint8_t policy = 0; (policy < POWER_POLICY_COUNT) && (name != NULL); policy++)
+    {
+        // Add +1 to name length to compare null character as well, a longer name is not a match
+        if (strncmp(name, powerPolicyNames[policy], strlen(powerPolicyNames[policy]) + 1) == 0)
         {
-            wifiProvisioning();
+            RetVal = policy;
+            break;
+        }
+    }
+
+    return RetVal;
+}
 
-            // Start blinking the pairing LED
-            pairingTimerInit();
-            Timer_start(pairingOneShotHandle);
-            pairingLEDblink = 1;
+/**
+ * Gets the name of a power policy
+ * @param policy The policy
+ * @return The name of the policy
+ */
+const char* wifiPowerPolicyName(PowerPolicy policy)
+{
+    return (policy < POWER_POLICY_COUNT) ? powerPolicyNames[policy] : "unknown";
+}
+
+/**
+ * Sets the power management policy of the NWP, unless it is already running
+ * @param policy The policy to run
+ */
+static void wifiApplyPowerPolicy(PowerPolicy policy)
+{
+    if ((policy != activePolicy) || !powerPolicyApplied)
+    {
+        switch (policy)
+        {
+        case power_policy_low_latency:
+            sl_WlanPolicySet(SL_WLAN_POLICY_PM, SL_WLAN_LOW_LATENCY_POLICY, NULL, 0);
+            break;
+        case power_policy_normal:
+            sl_WlanPolicySet(SL_WLAN_POLICY_PM, SL_WLAN_NORMAL_POLICY, NULL, 0);
+            break;
+        case power_policy_long_sleep:
+        {
+            SlWlanPmPolicyParams_t params;
+            memset(&params, 0, sizeof(params));
+            params.MaxSleepTimeMs = LONG_SLEEP_MAX_MS;
+            sl_WlanPolicySet(SL_WLAN_POLICY_PM, SL_WLAN_LONG_SLEEP_INTERVAL_POLICY, (uint8_t*)&params, sizeof(params));
+        }
+            break;
+        default:
+            // Within the network processor, UDP TX packets are buffered due to how the WiFi standard works.
+            // Because of this, UDP packet reception times may vary significantly. This power setting policy is
+            // utilized to maintain a much more consistent UDP reception time, and thus a more "snappy" application.
+            sl_WlanPolicySet(SL_WLAN_POLICY_PM, SL_WLAN_ALWAYS_ON_POLICY, NULL, 0);
+            break;
         }
+
+        activePolicy = policy;
+        powerPolicyApplied = true;
     }
+}
 
-    // Set the flag that tells the WiFi system that the board was at one point connected to an AP
-    wlanConnectedToAP = 1;
+/**
+ * Goes back to the selected power policy once a burst of commands is over
+ * @param task The power idle task (not used, but necessary for the task function)
+ */
+static void wifiPowerIdleTask(Task* task)
+{
+    if (!timerWheelActive(&powerBoostTimer))
+    {
+        wifiApplyPowerPolicy(selectedPolicy);
+    }
+}
+
+/**
+ * Ends a burst of commands. The NWP cannot be called from the timer interrupt,
+ * so the policy is changed by the power idle task.
+ * @param timer The power boost timer (not used, but necessary for the timer callback)
+ */
+static void wifiPowerBoostTimeoutHandler(WheelTimer* timer)
+{
+    taskPost(&powerIdleTask);
 }
 
 /**
@@ -153,6 +421,8 @@ int32_t simplelink_init(uint8_t const role)
         while(1){}
     }
 
+    profilerBootPhase(boot_phase_nwp);
+
     if(SL_RET_CODE_PROVISIONING_IN_PROGRESS == retVal)
     {
 #ifdef DEBUG_SESSION
@@ -327,6 +597,7 @@ int32_t wifiProvisioning()
     }
 
     // start provisioning
+    profilerBootPhase(boot_phase_provisioning);
     retVal = sl_WlanProvisioning(provisioningCmd, ROLE_STA, PROVISIONING_INACTIVITY_TIMEOUT, NULL, 0);
 
     if(retVal < 0)
@@ -337,7 +608,6 @@ int32_t wifiProvisioning()
     }
 
     wlanNeedUserProvision = 0;
-    wlanConnectToRouter = 1;
     return(retVal);
 }
 
@@ -361,9 +631,9 @@ void resetBoard()
 
 /**
  * While provisioning, restart the program if provisioning has not completed for a certain amount of time
- * @param handle The timer handle (not used, but necessary for the timer callback)
+ * @param timer The provisioning timer (not used, but necessary for the timer callback)
  */
-void WiFiProvisionTimeoutHandler(Timer_Handle handle)
+void WiFiProvisionTimeoutHandler(WheelTimer* timer)
 {
     // Want to time out after 10 minutes, so check that the count is < 20
     // (30 seconds * 20 = 600 seconds)
@@ -373,7 +643,6 @@ void WiFiProvisionTimeoutHandler(Timer_Handle handle)
 #ifdef DEBUG_SESSION
         UART_PRINT("Provisioning timeouts left: %d\r\n", timeoutMax - timeoutCount);
 #endif
-        startMiscOneShotTimer();
     }
     else
     {
@@ -389,9 +658,9 @@ void WiFiProvisionTimeoutHandler(Timer_Handle handle)
 
 /**
  * Keep an LED blinking while the board is not connected to a WiFi AP
- * @param handle The timer handle (not used, but necessary for the timer callback)
+ * @param timer The blink timer (not used, but necessary for the timer callback)
  */
-void WiFiPairingTimeoutHandler(Timer_Handle handle)
+void WiFiPairingTimeoutHandler(WheelTimer* timer)
 {
     if (GPIO_read(Board_PAIRING_OUTPUT_PIN))
     {
@@ -401,8 +670,6 @@ void WiFiPairingTimeoutHandler(Timer_Handle handle)
     {
         PAIRING_LED_ON();
     }
-
-    Timer_start(pairingOneShotHandle);
 }
 
 
@@ -432,6 +699,8 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
     {
     case SL_WLAN_EVENT_CONNECT:
     {
+        TRACE0(trace_module_wifi, TRACE_LEVEL_INFO, "connected to AP");
+        profilerBootPhase(boot_phase_connected);
 #ifdef DEBUG_SESSION
         UART_PRINT("STA connected to AP %s, ",
                    pWlanEvent->Data.Connect.SsidName);
@@ -451,6 +720,7 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
     {
         SlWlanEventDisconnect_t *pDiscntEvtData = NULL;
         pDiscntEvtData = &pWlanEventData->Disconnect;
+        TRACE1(trace_module_wifi, TRACE_LEVEL_WARN, "disconnected from AP, reason %u", pDiscntEvtData->ReasonCode);
 
         /** If the user has initiated 'Disconnect' request, 'ReasonCode'
          * is SL_USER_INITIATED_DISCONNECTION
@@ -469,6 +739,7 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
         }
         // We are now disconnected - show the user by lighting the pairing LED
         PAIRING_LED_ON();
+        wifiConnectionLost();
     }
     break;
 
@@ -485,7 +756,7 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
         }
 
         // Stop the provisioning timeout timer
-        stopMiscOneShotTimer();
+        timerWheelStop(&provisionTimer);
 
         break;
 
@@ -542,10 +813,15 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
             UART_PRINT(" [Provisioning] Auto-Provisioning Started\r\n");
 #endif
 
-            // Auto-provisioning has been started outside of the WiFi initialization loop. This means the
-            // board has been disconnected for a long period of time. If this happens, reset the board
-            // to attempt to reconnect, or allow the user to re-provision this device
-            if (wlanConnectedToAP == 1 || timeoutCount != 0)
+            // Auto-provisioning has been started after the board was connected. This means the board
+            // has been disconnected for a long period of time. Keep reconnecting with the backoff
+            // rather than leaving the AP the board was provisioned for.
+            if (wlanConnectedToAP == 1)
+            {
+                sl_WlanProvisioning(SL_WLAN_PROVISIONING_CMD_STOP, 0, 0, NULL, 0);
+            }
+            // A provisioning that timed out before, reset the board to let the user try again
+            else if (timeoutCount != 0)
             {
                 resetBoard();
             }
@@ -553,15 +829,13 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
             {
                 // Let the WiFi system know that the board needs a user provision
                 wlanNeedUserProvision = 1;
+                taskPost(&wifiTask);
 
                 // Stop auto-provisioning in order to start the custom provisioning provided by TI code in this file
                 sl_WlanProvisioning(SL_WLAN_PROVISIONING_CMD_STOP, 0, 0, NULL, 0);
 
                 // Start a provisioning timer in order to cycle the device if the limit is reached
-                initMiscOneShotTimer();
-                setMiscOneShotTimerCallback(WiFiProvisionTimeoutHandler);
-                setMiscOneShotTimeout(30*1000000);
-                startMiscOneShotTimer();
+                timerWheelStart(&provisionTimer, WiFiProvisionTimeoutHandler, PROVISION_TIMEOUT_MS, PROVISION_TIMEOUT_MS);
             }
 
             break;
@@ -579,11 +853,13 @@ void SimpleLinkWlanEventHandler(SlWlanEvent_t *pWlanEvent)
 #endif
 
                     // Stop the provisioning timeout timer
-                    stopMiscOneShotTimer();
+                    timerWheelStop(&provisionTimer);
 
                     // Successful provisioning: move on to main program
-                    wlanConnectToRouter = 0;
+                    wifiState = wifi_state_connected;
+                    wlanConnectedToAP = 1;
                     timeoutCount = 0;
+                    taskPost(&wifiTask);
                 }
             }
             break;
@@ -678,11 +954,15 @@ void SimpleLinkNetAppEventHandler(SlNetAppEvent_t *pNetAppEvent)
                                          0));
 #endif
         // Stop the provisioning timeout timer
-        stopMiscOneShotTimer();
+        timerWheelStop(&provisionTimer);
+        profilerBootPhase(boot_phase_network);
 
-        // When we acquire an IP, let the WiFi connection loop know the board is connected to an AP
-        wlanConnectToRouter = 0;
+        // When we acquire an IP, let the WiFi task know the board is connected to an AP. A new
+        // address also needs a new command socket, the WiFi task has it opened again.
+        wifiState = wifi_state_connected;
+        wlanConnectedToAP = 1;
         timeoutCount = 0;
+        taskPost(&wifiTask);
 
         // We are now connected - let the user know by turning off the pairing LED
         PAIRING_LED_OFF();
@@ -695,6 +975,7 @@ void SimpleLinkNetAppEventHandler(SlNetAppEvent_t *pNetAppEvent)
 #ifdef DEBUG_SESSION
         UART_PRINT("IPv4 lost Id or timeout, Id [0x%x]!!!\r\n", pNetAppEvent->Id);
 #endif
+        wifiConnectionLost();
     }
     break;
 
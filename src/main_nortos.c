@@ -33,26 +33,50 @@
 
 /*
  *  ======== main_nortos.c ========
- *  This file represents the main logic control for the NCIR project
+ *  This file represents the main logic control for the NCIR project. The same file builds
+ *  the NoRTOS main loop and, with TASK_THREADS defined, the FreeRTOS build that runs the
+ *  network, IR and storage work from their own threads.
  */
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <stddef.h>
+#ifdef TASK_THREADS
+#include <FreeRTOS.h>
+#include <task.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <ti/drivers/dpl/HwiP.h>
+#else
 #include <NoRTOS.h>
+#endif
 // Driver Header files
 #include <ti/drivers/GPIO.h>
+#include <ti/drivers/SPI.h>
 // Driver for NVS
 #include <ti/drivers/NVS.h>
+// Power policy for sleeping while the main loop waits
+#include <ti/drivers/Power.h>
 // Board Header file
 #include "Board.h"
 #include "Filesystem.h"
 #include "Wifi.h"
+#include "Mdns_Service.h"
 #include "Button.h"
 #include "IR_Emitter.h"
 #include "IR_Receiver.h"
+#include "Scheduler.h"
+#include "Timer_Wheel.h"
+#include "Profiler.h"
+#define TRACE_FILE trace_file_main
+#include "Trace.h"
+#include "Task_Queue.h"
+#include "Reply_Cache.h"
+#include "Admission.h"
 #include "Control_States.h"
 
 #ifdef DEBUG_SESSION
@@ -61,6 +85,9 @@
 
 // Constants
 #define BUFF_SIZE 256
+#define RECV_BUFF_SIZE 1024  // a batch carries several commands in one datagram
+#define BATCH_REPLY_SIZE 1024 // replies of a batch are sent together, in more datagrams if they do not fit
+#define COMMAND_PORT 44444
 #define ARG_LENGTH 32
 
 #define SOCKET_ERROR         "Error Creating Socket"
@@ -70,15 +97,175 @@
 #define BUTTON_DELETE_ERROR  "Error Deleting Button"
 #define BUTTON_SEND_ERROR    "Error Sending Button"
 #define BUTTON_REFRESH_ERROR "Error Refreshing Button List"
+#define SET_CHANNEL_ERROR    "Error Setting Button Channel"
+#define MACRO_ADD_ERROR      "Error Adding Macro"
+#define JOB_ADD_ERROR        "Error Scheduling Button"
+#define JOB_CANCEL_ERROR     "Error Cancelling Job"
+#define TRACE_SET_ERROR      "Error Setting Trace Level"
+#define POWER_POLICY_ERROR   "Error Setting Power Policy"
+#define GLITCH_FILTER_ERROR  "Error Setting Glitch Filter"
 #define DEVICE_INFO_ERROR    "Error Sending Device Information"
 #define SEND_ERROR           "Error Sending Message"
+#define BATCH_SAVE_ERROR     "Error Saving Button Table"
 
 #define READY_REC            "ready_to_record"
+#define RECORD_TIMEOUT       "record_timeout"
 #define BTN_NOT_AVAILABLE    "button_not_available"
+#define EMITTER_BUSY         "emitter_busy"
+#define COMMAND_BUSY         "command_busy"
+#define CLOCK_NOT_SET        "clock_not_set"
+#define TRACE_LEVEL_SET      "trace_level_set"
+
+#define SEND_CHANNEL_BUSY    -2
+#define LEARN_TIMEOUT_MS     15000 // give up waiting for a signal to record after this long
+#define SELECT_MIN_WAIT_MS   10    // sl_Select rounds shorter timeouts up to this, so sleep until a task instead
+#define SELECT_MAX_WAIT_MS   1000
+#define LEARN_POLL_MS        50    // how often the main loop looks for a captured signal while learning
+#define NETWORK_POLL_MS      10    // how often sl_Task runs while there is no socket to wait on
+#define TRACE_DUMP_WORDS     256   // trace words sent per trace_dump reply
+#define DEFERRED_COMMANDS    4     // bulk commands waiting for the bulk task, more are dropped
+#define MACRO_MAX_DELAY_MS   ((EMITTER_GAP_EDGES * EMITTER_MAX_GAP_US) / 1000) // the delay is sent as the trailing gap of the step
+
+#ifdef TASK_THREADS
+// Thread priorities of the threaded build, the SimpleLink host driver needs its spawn thread above the rest
+#define SPAWN_THREAD_PRIORITY   9
+#define IR_THREAD_PRIORITY      8 // task_priority_high
+#define RECEIVE_THREAD_PRIORITY 6 // network receive, also runs the start up
+#define COMMAND_THREAD_PRIORITY 4 // task_priority_normal
+#define STORAGE_THREAD_PRIORITY 2 // task_priority_low
+#define SPAWN_STACK_SIZE        2048
+#define THREAD_STACK_SIZE       4096
+#define DATAGRAM_QUEUE_SIZE     4     // datagrams received ahead of the command task
+#define RECEIVE_RETRY_MS        100   // how often the receive thread checks for a socket while there is none
+#endif
+
+// State of the macro being run, one step is sent at a time
+typedef struct
+{
+    MacroStep* steps;
+    uint16_t numSteps;
+    uint16_t currentStep;
+    int channel;         // channel the current step is being sent on, -1 until it has started
+    uint32_t elapsed_us;
+    char name[ARG_LENGTH];
+    int index;
+    ReplyAddr replyAddr;
+} MacroRun;
+
+// A bulk command waiting for the bulk task, with the client it replies to
+typedef struct
+{
+    char command[RECV_BUFF_SIZE];
+    ReplyAddr replyTo;
+    PowerPolicy arrivalPolicy;
+} DeferredCommand;
+
+#ifdef TASK_THREADS
+// A datagram the receive thread took from the socket, waiting for the command task
+typedef struct
+{
+    char data[RECV_BUFF_SIZE];
+    _i16 length;
+    SlSockAddrIn_t from;
+} Datagram;
+#endif
+
+static MacroRun macroRun = {0};
+
+// Socket and buffers shared by the tasks of the main loop
+static _i16 Sd = -1;
+static _i16 Status;
+static SlSockAddrIn_t Addr;
+static SlSocklen_t AddrSize = sizeof(SlSockAddrIn_t);
+static char recBuf[RECV_BUFF_SIZE] = {0};
+static ReplyAddr replyTo; // the client of the command being run
+
+// Replies to the commands of a batch are collected here, and sent together once it is done
+static char batchReply[BATCH_REPLY_SIZE];
+static uint16_t batchReplyLength = 0;
+static bool batchRunning = false;
+
+// Bulk commands run from a low priority task, after every command waiting in the socket
+static DeferredCommand deferredCommands[DEFERRED_COMMANDS];
+static uint8_t deferredHead = 0;
+static uint8_t deferredCount = 0;
+static char sendBuf[BUFF_SIZE] = {0};
+static ControlState currState = idle;
+
+// The button_sent reply of each output channel waits until the emitter reports that the IR sequence went out
+static ReplyAddr sentReplyAddr[EMITTER_CHANNEL_COUNT];
+static char sentButtonName[EMITTER_CHANNEL_COUNT][ARG_LENGTH] = {0};
+static int sentButtonIndex[EMITTER_CHANNEL_COUNT] = {0};
+// Scheduled sends have nobody waiting for a reply
+static bool sentReply[EMITTER_CHANNEL_COUNT] = {false};
+
+// The button being learned, saved by the learn task once a signal was captured or the wait timed out
+static bool learning = false;
+static char learnName[ARG_LENGTH];
+static ReplyAddr learnReplyAddr;
+static WheelTimer learnTimer;
+
+// The boot report is sent along with the first app_init reply
+static bool bootReported = false;
+
+// Reports are built by low priority tasks for the client that asked last
+static ReplyAddr refreshReplyAddr;
+static ReplyAddr statsReplyAddr;
+static bool statsReset = false;
+
+static Task emitterTask;
+static Task commandTask;
+static Task learnTask;
+static Task refreshTask;
+static Task statsTask;
+static Task networkTask;
+static Task serviceTask;
+static Task bulkTask;
+
+#ifdef TASK_THREADS
+// Filled by the receive thread while the tasks run, so a slow task does not keep datagrams in the NWP
+// The command task only moves the head and the receive thread only the tail, the count is changed masked
+static Datagram datagrams[DATAGRAM_QUEUE_SIZE];
+static uint8_t datagramHead = 0;
+static uint8_t datagramTail = 0;
+static volatile uint8_t datagramCount = 0;
+static sem_t datagramSlots; // free datagrams, the receive thread waits on it while the queue is full
+#endif
+
+static void emitterTaskFxn(Task* task);
+static void commandTaskFxn(Task* task);
+static void learnTaskFxn(Task* task);
+static void refreshTaskFxn(Task* task);
+static void statsTaskFxn(Task* task);
+static void networkTaskFxn(Task* task);
+static void serviceTaskFxn(Task* task);
+static void bulkTaskFxn(Task* task);
+static void learnTimeoutHandler(WheelTimer* timer);
+static void* mainThread(void* arg0);
+#ifdef TASK_THREADS
+static void* receiveThread(void* arg0);
+static void* taskThread(void* arg0);
+static void startThread(void* (*function)(void*), void* arg, int priority, size_t stackSize);
+static _i16 takeDatagram(char* buffer, SlSockAddrIn_t* from);
+#else
+static void waitForCommand();
+static void waitForTask(uint32_t timeout_ms);
+#endif
+static bool runCommand(char* command, PowerPolicy arrivalPolicy);
+static void runBatch(char* batch, PowerPolicy arrivalPolicy);
+static int sendReply(const ReplyAddr* to, const void* reply, uint16_t length);
+static int sendDatagram(const ReplyAddr* to, const void* datagram, uint16_t length);
+static void sendBusyReply(const ReplyAddr* to);
+static void flushBatchReply();
 
 int compareButtonNames(char* suppliedName, uint8_t buttonIndex);
 char* createButtonRefreshBuffer();
 void toLower(char* string);
+bool emitterIdle();
+uint32_t mainLoopWaitTime();
+int startButtonSend(uint16_t buttonIndex, uint32_t trailingGap_us);
+int parseMacroStep(char* stepString, MacroStep* step);
+void endMacro();
 
 #ifdef DEBUG_SESSION
 void fileSystemTestCode();
@@ -91,390 +278,1636 @@ void pairingLEDTestBlink();
  */
 int main(void)
 {
+    // Time the boot phases from here on
+    profilerStartClock();
+
     // Call driver init functions
     Board_initGeneral();
 
+#ifdef TASK_THREADS
+    // Start up continues in a thread, the SimpleLink host driver needs the kernel running
+    startThread(mainThread, NULL, RECEIVE_THREAD_PRIORITY, THREAD_STACK_SIZE);
+    vTaskStartScheduler();
+#else
     // Start NoRTOS
     NoRTOS_start();
+    mainThread(NULL);
+#endif
+
+    return (0);
+}
+
+/**
+ * Starts every subsystem and then runs the work of the board: the main loop in the NoRTOS
+ * build, the network receive thread in the threaded build
+ * @param arg0 not used, but necessary for the thread function
+ * @return never returns
+ */
+static void* mainThread(void* arg0)
+{
+    profilerBootPhase(boot_phase_board);
+
+    // Let the CPU sleep whenever NoRTOS is idle, e.g. while sl_Select blocks. The running
+    // timers keep the power policy from going into LPDS, so it only ever waits for an interrupt.
+    Power_enablePolicy();
 
 #ifdef DEBUG_SESSION
     // Terminal Initialization
     InitTerm();
 #endif
 
-    // Enable the file system NVS driver
-    filesystem_init();
+#ifdef TASK_THREADS
+    // Tasks can be posted by the timers and interrupts as soon as they start
+    taskQueue_init();
+    sem_init(&datagramSlots, 0, DATAGRAM_QUEUE_SIZE);
 
-    // Start the Network Processor for WiFi
-    wifi_init();
+    // The SimpleLink host driver handles the events of the NWP from its spawn thread, instead of sl_Task polls
+    startThread(sl_Task, NULL, SPAWN_THREAD_PRIORITY, SPAWN_STACK_SIZE);
+#endif
+
+    // Start the software timers, Wi-Fi provisioning already uses them
+    timerWheel_init();
+
+    // Start the cycle counter for the monotonic clock and the timing probes
+    profiler_init();
+
+    // Record trace calls up to the compile-time level
+    trace_init();
+
+    // Call driver initialization functions, only once as GPIO_init drops the IR callbacks
+    GPIO_init();
+    SPI_init();
+
+    // Enable IR receiver and emitter first, so passthrough works while the network comes up
+    IR_Init_Receiver();
+    IR_Init_Emitter();
+    profilerBootPhase(boot_phase_ir);
+
+    // Start the Network Processor for the file system, it connects to the last AP in the background
+    filesystem_init();
 
     // Start the button subsystem that utilizes the file system
     button_init();
 
+    // Restore the scheduled button sends, they wait for the clock to be set
+    scheduler_init();
+    profilerBootPhase(boot_phase_storage);
+
     // If we are in debug mode, this will print the current file system arrangement to the console
     fsPrintInfo();
 
-    // Call driver initialization functions
-    GPIO_init();
+    // Connect to the AP in the background, or provision the board if it has none
+    wifi_init();
 
-    // Enable IR receiver and emitter
-    IR_Init_Receiver();
-    IR_Init_Emitter();
+    // Run the radio power policy selected with power_policy, always on unless another one was selected
+    wifiLoadPowerPolicy();
+
+    // Every piece of work of the main loop is a task. Sends are high priority, so a button goes
+    // out before any command, learning, flash write or report that is waiting to run.
+    taskCreate(&emitterTask, emitterTaskFxn, task_priority_high);
+    taskCreate(&commandTask, commandTaskFxn, task_priority_normal);
+    taskCreate(&learnTask, learnTaskFxn, task_priority_normal);
+    taskCreate(&refreshTask, refreshTaskFxn, task_priority_low);
+    taskCreate(&statsTask, statsTaskFxn, task_priority_low);
+    taskCreate(&networkTask, networkTaskFxn, task_priority_normal);
+    taskCreate(&serviceTask, serviceTaskFxn, task_priority_low);
+    taskCreate(&bulkTask, bulkTaskFxn, task_priority_low);
+
+    // The command socket is opened once the board has an IP address, and again after every reconnect
+    wifiSetNetworkTask(&networkTask);
+
+    // The mDNS record carries the button count and table generation, so it is updated with the table
+    buttonSetTableChangeTask(&serviceTask);
+
+    // The emitter and receiver interrupts post the task that finishes their work
+    IRemitterSetCompletionTask(&emitterTask);
+    IRreceiverSetCaptureTask(&learnTask);
+
+#ifdef TASK_THREADS
+    // Sends preempt everything else, commands and learning go before flash writes and reports
+    startThread(taskThread, (void*)task_priority_high, IR_THREAD_PRIORITY, THREAD_STACK_SIZE);
+    startThread(taskThread, (void*)task_priority_normal, COMMAND_THREAD_PRIORITY, THREAD_STACK_SIZE);
+    startThread(taskThread, (void*)task_priority_low, STORAGE_THREAD_PRIORITY, THREAD_STACK_SIZE);
+
+    receiveThread(NULL);
+#else
+    while (1)
+    {
+        //The SimpleLink host driver architecture mandate calling 'sl_task' in
+        //a NO-RTOS application's main loop.
+        //The purpose of this call, is to handle asynchronous events and get
+        //flow control information sent from the NWP.
+        //Every event is classified and later handled by the host driver
+        //event handlers.
+        sl_Task(NULL);
+
+        // Run one task per pass, highest priority first, and wait for the network once none is left
+        if (!taskRunNext())
+        {
+            waitForCommand();
+        }
+    }
+#endif
+
+    return (NULL);
+}
+
+#ifdef TASK_THREADS
+/**
+ * Runs the tasks of one priority, posted from interrupts, timers and other tasks
+ * @param arg0 the TaskPriority the thread runs
+ * @return never returns
+ */
+static void* taskThread(void* arg0)
+{
+    TaskPriority priority = (TaskPriority)(uintptr_t)arg0;
+
+    while (1)
+    {
+        taskWaitAndRun(priority);
+    }
+
+    return (NULL);
+}
+
+/**
+ * Takes datagrams from the command socket as they arrive, while the tasks run, and posts
+ * the command task for them. Also posts the emitter task once a scheduled send is due,
+ * which the main loop does while it is idle in the NoRTOS build.
+ * @param arg0 not used, but necessary for the thread function
+ * @return never returns
+ */
+static void* receiveThread(void* arg0)
+{
+    while (1)
+    {
+        // The scheduler and the socket belong to the tasks, so only look at them under the task lock
+        taskLock();
+        uint32_t waitTime_ms = schedulerGetTimeUntilDue();
+        _i16 sd = ((Sd >= 0) && (wifiGetState() == wifi_state_connected)) ? Sd : -1;
+        taskUnlock();
+
+        if (waitTime_ms == 0)
+        {
+            taskPost(&emitterTask);
+        }
+
+        if (waitTime_ms > SELECT_MAX_WAIT_MS)
+        {
+            waitTime_ms = SELECT_MAX_WAIT_MS;
+        }
+
+        if ((sd < 0) || (waitTime_ms < SELECT_MIN_WAIT_MS))
+        {
+            // No socket while the WiFi task reconnects, or a scheduled send is due sooner than sl_Select can wait
+            uint32_t sleep_ms = ((sd < 0) && (waitTime_ms > RECEIVE_RETRY_MS)) ? RECEIVE_RETRY_MS : waitTime_ms;
+            usleep(((sleep_ms > 0) ? sleep_ms : 1) * 1000);
+        }
+        else
+        {
+            PROFILE_BEGIN(probe_socket_wait);
+            SlFdSet_t readSet;
+            SlTimeval_t timeout;
+            SL_SOCKET_FD_ZERO(&readSet);
+            SL_SOCKET_FD_SET(sd, &readSet);
+            timeout.tv_sec = waitTime_ms / 1000;
+            timeout.tv_usec = (waitTime_ms % 1000) * 1000;
+
+            bool readable = (sl_Select(sd + 1, &readSet, NULL, NULL, &timeout) > 0);
+            PROFILE_END(probe_socket_wait);
+
+            if (readable)
+            {
+                // Wait for the command task to free a datagram if it is behind
+                sem_wait(&datagramSlots);
+
+                Datagram* datagram = &datagrams[datagramTail];
+                SlSocklen_t fromSize = sizeof(SlSockAddrIn_t);
+                datagram->length = sl_RecvFrom(sd, datagram->data, RECV_BUFF_SIZE - 1, 0, (SlSockAddr_t*)&datagram->from, &fromSize);
+
+                if (datagram->length > 0)
+                {
+                    datagramTail = (datagramTail + 1) % DATAGRAM_QUEUE_SIZE;
+                    uintptr_t key = HwiP_disable();
+                    datagramCount++;
+                    HwiP_restore(key);
+                    taskPost(&commandTask);
+                }
+                else
+                {
+                    sem_post(&datagramSlots);
+                }
+            }
+        }
+    }
+
+    return (NULL);
+}
+
+/**
+ * Starts a detached thread
+ * @param function The thread function
+ * @param arg The argument of the thread function
+ * @param priority The priority of the thread
+ * @param stackSize The stack of the thread in bytes
+ */
+static void startThread(void* (*function)(void*), void* arg, int priority, size_t stackSize)
+{
+    pthread_t thread;
+    pthread_attr_t attrs;
+    struct sched_param priParam;
+
+    pthread_attr_init(&attrs);
+    priParam.sched_priority = priority;
+    pthread_attr_setschedparam(&attrs, &priParam);
+    pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attrs, stackSize);
+
+    if (pthread_create(&thread, &attrs, function, arg) != 0)
+    {
+        TRACE1(trace_module_main, TRACE_LEVEL_ERROR, "thread of priority %d not started", priority);
+        while (1);
+    }
+
+    pthread_attr_destroy(&attrs);
+}
+
+/**
+ * Takes the oldest datagram the receive thread queued
+ * @param buffer Receives the datagram, RECV_BUFF_SIZE long
+ * @param from Receives the address the datagram came from
+ * @return the length of the datagram, SL_EAGAIN if none is queued
+ */
+static _i16 takeDatagram(char* buffer, SlSockAddrIn_t* from)
+{
+    _i16 RetVal = SL_EAGAIN;
+
+    if (datagramCount > 0)
+    {
+        Datagram* datagram = &datagrams[datagramHead];
+        memcpy(buffer, datagram->data, datagram->length);
+        *from = datagram->from;
+        RetVal = datagram->length;
+
+        datagramHead = (datagramHead + 1) % DATAGRAM_QUEUE_SIZE;
+        uintptr_t key = HwiP_disable();
+        datagramCount--;
+        HwiP_restore(key);
+        sem_post(&datagramSlots);
+    }
+
+    return RetVal;
+}
+#endif
+
+/**
+ * This task opens the UDP command socket once the board has an IP address. The socket of
+ * the last connection is closed first, it is no longer bound once the NWP restarted.
+ * @param task the network task (not used, but necessary for the task function)
+ */
+static void networkTaskFxn(Task* task)
+{
+    if (Sd >= 0)
+    {
+        sl_Close(Sd);
+        Sd = -1;
+    }
 
     /***********************************************************************
      * Init UDP for non-blocking sockets
      ***********************************************************************/
-    // Initialize socket and buffers
-    _i16 Sd;
-    _i16 Status;
-    SlSockAddrIn_t Addr;
-    char recBuf[BUFF_SIZE] = {0};
-    char sendBuf[BUFF_SIZE] = {0};
+    // Initialize socket
     Sd = sl_Socket(SL_AF_INET, SL_SOCK_DGRAM, 0);
     if( 0 > Sd )
     {
 #ifdef DEBUG_SESSION
         UART_PRINT("\r\n%s\r\n", SOCKET_ERROR);
+#endif
+        TRACE1(trace_module_main, TRACE_LEVEL_ERROR, "socket failed %d", Sd);
+    }
+    else
+    {
+        // Binding Socket
+        Addr.sin_family = SL_AF_INET;
+        Addr.sin_port = sl_Htons(COMMAND_PORT);
+        Addr.sin_addr.s_addr = SL_INADDR_ANY;
+        Status = sl_Bind(Sd, ( SlSockAddr_t *)&Addr, AddrSize);
+        if( Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", BINDING_ERROR);
+#endif
+            TRACE1(trace_module_main, TRACE_LEVEL_ERROR, "bind failed %d", Status);
+            sl_Close(Sd);
+            Sd = -1;
+        }
+        else
+        {
+            // Retrieved from http://e2e.ti.com/support/wireless-connectivity/wifi/f/968/t/368485
+            // Enables non blocking networking receiving
+            SlSockNonblocking_t enableOption;
+            enableOption.NonBlockingEnabled = 1;
+            sl_SetSockOpt(Sd,SL_SOL_SOCKET,SL_SO_NONBLOCKING, (_u8 *)&enableOption,sizeof(enableOption));
+
+            profilerBootPhase(boot_phase_serving);
+
+            // Let clients find the command socket through mDNS
+            taskPost(&serviceTask);
+        }
+    }
+}
+
+/**
+ * This task advertises the command socket as an mDNS service, once it is open and
+ * again whenever the button table changes
+ * @param task the service task (not used, but necessary for the task function)
+ */
+static void serviceTaskFxn(Task* task)
+{
+    if ((Sd >= 0) && (wifiGetState() == wifi_state_connected))
+    {
+        mdnsAdvertiseService(COMMAND_PORT, getNumButtons(), getButtonTableGeneration());
+    }
+}
+
+/**
+ * This task finishes button sends once the emitter is done with the IR LED of their channel,
+ * and starts the next macro step and any scheduled send that is due
+ * @param task the emitter task (not used, but necessary for the task function)
+ */
+static void emitterTaskFxn(Task* task)
+{
+    // Finish a button send once the emitter is done with the IR LED of its channel
+    for (uint8_t channel = 0; channel < EMITTER_CHANNEL_COUNT; channel++)
+    {
+        uint32_t emissionTime_us;
+        if (IRemitterCompleted(channel, &emissionTime_us))
+        {
+            // A macro step finished, including the delay after it
+            if ((macroRun.steps != NULL) && (macroRun.channel == channel))
+            {
+                macroRun.elapsed_us += emissionTime_us;
+                macroRun.currentStep++;
+                macroRun.channel = -1;
+
+                if (macroRun.currentStep < macroRun.numSteps)
+                {
+                    sprintf(sendBuf, "\r\nmacro_progress,%s,%d,%d\r\n", macroRun.name, macroRun.currentStep, macroRun.numSteps);
+                }
+                else
+                {
+                    sprintf(sendBuf, "\r\nmacro_done,%s,%d,%d\r\n", macroRun.name, macroRun.index, macroRun.elapsed_us / 1000);
+                }
+                Status = sendReply(&macroRun.replyAddr, sendBuf, strlen(sendBuf));
+                if( strlen(sendBuf) != Status )
+                {
+#ifdef DEBUG_SESSION
+                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                }
+                if (macroRun.currentStep >= macroRun.numSteps)
+                {
+                    endMacro();
+                }
+            }
+            else if (sentReply[channel])
+            {
+                sprintf(sendBuf, "\r\nbutton_sent,%s,%d,%d\r\n", sentButtonName[channel], sentButtonIndex[channel], emissionTime_us);
+                Status = sendReply(&sentReplyAddr[channel], sendBuf, strlen(sendBuf));
+                sentReply[channel] = false;
+                if( strlen(sendBuf) != Status )
+                {
+#ifdef DEBUG_SESSION
+                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                }
+            }
+
+            // Start edge detection again once our own output can no longer be picked up
+            if (emitterIdle())
+            {
+                IRstartEdgeDetectGPIO();
+                currState = idle;
+            }
+        }
+    }
+
+    // Start the next step of a running macro as soon as its output channel is free
+    if ((macroRun.steps != NULL) && (macroRun.channel < 0))
+    {
+        MacroStep* step = &macroRun.steps[macroRun.currentStep];
+        int channel = startButtonSend(step->buttonIndex, (uint32_t)step->delay_ms * 1000);
+
+        if (channel >= 0)
+        {
+            macroRun.channel = channel;
+            currState = send_button;
+        }
+        else if (channel != SEND_CHANNEL_BUSY)
+        {
+            sprintf(sendBuf, "\r\nmacro_error,%s,%d\r\n", macroRun.name, macroRun.currentStep);
+            Status = sendReply(&macroRun.replyAddr, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+            endMacro();
+
+            if (emitterIdle())
+            {
+                IRstartEdgeDetectGPIO();
+                currState = idle;
+            }
+        }
+    }
 
-        // At this point, we can't go any further, so try to restart
-        resetBoard();
+    // Send the earliest scheduled button once it is due. A job whose channel is still
+    // sending stays at the top of the queue and is tried again on the next pass.
+    ScheduledJob job;
+    if (schedulerGetDueJob(&job))
+    {
+        int channel = startButtonSend(job.buttonIndex, 0);
+
+        if (channel != SEND_CHANNEL_BUSY)
+        {
+            if (channel >= 0)
+            {
+                sentReply[channel] = false;
+                currState = send_button;
+            }
+            else
+            {
+                TRACE2(trace_module_main, TRACE_LEVEL_ERROR, "scheduled job %u failed for button %u", job.jobId, job.buttonIndex);
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\nScheduled job %d failed\r\n", job.jobId);
 #endif
+            }
+            schedulerJobDone(job.jobId);
+        }
+    }
+}
+
+/**
+ * This task receives one datagram and runs the command in it. The task posts itself
+ * again after a datagram, so every queued datagram is handled with more urgent tasks
+ * getting to run in between.
+ * @param task the command task
+ */
+static void commandTaskFxn(Task* task)
+{
+    // Clear the send and receive buffers
+    if (recBuf[0] != NULL)
+    {
+        memset(recBuf, NULL, sizeof(recBuf));
     }
 
-    // Binding Socket
+    if (recBuf[0] != NULL)
+    {
+        memset(sendBuf, NULL, sizeof(sendBuf));
+    }
+
+    // Reinitialize address structure to avoid potential errors
     Addr.sin_family = SL_AF_INET;
-    Addr.sin_port = sl_Htons(44444);
+    Addr.sin_port = sl_Htons(COMMAND_PORT);
     Addr.sin_addr.s_addr = SL_INADDR_ANY;
-    SlSocklen_t AddrSize = sizeof(SlSockAddrIn_t);
-    Status = sl_Bind(Sd, ( SlSockAddr_t *)&Addr, AddrSize);
-    if( Status )
+
+#ifdef TASK_THREADS
+    // The receive thread already took the datagram from the socket, leaving room for the NULL character
+    Status = takeDatagram(recBuf, &Addr);
+#else
+    // Receive data from the network, leaving room for the NULL character
+    Status = sl_RecvFrom(Sd, recBuf, RECV_BUFF_SIZE - 1, 0, ( SlSockAddr_t *)&Addr, &AddrSize);
+#endif
+    if(Status < 0 && Status != SL_EAGAIN)
     {
 #ifdef DEBUG_SESSION
-        UART_PRINT("\r\n%s\r\n", BINDING_ERROR);
-
-        // At this point, we can't go any further, so try to restart
-        resetBoard();
+        UART_PRINT("\r\n%s\r\n", RECEIVING_ERROR);
 #endif
     }
 
-    // Retrieved from http://e2e.ti.com/support/wireless-connectivity/wifi/f/968/t/368485
-    // Enables non blocking networking receiving
-    SlSockNonblocking_t enableOption;
-    enableOption.NonBlockingEnabled = 1;
-    sl_SetSockOpt(Sd,SL_SOL_SOCKET,SL_SO_NONBLOCKING, (_u8 *)&enableOption,sizeof(enableOption));
+    // Data was received
+    if (Status > 0)
+    {
+        PROFILE_BEGIN(probe_udp_command);
 
-    // Within the network processor, UDP TX packets are buffered due to how the WiFi standard works.
-    // Because of this, UDP packet reception times may vary significantly. This power setting policy is
-    // utilized to maintain a much more consistent UDP reception time, and thus a more "snappy" application.
-    sl_WlanPolicySet(SL_WLAN_POLICY_PM , SL_WLAN_ALWAYS_ON_POLICY, NULL, 0);
+        // Keep the radio responsive for the rest of the burst, the probes keep the policy it arrived under
+        PowerPolicy arrivalPolicy = wifiGetActivePowerPolicy();
+        uint32_t arrivalCycles = PROFILER_CYCLES();
+        wifiNoteActivity();
 
-    ControlState currState = idle;
-    while (1)
+        // More datagrams may be queued behind this one
+        taskPost(task);
+        TRACE1(trace_module_main, TRACE_LEVEL_DEBUG, "command of %d bytes received", Status);
+#ifdef DEBUG_SESSION
+        UART_PRINT("\r\nReceived: %s\r\n", recBuf);
+#endif
+
+        // A command may start with a sequence number, its replies then start with it too
+        char* command = recBuf;
+        replyTo.addr = Addr;
+        replyTo.hasSeq = replyParseSeq(&command, &replyTo.seq);
+
+        // Bulk commands are dropped once too many are waiting, before they take any tokens,
+        // and told so, as they would otherwise be retried blindly. Commands over the rate of
+        // their client are dropped silently before they cost anything else.
+        CommandClass commandClass = admissionClassify(command);
+        if ((commandClass == command_class_bulk) && (deferredCount == DEFERRED_COMMANDS))
+        {
+            admissionNoteDeferred(false);
+            sendBusyReply(&replyTo);
+        }
+        else if (admissionAdmit(&Addr, commandClass))
+        {
+            // A retried command is answered from the reply cache instead of being run again
+            const char* cachedReply = NULL;
+            uint16_t cachedLength = 0;
+            ReplyCacheResult cacheResult = replyTo.hasSeq ? replyCacheCheck(&replyTo, &cachedReply, &cachedLength) : reply_cache_miss;
+
+            if (cacheResult == reply_cache_hit)
+            {
+                sl_SendTo(Sd, cachedReply, cachedLength, 0, (SlSockAddr_t*)&replyTo.addr, sizeof(SlSockAddr_t));
+            }
+            else if (cacheResult == reply_cache_miss)
+            {
+                // Bulk commands wait until every send and other command in the socket has been run
+                if (commandClass == command_class_bulk)
+                {
+                    DeferredCommand* deferred = &deferredCommands[(deferredHead + deferredCount) % DEFERRED_COMMANDS];
+                    strncpy(deferred->command, command, RECV_BUFF_SIZE - 1);
+                    deferred->command[RECV_BUFF_SIZE - 1] = '\0';
+                    deferred->replyTo = replyTo;
+                    deferred->arrivalPolicy = arrivalPolicy;
+                    deferredCount++;
+
+                    admissionNoteDeferred(true);
+                    taskPost(&bulkTask);
+                }
+                // A command that ran without replying still answers its retries
+                else if (!runCommand(command, arrivalPolicy) && replyTo.hasSeq)
+                {
+                    replyCacheComplete(&replyTo);
+                }
+            }
+        }
+
+        PROFILE_END(probe_udp_command);
+        profilerRecord((ProfileProbe)(probe_command_always_on + arrivalPolicy), arrivalCycles);
+    }
+}
+
+/**
+ * This task runs the oldest deferred bulk command. It is low priority, so sends and other
+ * commands that arrive meanwhile go first. A batch runs each of its commands in order.
+ * @param task the bulk task, posted again while more commands wait
+ */
+static void bulkTaskFxn(Task* task)
+{
+    if (deferredCount > 0)
     {
-        //The SimpleLink host driver architecture mandate calling 'sl_task' in
-        //a NO-RTOS application's main loop.
-        //The purpose of this call, is to handle asynchronous events and get
-        //flow control information sent from the NWP.
-        //Every event is classified and later handled by the host driver
-        //event handlers.
-        sl_Task(NULL);
+        DeferredCommand* deferred = &deferredCommands[deferredHead];
+        bool replyLater = false;
+        replyTo = deferred->replyTo;
+
+        if (strncasecmp(deferred->command, BATCH_STR, strlen(BATCH_STR)) == 0)
+        {
+            runBatch(deferred->command, deferred->arrivalPolicy);
+        }
+        else
+        {
+            replyLater = runCommand(deferred->command, deferred->arrivalPolicy);
+        }
+
+        if (!replyLater && replyTo.hasSeq)
+        {
+            replyCacheComplete(&replyTo);
+        }
+
+        deferredHead = (deferredHead + 1) % DEFERRED_COMMANDS;
+        deferredCount--;
+        if (deferredCount > 0)
+        {
+            taskPost(task);
+        }
+    }
+}
+
+/**
+ * Runs one command and replies to the client of the command being run
+ * @param command The command and its arguments, changed while they are parsed
+ * @param arrivalPolicy The power policy the command arrived under, for the ping reply
+ * @return true if the reply is sent later on by a task, e.g. button_sent or the button list
+ */
+static bool runCommand(char* command, PowerPolicy arrivalPolicy)
+{
+    bool replyLater = false;
+
+    // Parse the command and its arguments
+    char *strState;
+    char *arg1;
+    char *arg2;
+    char *arg3;
+    char *arg4;
+    const char delim[2] = ",";
+    strState = strtok(command, delim);
+    arg1 = strtok(NULL, delim);
+    arg2 = strtok(NULL, delim);
+    arg3 = strtok(NULL, delim);
+    arg4 = strtok(NULL, delim);
+    toLower(strState);
+
+    // SEND_BUTTON: Sends button with IR and reports back to app
+    if(strncmp(strState, SEND_BUTTON_STR, strlen(SEND_BUTTON_STR)) == 0){
+
+        // Check if the button name argument is not empty
+        if (arg1[0] != NULL)
+        {
+            int button_index = atoi(arg2);
+
+            // Compare the name of the button the client wants to delete with
+            // the name of the button that was stored at the button index. If
+            // it does not match, send a message telling the client that their
+            // button database is out-of-date and should be updated.
+            if (compareButtonNames(arg1, button_index) == 0)
+            {
+                currState = send_button;
+                int channel = startButtonSend(button_index, 0);
+
+                if (channel >= 0)
+                {
+                    // Remember who to tell once the signal has been sent, button_sent is replied on completion
+                    strncpy(sentButtonName[channel], arg1, ARG_LENGTH - 1);
+                    sentButtonIndex[channel] = button_index;
+                    sentReplyAddr[channel] = replyTo;
+                    sentReply[channel] = true;
+                    replyLater = true;
+                }
+                else
+                {
+                    // Each output channel can only send one sequence at a time
+                    sprintf(sendBuf, "\r\n%s\r\n", (channel == SEND_CHANNEL_BUSY) ? EMITTER_BUSY : BUTTON_SEND_ERROR);
+                    Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+                    if( strlen(sendBuf) != Status )
+                    {
+#ifdef DEBUG_SESSION
+                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                    }
+
+                    // Go back into the idle state right away if nothing else is being sent
+                    if (emitterIdle())
+                    {
+                        IRstartEdgeDetectGPIO();
+                        currState = idle;
+                    }
+                }
+            }
+            else
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
+                Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+                if( strlen(sendBuf) != Status )
+                {
+#ifdef DEBUG_SESSION
+                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                }
+            }
+        }
+    }
+    // APP_INIT: Provide the app with the device IP and Name
+    else if(strncmp(strState, APP_INIT_STR, strlen(APP_INIT_STR)) == 0){
+
+        // Get the obtained IP of the device
+        uint16_t len = sizeof(SlNetCfgIpV4Args_t);
+        uint16_t configOpt = 0;
+        SlNetCfgIpV4Args_t ipV4 = {0};
+        sl_NetCfgGet(SL_NETCFG_IPV4_STA_ADDR_MODE, &configOpt, &len, (_u8 *)&ipV4);
+
+        // Get the user-assigned name of the device
+        len = DEVICE_NAME_LENGTH;
+        char deviceName[len];
+        memset(deviceName, 0, len);
+        configOpt = SL_WLAN_P2P_OPT_DEV_NAME;
+        sl_WlanGet(SL_WLAN_CFG_P2P_PARAM_ID, &configOpt , &len, (_u8*)deviceName);
+
+        currState = app_init;
+        sprintf(sendBuf, "\r\n%d.%d.%d.%d,%s\r\n",
+                         (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 3),
+                         (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 2),
+                         (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 1),
+                         (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 0),
+                         (char *)deviceName);
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", DEVICE_INFO_ERROR);
+#endif
+        }
+
+        // The first app to find the device after a boot also gets the boot report, for the fleet dashboards
+        if (!bootReported)
+        {
+            profilerFormatBootReport(sendBuf, BUFF_SIZE);
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+            bootReported = true;
+        }
+        currState = idle;
+    }
+    // BUTTON_REFRESH: Provide the app with a list of available buttons
+    else if(strncmp(strState, BUTTON_REFRESH_STR, strlen(BUTTON_REFRESH_STR)) == 0){
+        // The list is read from flash and sent by a low priority task, so sends are not held up by it
+        refreshReplyAddr = replyTo;
+        replyLater = true;
+        taskPost(&refreshTask);
+    }
+    // ADD_BUTTON: Record the button and report back to the application
+    else if(strncmp(strState, ADD_BUTTON_STR, strlen(ADD_BUTTON_STR)) == 0){
+
+        // Check if the name argument is not empty
+        if (arg1[0] != NULL)
+        {
+            currState = add_button;
+            IRreceiverSetMode(program);
+
+            // Let the client know that the device is waiting for an IR signal to record
+            sprintf(sendBuf, "\r\n%s\r\n", READY_REC);
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+
+            // The learn task saves the button once a signal was captured, or gives up after a while
+            strncpy(learnName, arg1, ARG_LENGTH - 1);
+            learnReplyAddr = replyTo;
+            learning = true;
+            timerWheelStart(&learnTimer, learnTimeoutHandler, LEARN_TIMEOUT_MS, 0);
+        }
+    }
+    // DELETE_BUTTON: Deletes button from flash and reports back to app
+    else if(strncmp(strState, DELETE_BUTTON_STR, strlen(DELETE_BUTTON_STR)) == 0){
+
+        // Check if the button name argument is not empty
+        if (arg1[0] != NULL)
+        {
+            int button_index = atoi(arg2);
+
+            // Compare the name of the button the client wants to delete with
+            // the name of the button that was stored at the button index. If
+            // it does not match, send a message telling the client that their
+            // button database is out-of-date and should be updated.
+            if (compareButtonNames(arg1, button_index) == 0)
+            {
+                currState = delete_button;
+
+                int delCheck = deleteButton(button_index);
+                if(delCheck == FILE_IO_ERROR){
+                    sprintf(sendBuf, "\r\n%s\r\n", BUTTON_DELETE_ERROR);
+                    Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+                    if( strlen(sendBuf) != Status )
+                    {
+#ifdef DEBUG_SESSION
+                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                    }
+                }
+                else{
+                    // Scheduled sends of the button would now fail
+                    schedulerCancelButtonJobs(button_index);
+
+                    sprintf(sendBuf, "\r\ndeleted_button,%s,%d\r\n", arg1, button_index);
+                    Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+                    if( strlen(sendBuf) != Status )
+                    {
+#ifdef DEBUG_SESSION
+                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                    }
+                }
+
+                currState = idle;
+            }
+            else
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
+                Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+                if( strlen(sendBuf) != Status )
+                {
+#ifdef DEBUG_SESSION
+                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                }
+            }
+        }
+    }
+    // CLEAR_ALL: Deletes all buttons on the device
+    else if(strncmp(strState, CLEAR_BUTTONS_STR, strlen(CLEAR_BUTTONS_STR)) == 0){
+        deleteAllButtons();
+        schedulerCancelAllJobs();
+    }
+    // ADD_MACRO: Stores a list of buttons to send with a delay after each one
+    else if(strncmp(strState, ADD_MACRO_STR, strlen(ADD_MACRO_STR)) == 0){
+
+        // Check if the macro name and first step are not empty
+        if ((arg1 != NULL) && (arg2 != NULL))
+        {
+            MacroStep steps[MAX_MACRO_STEPS];
+            uint16_t numSteps = 0;
+            bool error = false;
+
+            // Steps are given as <button index>:<delay in ms>
+            char* stepString = arg2;
+            char* nextString = arg3;
+            while ((stepString != NULL) && (error == false))
+            {
+                if ((numSteps < MAX_MACRO_STEPS) && (parseMacroStep(stepString, &steps[numSteps]) == 0))
+                {
+                    numSteps++;
+                }
+                else
+                {
+                    error = true;
+                }
+                stepString = nextString;
+                nextString = strtok(NULL, delim);
+            }
+
+            int macro_index = error ? FILE_IO_ERROR : createMacro((const unsigned char*)arg1, steps, numSteps);
+
+            if (macro_index == FILE_IO_ERROR)
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", MACRO_ADD_ERROR);
+            }
+            else
+            {
+                // Get the name that was saved to the button table of contents
+                // as the name could have been truncated if it was too long
+                char btnNameBuff[BUTTON_NAME_MAX_SIZE];
+                getButtonName(macro_index, btnNameBuff);
+                sprintf(sendBuf, "\r\nmacro_saved,%s,%d\r\n", btnNameBuff, macro_index);
+            }
+
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // SEND_MACRO: Runs all steps of a macro on the device and reports each one back to app
+    else if(strncmp(strState, SEND_MACRO_STR, strlen(SEND_MACRO_STR)) == 0){
+
+        // Check if the macro name argument is not empty
+        if ((arg1 != NULL) && (arg2 != NULL))
+        {
+            int macro_index = atoi(arg2);
+
+            if (compareButtonNames(arg1, macro_index) != 0)
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
+            }
+            // Only one macro runs at a time
+            else if (macroRun.steps != NULL)
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", EMITTER_BUSY);
+            }
+            else
+            {
+                macroRun.steps = getMacroSteps(macro_index, &macroRun.numSteps);
+
+                if (macroRun.steps != NULL)
+                {
+                    // The emitter task starts the first step, and every later one as the step before completes
+                    macroRun.currentStep = 0;
+                    macroRun.channel = -1;
+                    macroRun.elapsed_us = 0;
+                    macroRun.index = macro_index;
+                    macroRun.replyAddr = replyTo;
+                    strncpy(macroRun.name, arg1, ARG_LENGTH - 1);
+                    sprintf(sendBuf, "\r\nmacro_started,%s,%d,%d\r\n", arg1, macro_index, macroRun.numSteps);
+                    taskPost(&emitterTask);
+                }
+                else
+                {
+                    sprintf(sendBuf, "\r\n%s\r\n", BUTTON_SEND_ERROR);
+                }
+            }
+
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // SET_CHANNEL: Binds a button to the IR output channel it is sent on
+    else if(strncmp(strState, SET_CHANNEL_STR, strlen(SET_CHANNEL_STR)) == 0){
+
+        // Check if the button name and channel arguments are not empty
+        if ((arg1 != NULL) && (arg2 != NULL) && (arg3 != NULL))
+        {
+            int button_index = atoi(arg2);
+            int channel = atoi(arg3);
+
+            if ((compareButtonNames(arg1, button_index) == 0) && (channel >= 0) && (channel < EMITTER_CHANNEL_COUNT)
+                && (setButtonOutputChannel(button_index, channel) == 0))
+            {
+                sprintf(sendBuf, "\r\nchannel_set,%s,%d,%d\r\n", arg1, button_index, channel);
+            }
+            else
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", SET_CHANNEL_ERROR);
+            }
+
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // SET_TIME: Sets the clock that scheduled sends are compared against
+    else if(strncmp(strState, SET_TIME_STR, strlen(SET_TIME_STR)) == 0){
+
+        // The Unix time is given in seconds with optional milliseconds
+        if (arg1 != NULL)
+        {
+            uint64_t unixTime_ms = ((uint64_t)strtoul(arg1, NULL, 10) * 1000) + ((arg2 != NULL) ? atoi(arg2) : 0);
+            schedulerSetTime(unixTime_ms);
+
+            sprintf(sendBuf, "\r\ntime_set,%s\r\n", arg1);
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // SEND_AT/SEND_AFTER: Schedules a button to be sent at a Unix time in seconds or after
+    // a delay in milliseconds, optionally repeating with a period in the same unit
+    else if((strncmp(strState, SEND_AT_STR, strlen(SEND_AT_STR)) == 0) ||
+            (strncmp(strState, SEND_AFTER_STR, strlen(SEND_AFTER_STR)) == 0)){
+
+        // Check if the button name, index and time arguments are not empty
+        if ((arg1 != NULL) && (arg2 != NULL) && (arg3 != NULL))
+        {
+            int button_index = atoi(arg2);
+            bool absolute = (strncmp(strState, SEND_AT_STR, strlen(SEND_AT_STR)) == 0);
+            uint32_t scale = absolute ? 1000 : 1;
+            uint64_t dueTime = strtoull(arg3, NULL, 10);
+            uint64_t period = (arg4 != NULL) ? strtoull(arg4, NULL, 10) : 0;
+
+            // Both times are 32-bit numbers, and the period also has to fit in 32 bits once it is in ms
+            bool inRange = (dueTime <= UINT32_MAX) && (period <= UINT32_MAX) && ((period * scale) <= UINT32_MAX);
+            uint64_t dueTime_ms = dueTime * scale;
+            uint32_t period_ms = (uint32_t)(period * scale);
+
+            if (absolute == false)
+            {
+                dueTime_ms += schedulerGetTime();
+            }
+
+            // Macros run on the device step by step and cannot be scheduled, only IR buttons can
+            if ((compareButtonNames(arg1, button_index) != 0) ||
+                (getButtonCarrierFrequency(button_index) == MACRO_CARRIER_FREQUENCY))
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
+            }
+            else if (inRange == false)
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", JOB_ADD_ERROR);
+            }
+            // Jobs are kept in Unix time so they can be restored after a reset
+            else if (schedulerClockValid() == false)
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", CLOCK_NOT_SET);
+            }
+            else
+            {
+                int jobId = schedulerAddJob(button_index, dueTime_ms, period_ms);
+
+                if (jobId != SCHEDULER_ERROR)
+                {
+                    sprintf(sendBuf, "\r\njob_scheduled,%d,%s,%d\r\n", jobId, arg1, button_index);
+                }
+                else
+                {
+                    sprintf(sendBuf, "\r\n%s\r\n", JOB_ADD_ERROR);
+                }
+            }
+
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // CANCEL_JOB: Removes a scheduled send
+    else if(strncmp(strState, CANCEL_JOB_STR, strlen(CANCEL_JOB_STR)) == 0){
+
+        // Check if the job ID argument is not empty
+        if (arg1 != NULL)
+        {
+            if (schedulerCancelJob(strtoul(arg1, NULL, 10)) == 0)
+            {
+                sprintf(sendBuf, "\r\njob_cancelled,%s\r\n", arg1);
+            }
+            else
+            {
+                sprintf(sendBuf, "\r\n%s\r\n", JOB_CANCEL_ERROR);
+            }
+
+            Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
+#ifdef DEBUG_SESSION
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+            }
+        }
+    }
+    // PROFILE_STATS: Reports the timing probes, and clears them if asked to
+    else if(strncmp(strState, PROFILE_STATS_STR, strlen(PROFILE_STATS_STR)) == 0){
+        // The report is built and sent by a low priority task, so sends are not held up by it
+        statsReplyAddr = replyTo;
+        replyLater = true;
+        statsReset = ((arg1 != NULL) && (strncmp(arg1, PROFILE_RESET_ARG, strlen(PROFILE_RESET_ARG)) == 0));
+        taskPost(&statsTask);
+    }
+    // TRACE_DUMP: Sends the oldest trace records as raw words, for tools/trace_decode.py. The records
+    // are removed from the trace, the client asks again until a reply holds no words.
+    else if(strncmp(strState, TRACE_DUMP_STR, strlen(TRACE_DUMP_STR)) == 0){
+        static uint8_t dumpBuf[BUFF_SIZE + (TRACE_DUMP_WORDS * sizeof(uint32_t))];
+        uint32_t words[TRACE_DUMP_WORDS];
+        uint16_t numWords = traceRead(words, TRACE_DUMP_WORDS);
+
+        // trace_dump,<dropped records>,<words> followed by the words in the byte order of the device
+        int headerSize = sprintf((char*)dumpBuf, "\r\ntrace_dump,%u,%u\r\n", traceGetDropCount(), numWords);
+        memcpy(&dumpBuf[headerSize], words, numWords * sizeof(uint32_t));
+        uint16_t dumpSize = headerSize + (numWords * sizeof(uint32_t));
+
+        Status = sendReply(&replyTo, dumpBuf, dumpSize);
+        if(dumpSize != Status)
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // TRACE_LEVEL: Sets the most detailed trace level a module records
+    else if(strncmp(strState, TRACE_LEVEL_STR, strlen(TRACE_LEVEL_STR)) == 0){
+        if ((arg1 != NULL) && (arg2 != NULL) && traceSetLevel(atoi(arg1), atoi(arg2)))
+        {
+            sprintf(sendBuf, "\r\n%s,%d,%d\r\n", TRACE_LEVEL_SET, atoi(arg1), atoi(arg2));
+        }
+        else
+        {
+            sprintf(sendBuf, "\r\n%s\r\n", TRACE_SET_ERROR);
+        }
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // GLITCH_FILTER: Sets the shortest mark or space accepted while learning, in microseconds
+    else if(strncmp(strState, GLITCH_FILTER_STR, strlen(GLITCH_FILTER_STR)) == 0){
+        if ((arg1 != NULL) && IRsetGlitchFilter(strtoul(arg1, NULL, 10)))
+        {
+            sprintf(sendBuf, "\r\n%s,%lu\r\n", GLITCH_FILTER_STR, strtoul(arg1, NULL, 10));
+        }
+        else
+        {
+            sprintf(sendBuf, "\r\n%s\r\n", GLITCH_FILTER_ERROR);
+        }
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // BOOT_STATS: Reports when each boot phase was reached, in microseconds
+    else if(strncmp(strState, BOOT_STATS_STR, strlen(BOOT_STATS_STR)) == 0){
+        profilerFormatBootReport(sendBuf, BUFF_SIZE);
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // POWER_POLICY: Selects the radio power policy used while idle, and reports the selected and active policy
+    else if(strncmp(strState, POWER_POLICY_STR, strlen(POWER_POLICY_STR)) == 0){
+        int policy = wifiParsePowerPolicy(arg1);
+
+        if ((arg1 != NULL) && ((policy < 0) || (wifiSetPowerPolicy((PowerPolicy)policy) == FILE_IO_ERROR)))
+        {
+            sprintf(sendBuf, "\r\n%s\r\n", POWER_POLICY_ERROR);
+        }
+        else
+        {
+            sprintf(sendBuf, "\r\npower_policy,%s,%s\r\n",
+                             wifiPowerPolicyName(wifiGetPowerPolicy()),
+                             wifiPowerPolicyName(wifiGetActivePowerPolicy()));
+        }
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // PING: Replies right away, so the client can measure the round trip under the policy it arrived under
+    else if(strncmp(strState, PING_STR, strlen(PING_STR)) == 0){
+        sprintf(sendBuf, "\r\npong,%s,%s\r\n", (arg1 != NULL) ? arg1 : "", wifiPowerPolicyName(arrivalPolicy));
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // ADMISSION_STATS: Reports the admitted, dropped and deferred commands since start up
+    else if(strncmp(strState, ADMISSION_STATS_STR, strlen(ADMISSION_STATS_STR)) == 0){
+        AdmissionStats stats;
+        admissionGetStats(&stats);
+
+        // Admitted and dropped per class (interactive, normal, bulk), deferred and dropped from the deferred queue
+        sprintf(sendBuf, "\r\nadmission_stats,%u,%u,%u,%u,%u,%u,%u,%u\r\n",
+                         stats.admitted[command_class_interactive],
+                         stats.admitted[command_class_normal],
+                         stats.admitted[command_class_bulk],
+                         stats.dropped[command_class_interactive],
+                         stats.dropped[command_class_normal],
+                         stats.dropped[command_class_bulk],
+                         stats.deferred,
+                         stats.deferDropped);
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+    // EMITTER_STATS: Reports how accurately the last button was sent
+    else if(strncmp(strState, EMITTER_STATS_STR, strlen(EMITTER_STATS_STR)) == 0){
+        // The output channel is optional and defaults to the first one
+        uint8_t channel = (arg1 != NULL) ? atoi(arg1) : 0;
+        EmitterStats stats = {0};
+        IRgetEmitterStats(channel, &stats);
+
+        // Channel, intervals, carrier start/stop latency, worst edge latency, worst interval error and drift (ns)
+        sprintf(sendBuf, "\r\nemitter_stats,%d,%d,%d,%d,%d,%d,%d\r\n",
+                         channel,
+                         stats.edges,
+                         stats.carrierStartLatency_ns,
+                         stats.carrierStopLatency_ns,
+                         stats.maxEdgeLatency_ns,
+                         stats.maxIntervalError_ns,
+                         stats.cumulativeDrift_ns);
+
+        Status = sendReply(&replyTo, sendBuf, strlen(sendBuf));
+        if( strlen(sendBuf) != Status )
+        {
+#ifdef DEBUG_SESSION
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+        }
+    }
+
+    return replyLater;
+}
+
+/**
+ * Runs the commands of a batch in order. The commands follow the batch keyword, one per
+ * line. Their replies are sent together, ending with "batch,<commands run>", and the button
+ * table is written once for all of them. Replies that come later, like button_sent or the
+ * button list, are still sent on their own.
+ * @param batch The batch, changed while its commands are parsed
+ * @param arrivalPolicy The power policy the batch arrived under, for the ping reply
+ */
+static void runBatch(char* batch, PowerPolicy arrivalPolicy)
+{
+    uint16_t numCommands = 0;
+    char* command = strchr(batch, '\n');
+
+    batchRunning = true;
+    batchReplyLength = 0;
+    buttonTableBeginBatch();
+
+    while (command != NULL)
+    {
+        // Split off the next command, lines may also end with a carriage return
+        command++;
+        char* next = strchr(command, '\n');
+        if (next != NULL)
+        {
+            *next = '\0';
+            if ((next > command) && (next[-1] == '\r'))
+            {
+                next[-1] = '\0';
+            }
+        }
+
+        if (command[0] != '\0')
+        {
+            runCommand(command, arrivalPolicy);
+            numCommands++;
+        }
+        command = next;
+    }
+
+    if (buttonTableEndBatch() == FILE_IO_ERROR)
+    {
+        sprintf(sendBuf, "\r\n%s\r\n", BATCH_SAVE_ERROR);
+        sendReply(&replyTo, sendBuf, strlen(sendBuf));
+    }
 
-        // Clear the send and receive buffers
-        if (recBuf[0] != NULL)
-        {
-            memset(recBuf, NULL, sizeof(recBuf));
-        }
+    TRACE1(trace_module_main, TRACE_LEVEL_DEBUG, "batch of %u commands run", numCommands);
+    sprintf(sendBuf, "\r\n%s,%u\r\n", BATCH_STR, numCommands);
+    sendReply(&replyTo, sendBuf, strlen(sendBuf));
 
-        if (recBuf[0] != NULL)
-        {
-            memset(sendBuf, NULL, sizeof(sendBuf));
-        }
+    flushBatchReply();
+    batchRunning = false;
+}
 
-        // Reinitialize address structure to avoid potential errors
-        Addr.sin_family = SL_AF_INET;
-        Addr.sin_port = sl_Htons(44444);
-        Addr.sin_addr.s_addr = SL_INADDR_ANY;
+/**
+ * This task saves the button being learned once the receiver has captured its signal,
+ * or tells the client that no signal was seen once the learn timer has run out
+ * @param task the learn task (not used, but necessary for the task function)
+ */
+static void learnTaskFxn(Task* task)
+{
+    bool recorded = IRbuttonReady();
+
+    if (learning && (recorded || !timerWheelActive(&learnTimer)))
+    {
+        timerWheelStop(&learnTimer);
+        learning = false;
 
-        // Receive data from the network
-        Status = sl_RecvFrom(Sd, recBuf, BUFF_SIZE, 0, ( SlSockAddr_t *)&Addr, &AddrSize);
-        if(Status < 0 && Status != SL_EAGAIN)
+        if (recorded == false)
         {
+            TRACE0(trace_module_main, TRACE_LEVEL_INFO, "learning timed out");
+            sprintf(sendBuf, "\r\n%s\r\n", RECORD_TIMEOUT);
+            Status = sendReply(&learnReplyAddr, sendBuf, strlen(sendBuf));
+            if( strlen(sendBuf) != Status )
+            {
 #ifdef DEBUG_SESSION
-            UART_PRINT("\r\n%s\r\n", RECEIVING_ERROR);
+                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
+            }
         }
-
-        // Data was received
-        if (Status > 0)
+        else
         {
+            uint16_t sequenceSize = 0;
+            SignalInterval* irSequence = getIRsequence(&sequenceSize);
+            uint16_t carrFreq = getIRcarrierFrequency();
 #ifdef DEBUG_SESSION
-            UART_PRINT("\r\nReceived: %s\r\n", recBuf);
+            GlitchCounters glitches;
+            IRgetGlitchCounters(&glitches);
+            UART_PRINT("\r\nRejected marks: %d, spaces: %d, edges: %d\r\n",
+                       glitches.rejectedMarks, glitches.rejectedSpaces, glitches.rejectedEdges);
 #endif
+            int button_index = createButton((const unsigned char*)learnName, carrFreq, irSequence, sequenceSize);
 
-            // Parse commands from the receive buffer
-            char *strState;
-            char *arg1;
-            char *arg2;
-            const char delim[2] = ",";
-            strState = strtok(recBuf, delim);
-            arg1 = strtok(NULL, delim);
-            arg2 = strtok(NULL, delim);
-            toLower(strState);
-
-            // SEND_BUTTON: Sends button with IR and reports back to app
-            if(strncmp(strState, SEND_BUTTON_STR, strlen(SEND_BUTTON_STR)) == 0){
-
-                // Check if the button name argument is not empty
-                if (arg1[0] != NULL)
+            if(button_index == FILE_IO_ERROR){
+                TRACE1(trace_module_main, TRACE_LEVEL_ERROR, "learned button of %u bytes not saved", sequenceSize);
+                sprintf(sendBuf, "\r\n%s\r\n", BUTTON_ADD_ERROR);
+                sendReply(&learnReplyAddr, sendBuf, strlen(sendBuf));
+            }
+            else{
+                // Get the name that was saved to the button table of contents
+                // as the name could have been truncated if it was too long
+                char btnNameBuff[BUTTON_NAME_MAX_SIZE];
+                getButtonName(button_index, btnNameBuff);
+                TRACE2(trace_module_main, TRACE_LEVEL_INFO, "learned button %d at %u Hz", button_index, carrFreq);
+                sprintf(sendBuf, "\r\nbutton_saved,%s,%d\r\n", btnNameBuff, button_index);
+
+                Status = sendReply(&learnReplyAddr, sendBuf, strlen(sendBuf));
+                if( strlen(sendBuf) != Status )
                 {
-                    int button_index = atoi(arg2);
+#ifdef DEBUG_SESSION
+                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+#endif
+                }
+            }
+        }
+        // Our own output must not be picked up by the passthrough
+        IRreceiverSetMode(passthru);
+        if (emitterIdle())
+        {
+            currState = idle;
+        }
+        else
+        {
+            IRstopEdgeDetectGPIO();
+        }
+    }
+}
 
-                    // Compare the name of the button the client wants to delete with
-                    // the name of the button that was stored at the button index. If
-                    // it does not match, send a message telling the client that their
-                    // button database is out-of-date and should be updated.
-                    if (compareButtonNames(arg1, button_index) == 0)
-                    {
-                        bool error = true;
+/**
+ * Wakes the learn task once the user has had enough time to press the button
+ * @param timer the learn timer (not used, but necessary for the timer callback)
+ */
+static void learnTimeoutHandler(WheelTimer* timer)
+{
+    taskPost(&learnTask);
+}
 
-                        // Stop any IR detection while sending a button signal
-                        IRstopEdgeDetectGPIO();
-                        currState = send_button;
+/**
+ * This task sends the list of stored buttons to the client that asked for it last
+ * @param task the refresh task (not used, but necessary for the task function)
+ */
+static void refreshTaskFxn(Task* task)
+{
+    currState = button_refresh;
 
-                        SignalInterval* irSequence = getButtonSignalInterval(button_index);
-                        if (irSequence != NULL)
-                        {
-                            int carrFreq = getButtonCarrierFrequency(button_index);
+    char* refreshBuff = createButtonRefreshBuffer();
 
-                            if (carrFreq != FILE_IO_ERROR)
-                            {
-                                // Send out the signal
-                                IRemitterSendButton(irSequence, carrFreq);
+    if (refreshBuff != NULL)
+    {
+        // Add the end NULL character for receiver convenience
+        uint16_t refreshBuffSize = strlen(refreshBuff) + 1;
 
-                                // Indicate success status
-                                error = false;
+        Status = sendReply(&refreshReplyAddr, refreshBuff, refreshBuffSize);
 
-                                sprintf(sendBuf, "\r\nbutton_sent,%s,%d\r\n", arg1, button_index);
-                                Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                                if( strlen(sendBuf) != Status )
-                                {
+        if(refreshBuffSize != Status)
+        {
 #ifdef DEBUG_SESSION
-                                    UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
-                                }
-                            }
-                        }
+        }
 
-                        // Send an error message if something went wrong
-                        if (error)
-                        {
-                            sprintf(sendBuf, "\r\n%s\r\n", BUTTON_SEND_ERROR);
-                            Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                            if( strlen(sendBuf) != Status )
-                            {
+        free(refreshBuff);
+    }
+    else
+    {
+        Status = sendReply(&refreshReplyAddr, BUTTON_REFRESH_ERROR, strlen(BUTTON_REFRESH_ERROR));
+
+        // Send the same message to the UART for debug purposes
+        if(strlen(BUTTON_REFRESH_ERROR) != Status)
+        {
 #ifdef DEBUG_SESSION
-                                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
-                            }
-                        }
+        }
+    }
+    currState = idle;
+}
 
-                        // Start edge detection again, as we are going into an idle state
-                        IRstartEdgeDetectGPIO();
-                        currState = idle;
-                    }
-                    else
-                    {
-                        sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
-                        Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                        if( strlen(sendBuf) != Status )
-                        {
+/**
+ * This task sends the timing probe report to the client that asked for it last,
+ * and clears the probes if that client asked for it
+ * @param task the stats task (not used, but necessary for the task function)
+ */
+static void statsTaskFxn(Task* task)
+{
+    char* report = profilerCreateReport();
+
+    if (report != NULL)
+    {
+        // Add the end NULL character for receiver convenience
+        uint16_t reportSize = strlen(report) + 1;
+
+        Status = sendReply(&statsReplyAddr, report, reportSize);
+        if(reportSize != Status)
+        {
 #ifdef DEBUG_SESSION
-                            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
-                        }
-                    }
-                }
-            }
-            // APP_INIT: Provide the app with the device IP and Name
-            else if(strncmp(strState, APP_INIT_STR, strlen(APP_INIT_STR)) == 0){
+        }
 
-                // Get the obtained IP of the device
-                uint16_t len = sizeof(SlNetCfgIpV4Args_t);
-                uint16_t configOpt = 0;
-                SlNetCfgIpV4Args_t ipV4 = {0};
-                sl_NetCfgGet(SL_NETCFG_IPV4_STA_ADDR_MODE, &configOpt, &len, (_u8 *)&ipV4);
+        free(report);
+    }
 
-                // Get the user-assigned name of the device
-                len = DEVICE_NAME_LENGTH;
-                char deviceName[len];
-                memset(deviceName, 0, len);
-                configOpt = SL_WLAN_P2P_OPT_DEV_NAME;
-                sl_WlanGet(SL_WLAN_CFG_P2P_PARAM_ID, &configOpt , &len, (_u8*)deviceName);
+    // Print the same report to the UART for debug purposes
+    profilerPrint();
 
-                currState = app_init;
-                sprintf(sendBuf, "\r\n%d.%d.%d.%d,%s\r\n",
-                                 (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 3),
-                                 (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 2),
-                                 (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 1),
-                                 (uint8_t)SL_IPV4_BYTE(ipV4.Ip, 0),
-                                 (char *)deviceName);
+    if (statsReset)
+    {
+        profilerReset();
+        statsReset = false;
+    }
+}
 
-                Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
+#ifndef TASK_THREADS
+/**
+ * Runs when no task is posted. Posts the emitter task once a scheduled send is due, and
+ * blocks until a datagram arrives or the next local event is due, rather than asking the
+ * network processor over SPI on every pass. The command task is posted to read the datagram.
+ * While the board has no connection it sleeps until a task is posted, for as long as
+ * sl_Task can wait, so IR work keeps running without the loop spinning.
+ */
+static void waitForCommand()
+{
+    // Sends, macros, learning and timers are finished by tasks posted from interrupts,
+    // which cannot wake sl_Select, so the wait ends when the first of them is due
+    uint32_t waitTime_ms = mainLoopWaitTime();
 
-                if( strlen(sendBuf) != Status )
-                {
-#ifdef DEBUG_SESSION
-                    UART_PRINT("\r\n%s\r\n", DEVICE_INFO_ERROR);
-#endif
-                }
-                currState = idle;
-            }
-            // BUTTON_REFRESH: Provide the app with a list of available buttons
-            else if(strncmp(strState, BUTTON_REFRESH_STR, strlen(BUTTON_REFRESH_STR)) == 0){
-                currState = button_refresh;
+    if (schedulerGetTimeUntilDue() == 0)
+    {
+        taskPost(&emitterTask);
+    }
+    else if ((Sd < 0) || (wifiGetState() != wifi_state_connected))
+    {
+        // No socket to wait on while the WiFi task reconnects, sl_Task keeps the events coming
+        waitForTask((waitTime_ms < NETWORK_POLL_MS) ? waitTime_ms : NETWORK_POLL_MS);
+    }
+    else if (taskPending())
+    {
+        // An interrupt posted a task since the main loop looked, run it first
+    }
+    else if (waitTime_ms < SELECT_MIN_WAIT_MS)
+    {
+        // Too soon for sl_Select, so sleep until the event and then look at the socket
+        waitForTask(waitTime_ms);
+        taskPost(&commandTask);
+    }
+    else
+    {
+        PROFILE_BEGIN(probe_socket_wait);
+        SlFdSet_t readSet;
+        SlTimeval_t timeout;
+        SL_SOCKET_FD_ZERO(&readSet);
+        SL_SOCKET_FD_SET(Sd, &readSet);
+        timeout.tv_sec = waitTime_ms / 1000;
+        timeout.tv_usec = (waitTime_ms % 1000) * 1000;
+
+        bool readable = (sl_Select(Sd + 1, &readSet, NULL, NULL, &timeout) > 0);
+        PROFILE_END(probe_socket_wait);
+
+        if (readable)
+        {
+            taskPost(&commandTask);
+        }
+    }
+}
 
-                char* refreshBuff = createButtonRefreshBuffer();
+/**
+ * Sleeps until an interrupt posts a task or a time has passed. The CPU waits for an
+ * interrupt in between, the tick of the timer wheel wakes it at least every millisecond.
+ * @param timeout_ms the longest time to sleep
+ */
+static void waitForTask(uint32_t timeout_ms)
+{
+    uint64_t end = timerWheelGetUptime() + timeout_ms;
 
-                if (refreshBuff != NULL)
-                {
-                    // Add the end NULL character for receiver convenience
-                    uint16_t refreshBuffSize = strlen(refreshBuff) + 1;
+    while (!taskPending() && (timerWheelGetUptime() < end))
+    {
+        Power_idleFunc();
+    }
+}
+#endif
 
-                    Status = sl_SendTo(Sd, refreshBuff, refreshBuffSize, 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
+/**
+ * Sends a reply to a client. While a batch runs, replies to it are collected and sent
+ * together when it is done.
+ * @param to The client and sequence number the reply goes to
+ * @param reply The reply
+ * @param length The length of the reply
+ * @return length if the whole reply was sent or collected, else a SimpleLink error code or the bytes sent
+ */
+static int sendReply(const ReplyAddr* to, const void* reply, uint16_t length)
+{
+    int RetVal = length;
 
-                    if(refreshBuffSize != Status)
-                    {
-#ifdef DEBUG_SESSION
-                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
-#endif
-                    }
+    if (batchRunning && (to == &replyTo) && (length <= BATCH_REPLY_SIZE))
+    {
+        if ((batchReplyLength + length) > BATCH_REPLY_SIZE)
+        {
+            flushBatchReply();
+        }
 
-                    free(refreshBuff);
-                }
-                else
-                {
-                    Status = sl_SendTo(Sd, BUTTON_REFRESH_ERROR, strlen(BUTTON_REFRESH_ERROR), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
+        memcpy(&batchReply[batchReplyLength], reply, length);
+        batchReplyLength += length;
+    }
+    else
+    {
+        RetVal = sendDatagram(to, reply, length);
+    }
 
-                    // Send the same message to the UART for debug purposes
-                    if(strlen(BUTTON_REFRESH_ERROR) != Status)
-                    {
-#ifdef DEBUG_SESSION
-                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
-#endif
-                    }
-                }
-                currState = idle;
-            }
-            // ADD_BUTTON: Record the button and report back to the application
-            else if(strncmp(strState, ADD_BUTTON_STR, strlen(ADD_BUTTON_STR)) == 0){
+    return RetVal;
+}
 
-                // Check if the name argument is not empty
-                if (arg1[0] != NULL)
-                {
-                    currState = add_button;
-                    IRreceiverSetMode(program);
+/**
+ * Tells a client its command was dropped because the board is busy. The reply is not kept
+ * in the reply cache, so a retry of the command is run once there is room for it.
+ * @param to The client and sequence number the reply goes to
+ */
+static void sendBusyReply(const ReplyAddr* to)
+{
+    char busyReply[REPLY_SEQ_PREFIX_SIZE + sizeof(COMMAND_BUSY) + 4];
+    uint16_t length = 0;
 
-                    // Let the client know that the device is waiting for an IR signal to record
-                    sprintf(sendBuf, "\r\n%s\r\n", READY_REC);
-                    Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
+    if (to->hasSeq)
+    {
+        length = sprintf(busyReply, "#%lu,", (unsigned long)to->seq);
+    }
+    length += sprintf(&busyReply[length], "\r\n%s\r\n", COMMAND_BUSY);
 
-                    if( strlen(sendBuf) != Status )
-                    {
+    Status = sl_SendTo(Sd, busyReply, length, 0, (SlSockAddr_t*)&to->addr, sizeof(SlSockAddr_t));
+    if (length != Status)
+    {
 #ifdef DEBUG_SESSION
-                        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+        UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
-                    }
-
-                    // Wait for button recording to be completed
-                    while(!IRbuttonReady());
-
-                    uint16_t sequenceSize = 0;
-                    SignalInterval* irSequence = getIRsequence(&sequenceSize);
-                    uint16_t carrFreq = getIRcarrierFrequency();
-                    int button_index = createButton((const unsigned char*)arg1, carrFreq, irSequence, sequenceSize);
+    }
+}
 
-                    if(button_index == FILE_IO_ERROR){
-                        sprintf(sendBuf, "\r\n%s\r\n", BUTTON_ADD_ERROR);
-                        sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                    }
-                    else{
-                        // Get the name that was saved to the button table of contents
-                        // as the name could have been truncated if it was too long
-                        char btnNameBuff[BUTTON_NAME_MAX_SIZE];
-                        getButtonName(button_index, btnNameBuff);
-                        sprintf(sendBuf, "\r\nbutton_saved,%s,%d\r\n", btnNameBuff, button_index);
-
-                        Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                        if( strlen(sendBuf) != Status )
-                        {
+/**
+ * Sends the collected replies of the running batch
+ */
+static void flushBatchReply()
+{
+    if (batchReplyLength > 0)
+    {
+        Status = sendDatagram(&replyTo, batchReply, batchReplyLength);
+        if (batchReplyLength != Status)
+        {
 #ifdef DEBUG_SESSION
-                            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
+            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
 #endif
-                        }
-                    }
-                    IRreceiverSetMode(passthru);
-                    currState = idle;
-                }
-            }
-            // DELETE_BUTTON: Deletes button from flash and reports back to app
-            else if(strncmp(strState, DELETE_BUTTON_STR, strlen(DELETE_BUTTON_STR)) == 0){
+        }
+        batchReplyLength = 0;
+    }
+}
 
-                // Check if the button name argument is not empty
-                if (arg1[0] != NULL)
-                {
-                    int button_index = atoi(arg2);
+/**
+ * Sends a datagram to a client. If the command carried a sequence number, the datagram
+ * starts with it and is kept in the reply cache for retries of the command.
+ * @param to The client and sequence number the datagram goes to
+ * @param datagram The datagram
+ * @param length The length of the datagram
+ * @return length if the whole datagram was sent, else a SimpleLink error code or the bytes sent
+ */
+static int sendDatagram(const ReplyAddr* to, const void* datagram, uint16_t length)
+{
+    int RetVal = SL_ERROR_BSD_ENOMEM;
 
-                    // Compare the name of the button the client wants to delete with
-                    // the name of the button that was stored at the button index. If
-                    // it does not match, send a message telling the client that their
-                    // button database is out-of-date and should be updated.
-                    if (compareButtonNames(arg1, button_index) == 0)
-                    {
-                        currState = delete_button;
+    if (to->hasSeq)
+    {
+        char* sequenced = malloc(REPLY_SEQ_PREFIX_SIZE + length);
 
-                        int delCheck = deleteButton(button_index);
-                        if(delCheck == FILE_IO_ERROR){
-                            sprintf(sendBuf, "\r\n%s\r\n", BUTTON_DELETE_ERROR);
-                            Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                            if( strlen(sendBuf) != Status )
-                            {
-#ifdef DEBUG_SESSION
-                                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
-#endif
-                            }
-                        }
-                        else{
-                            sprintf(sendBuf, "\r\ndeleted_button,%s,%d\r\n", arg1, button_index);
-                            Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                            if( strlen(sendBuf) != Status )
-                            {
-#ifdef DEBUG_SESSION
-                                UART_PRINT("\r\n%s\r\n", SEND_ERROR);
-#endif
-                            }
-                        }
+        if (sequenced != NULL)
+        {
+            uint16_t prefixLength = sprintf(sequenced, "#%lu,", (unsigned long)to->seq);
+            memcpy(&sequenced[prefixLength], datagram, length);
+            replyCacheStore(to, sequenced, prefixLength + length);
 
-                        currState = idle;
-                    }
-                    else
-                    {
-                        sprintf(sendBuf, "\r\n%s\r\n", BTN_NOT_AVAILABLE);
-                        Status = sl_SendTo(Sd, sendBuf, strlen(sendBuf), 0, (SlSockAddr_t*)&Addr, sizeof(SlSockAddr_t));
-                        if( strlen(sendBuf) != Status )
-                        {
-#ifdef DEBUG_SESSION
-                            UART_PRINT("\r\n%s\r\n", SEND_ERROR);
-#endif
-                        }
-                    }
-                }
-            }
-            // CLEAR_ALL: Deletes all buttons on the device
-            else if(strncmp(strState, CLEAR_BUTTONS_STR, strlen(CLEAR_BUTTONS_STR)) == 0){
-                deleteAllButtons();
+            RetVal = sl_SendTo(Sd, sequenced, prefixLength + length, 0, (SlSockAddr_t*)&to->addr, sizeof(SlSockAddr_t));
+            if (RetVal == (prefixLength + length))
+            {
+                RetVal = length;
             }
+
+            free(sequenced);
         }
     }
+    else
+    {
+        RetVal = sl_SendTo(Sd, datagram, length, 0, (SlSockAddr_t*)&to->addr, sizeof(SlSockAddr_t));
+    }
+
+    return RetVal;
 }
 
 /**
@@ -576,6 +2009,157 @@ void toLower(char* string){
     }
 }
 
+/**
+ * This method checks if every IR output channel is done sending, no macro is running
+ * and no button is being learned, so the receiver can go back to passthrough
+ * @return true if no channel is sending
+ */
+bool emitterIdle(){
+    if((macroRun.steps != NULL) || learning){
+        return false;
+    }
+    for(uint8_t channel = 0; channel < EMITTER_CHANNEL_COUNT; channel++){
+        if(IRemitterBusy(channel)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * This method gets how long the main loop can wait for a datagram before it has
+ * something else to do: a scheduled send, a timer, the end of a send or macro step,
+ * or a look for the signal being learned
+ * @return the wait time in milliseconds, at least 1 so the main loop never spins
+ */
+uint32_t mainLoopWaitTime()
+{
+    uint32_t RetVal = SELECT_MAX_WAIT_MS;
+
+    uint32_t jobWait_ms = schedulerGetTimeUntilDue();
+    if (jobWait_ms < RetVal)
+    {
+        RetVal = jobWait_ms;
+    }
+
+    // Timer callbacks (Wi-Fi reconnect, power boost, learn timeout) post tasks
+    // that cannot wake sl_Select either, so wake up for the next one
+    uint32_t timerWait_ms = timerWheelGetTimeUntilNext();
+    if (timerWait_ms < RetVal)
+    {
+        RetVal = timerWait_ms;
+    }
+
+    // A send completes in the interval timer interrupt, and the next macro step starts
+    // from its completion, so wake up once the first busy channel is done
+    for (uint8_t channel = 0; channel < EMITTER_CHANNEL_COUNT; channel++)
+    {
+        uint32_t sendWait_ms = (IRemitterGetTimeUntilDone(channel) + 999) / 1000;
+        if (IRemitterBusy(channel) && (sendWait_ms < RetVal))
+        {
+            RetVal = sendWait_ms;
+        }
+    }
+
+    // A captured signal cannot be told in advance, so look for it now and then
+    if (learning && (LEARN_POLL_MS < RetVal))
+    {
+        RetVal = LEARN_POLL_MS;
+    }
+
+    // Whatever is due now runs after the shortest wait
+    if (RetVal == 0)
+    {
+        RetVal = 1;
+    }
+
+    return RetVal;
+}
+
+/**
+ * This method starts sending the IR signal of a button on the output channel it is bound to
+ * @param buttonIndex the index of the button to send
+ * @param trailingGap_us silence to keep the channel busy for after the signal
+ * @return the channel the button is being sent on, SEND_CHANNEL_BUSY if that channel
+ *         is still sending, else FILE_IO_ERROR
+ */
+int startButtonSend(uint16_t buttonIndex, uint32_t trailingGap_us)
+{
+    int RetVal = FILE_IO_ERROR;
+
+    int channel = getButtonOutputChannel(buttonIndex);
+    int carrFreq = getButtonCarrierFrequency(buttonIndex);
+
+    // Macros cannot be sent as a button
+    if ((channel >= 0) && (channel < EMITTER_CHANNEL_COUNT) && (carrFreq != FILE_IO_ERROR) && (carrFreq != MACRO_CARRIER_FREQUENCY))
+    {
+        if (IRemitterBusy(channel))
+        {
+            RetVal = SEND_CHANNEL_BUSY;
+        }
+        else
+        {
+            SignalInterval* irSequence = getButtonSignalInterval(buttonIndex);
+            if (irSequence != NULL)
+            {
+                // Stop any IR detection while sending a button signal
+                IRstopEdgeDetectGPIO();
+
+                // Send out the signal
+                IRemitterSendButton(channel, irSequence, carrFreq, trailingGap_us);
+                RetVal = channel;
+            }
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * This method parses one macro step given as <button index>:<delay in ms>.
+ * The delay is optional and defaults to 0.
+ * @param stepString the step to parse
+ * @param step filled with the parsed step
+ * @return 0 if the step refers to a stored IR button and its delay is at most
+ *         MACRO_MAX_DELAY_MS, else FILE_IO_ERROR
+ */
+int parseMacroStep(char* stepString, MacroStep* step)
+{
+    int RetVal = FILE_IO_ERROR;
+    char* delayString = NULL;
+    char* delayEnd = NULL;
+    unsigned long delay_ms = 0;
+    bool delayValid = true;
+
+    step->buttonIndex = strtol(stepString, &delayString, 10);
+    if (*delayString == ':')
+    {
+        // strtoul saturates on overflow and wraps negative numbers, both end up out of range
+        delay_ms = strtoul(delayString + 1, &delayEnd, 10);
+        delayValid = (delayEnd != (delayString + 1)) && (delay_ms <= MACRO_MAX_DELAY_MS);
+    }
+    step->delay_ms = (_u32)delay_ms;
+
+    // Macros can only run IR buttons, not other macros
+    int carrFreq = getButtonCarrierFrequency(step->buttonIndex);
+    if ((delayString != stepString) && delayValid && (carrFreq != FILE_IO_ERROR) && (carrFreq != MACRO_CARRIER_FREQUENCY))
+    {
+        RetVal = 0;
+    }
+
+    return RetVal;
+}
+
+/**
+ * This method releases the steps of the running macro
+ */
+void endMacro()
+{
+    free(macroRun.steps);
+    macroRun.steps = NULL;
+    macroRun.channel = -1;
+}
+
 
 #ifdef DEBUG_SESSION
 void fileSystemTestCode()
@@ -36,9 +36,15 @@
 
 // Standard includes
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Interrupt masking while the log buffer is shared with interrupts
+#include <ti/drivers/dpl/HwiP.h>
+
 #include "uart_term.h"
 
 extern int vsnprintf(char * s,
@@ -50,12 +56,30 @@ extern int vsnprintf(char * s,
 //                          LOCAL DEFINES
 //*****************************************************************************
 #define IS_SPACE(x)       (x == 32 ? 1 : 0)
+#define LOG_BUFFER_MASK   (LOG_BUFFER_SIZE - 1)
 
 //*****************************************************************************
 //                 GLOBAL VARIABLES
 //*****************************************************************************
 static UART_Handle uartHandle;
 
+// Messages wait in the log buffer until the UART DMA has sent them. The head
+// and tail only ever count up, the buffer position is found with the mask.
+static char logBuffer[LOG_BUFFER_SIZE];
+static uint32_t logHead = 0;
+static uint32_t logTail = 0;
+static uint32_t logWriteLength = 0;
+static bool logWriteBusy = false;
+static uint32_t logDropped = 0;
+static uint32_t logDropReported = 0;
+
+//*****************************************************************************
+//                 LOCAL FUNCTION PROTOTYPES
+//*****************************************************************************
+static bool LogPush(const char *str, uint32_t length);
+static void LogStartWrite(void);
+static void LogWriteDone(UART_Handle handle, void *buf, size_t count);
+
 //*****************************************************************************
 //
 //! Initialization
@@ -80,11 +104,17 @@ UART_Handle InitTerm(void)
     uartParams.readReturnMode = UART_RETURN_FULL;
     uartParams.readEcho = UART_ECHO_OFF;
     uartParams.baudRate = 115200;
+    /* the log buffer is sent in the background, see LogWriteDone */
+    uartParams.writeMode = UART_MODE_CALLBACK;
+    uartParams.writeCallback = LogWriteDone;
 
     uartHandle = UART_open(Board_UART0, &uartParams);
     /* remove uart receive from LPDS dependency */
     UART_control(uartHandle, UART_CMD_RXDISABLE, NULL);
 
+    /* send anything that was logged before the UART was open */
+    LogStartWrite();
+
     return(uartHandle);
 }
 
@@ -92,59 +122,62 @@ UART_Handle InitTerm(void)
 //
 //! prints the formatted string on to the console
 //!
+//! The message is formatted on the stack and queued in the log buffer, the
+//! UART DMA sends it in the background. Messages longer than LOG_LINE_SIZE
+//! are truncated, and messages that do not fit in the log buffer are dropped.
+//!
 //! \param[in]  format  - is a pointer to the character string specifying the
 //!                       format in the following arguments need to be
 //!                       interpreted.
 //! \param[in]  [variable number of] arguments according to the format in the
 //!             first parameters
 //!
-//! \return count of characters printed
+//! \return count of characters printed, -1 if the message was dropped
+//!
+//! \note Can be called from interrupts
 //
 //*****************************************************************************
 int Report(const char *pcFormat,
            ...)
 {
     int iRet = 0;
-    char        *pcBuff;
-    char        *pcTemp;
-    int iSize = 256;
+    char pcBuff[LOG_LINE_SIZE];
     va_list list;
 
-    pcBuff = (char*)malloc(iSize);
-    if(pcBuff == NULL)
-    {
-        return(-1);
-    }
-    while(1)
+    va_start(list,pcFormat);
+    iRet = vsnprintf(pcBuff, LOG_LINE_SIZE, pcFormat, list);
+    va_end(list);
+
+    if(iRet > -1)
     {
-        va_start(list,pcFormat);
-        iRet = vsnprintf(pcBuff, iSize, pcFormat, list);
-        va_end(list);
-        if((iRet > -1) && (iRet < iSize))
+        if(iRet >= LOG_LINE_SIZE)
         {
-            break;
+            iRet = LOG_LINE_SIZE - 1;
         }
-        else
+
+        if(LogPush(pcBuff, iRet) == false)
         {
-            iSize *= 2;
-            if((pcTemp = realloc(pcBuff, iSize)) == NULL)
-            {
-                Message("Could not reallocate memory\n\r");
-                iRet = -1;
-                break;
-            }
-            else
-            {
-                pcBuff = pcTemp;
-            }
+            iRet = -1;
         }
     }
-    Message(pcBuff);
-    free(pcBuff);
 
     return(iRet);
 }
 
+//*****************************************************************************
+//
+//! Gets how many messages were dropped because the log buffer was full
+//!
+//! \param  none
+//!
+//! \return count of dropped messages since start up
+//
+//*****************************************************************************
+uint32_t LogGetDropCount(void)
+{
+    return(logDropped);
+}
+
 //*****************************************************************************
 //
 //! Trim the spaces from left and right end of given string
@@ -224,7 +257,7 @@ int GetCmd(char *pcBuffer,
         //
         if((cChar == '\r') || (cChar == '\n'))
         {
-            UART_writePolling(uartHandle, &cChar, 1);
+            putch(cChar);
             break;
         }
         else if(cChar == '\b')
@@ -232,20 +265,16 @@ int GetCmd(char *pcBuffer,
             //
             // Deleting last character when you hit backspace
             //
-            char ch;
-
-            UART_writePolling(uartHandle, &cChar, 1);
-            ch = ' ';
-            UART_writePolling(uartHandle, &ch, 1);
+            putch(cChar);
+            putch(' ');
             if(iLen)
             {
-                UART_writePolling(uartHandle, &cChar, 1);
+                putch(cChar);
                 iLen--;
             }
             else
             {
-                ch = '\a';
-                UART_writePolling(uartHandle, &ch, 1);
+                putch('\a');
             }
         }
         else
@@ -253,7 +282,7 @@ int GetCmd(char *pcBuffer,
             //
             // Echo the received character
             //
-            UART_writePolling(uartHandle, &cChar, 1);
+            putch(cChar);
 
             *(pcBuffer + iLen) = cChar;
             iLen++;
@@ -278,17 +307,12 @@ int GetCmd(char *pcBuffer,
 //!
 //! \return none
 //!
-//! \note If UART_NONPOLLING defined in than Message or UART write should be
-//!       called in task/thread context only.
+//! \note Can be called from interrupts, the string is queued in the log buffer
 //
 //*****************************************************************************
 void Message(const char *str)
 {
-#ifdef UART_NONPOLLING
-    UART_write(uartHandle, str, strlen(str));
-#else
-    UART_writePolling(uartHandle, str, strlen(str));
-#endif
+    LogPush(str, strlen(str));
 }
 
 //*****************************************************************************
@@ -329,6 +353,9 @@ char getch(void)
 //
 //! Outputs a character to the console
 //!
+//! The character is queued in the log buffer like any message, the UART is
+//! opened in callback mode for its DMA and cannot be written by polling.
+//!
 //! \param[in]  char    - A character to be printed
 //!
 //! \return none
@@ -336,5 +363,123 @@ char getch(void)
 //*****************************************************************************
 void putch(char ch)
 {
-    UART_writePolling(uartHandle, &ch, 1);
+    LogPush(&ch, 1);
+}
+
+//*****************************************************************************
+//
+//! Queues a string in the log buffer and starts sending it
+//!
+//! A notice of the messages dropped since the last one that fit is queued
+//! ahead of the string.
+//!
+//! \param[in]  str     - is the pointer to the string to queue
+//! \param[in]  length  - is the length of the string
+//!
+//! \return true if the string was queued, false if it was dropped
+//
+//*****************************************************************************
+static bool LogPush(const char *str, uint32_t length)
+{
+    bool queued = false;
+    char notice[32];
+    uint32_t noticeLength = 0;
+    uintptr_t key = HwiP_disable();
+
+    if(logDropped != logDropReported)
+    {
+        noticeLength = snprintf(notice, sizeof(notice), "\r\n[%u dropped]\r\n",
+                                logDropped - logDropReported);
+    }
+
+    if((LOG_BUFFER_SIZE - (logHead - logTail)) >= (noticeLength + length))
+    {
+        for(uint32_t i = 0; i < noticeLength; i++)
+        {
+            logBuffer[(logHead + i) & LOG_BUFFER_MASK] = notice[i];
+        }
+        logHead += noticeLength;
+        logDropReported = logDropped;
+
+        for(uint32_t i = 0; i < length; i++)
+        {
+            logBuffer[(logHead + i) & LOG_BUFFER_MASK] = str[i];
+        }
+        logHead += length;
+        queued = true;
+    }
+    else
+    {
+        logDropped++;
+    }
+
+    HwiP_restore(key);
+
+    LogStartWrite();
+
+    return(queued);
+}
+
+//*****************************************************************************
+//
+//! Starts a UART DMA write of the oldest queued part of the log buffer, unless
+//! one is already running. One write never wraps around the end of the buffer.
+//!
+//! \param  none
+//!
+//! \return none
+//
+//*****************************************************************************
+static void LogStartWrite(void)
+{
+    uint32_t start = 0;
+    uint32_t length = 0;
+    uintptr_t key = HwiP_disable();
+
+    if((uartHandle != NULL) && (logWriteBusy == false) && (logHead != logTail))
+    {
+        start = logTail & LOG_BUFFER_MASK;
+        length = logHead - logTail;
+        if(length > (LOG_BUFFER_SIZE - start))
+        {
+            length = LOG_BUFFER_SIZE - start;
+        }
+        if(length > LOG_DMA_MAX_WRITE)
+        {
+            length = LOG_DMA_MAX_WRITE;
+        }
+
+        logWriteLength = length;
+        logWriteBusy = true;
+    }
+
+    HwiP_restore(key);
+
+    if(length > 0)
+    {
+        UART_write(uartHandle, &logBuffer[start], length);
+    }
+}
+
+//*****************************************************************************
+//
+//! UART write callback, frees the part of the log buffer that was sent and
+//! sends the next one
+//!
+//! \param[in]  handle  - is the UART handle (not used)
+//! \param[in]  buf     - is the part of the log buffer that was sent (not used)
+//! \param[in]  count   - is the number of bytes sent (not used)
+//!
+//! \return none
+//
+//*****************************************************************************
+static void LogWriteDone(UART_Handle handle, void *buf, size_t count)
+{
+    uintptr_t key = HwiP_disable();
+    logTail += logWriteLength;
+    logWriteLength = 0;
+    logWriteBusy = false;
+    HwiP_restore(key);
+
+    LogStartWrite();
 }
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Writes the noisy capture corpus replayed by test_ir_receiver. Every capture is a clean
+remote signal with the kinds of noise seen on the receiver added to it: flashes of
+ambient light, carrier dropouts inside a mark and edges bouncing within a carrier period.
+
+The captures are stored as the intervals the capture timer reports, in timer ticks,
+together with the sequence the receiver has to learn from them and the number of
+marks, spaces and edges its glitch filter has to reject.
+
+    python3 generate.py    rewrites the corpus files next to this script
+"""
+
+import os
+
+TICK_NS = 11.5  # TIME_PER_TICK in IR_Receiver.h, the receiver counts 115E-10s per tick
+
+
+def ticks(us):
+    return max(1, int(round(us * 1000 / TICK_NS)))
+
+
+class Capture:
+    def __init__(self, carrier):
+        self.half_period = 500000.0 / carrier
+        self.intervals = [ticks(self.half_period)]  # the first edge is only a start point
+        self.pending_space = None
+
+    def mark(self, us, dropout_at=None, dropout_us=0, bounce_at=None):
+        """Carrier edges for a mark. A dropout leaves out the edges of a stretch of the
+        mark, a bounce splits one carrier half period into two edges."""
+        if self.pending_space is not None:
+            self.intervals.append(ticks(self.pending_space))
+            self.pending_space = None
+        count = int(round(us / self.half_period))
+        i = 0
+        while i < count:
+            if (dropout_at is not None) and (i == int(dropout_at / self.half_period)):
+                skipped = int(round(dropout_us / self.half_period))
+                self.intervals.append(ticks(self.half_period * skipped))
+                i += skipped
+            elif (bounce_at is not None) and (i == int(bounce_at / self.half_period)):
+                self.intervals.append(ticks(1.0))
+                self.intervals.append(ticks(self.half_period - 1.0))
+                i += 1
+            else:
+                self.intervals.append(ticks(self.half_period))
+                i += 1
+
+    def space(self, us, flash_at=None, flash_us=0):
+        """Silence before the next mark. A flash is a short burst of light inside it."""
+        if flash_at is None:
+            self.pending_space = us
+        else:
+            self.intervals.append(ticks(flash_at))
+            self.intervals.append(ticks(flash_us))
+            self.pending_space = us - flash_at - flash_us
+
+    def flash(self, us, then_us):
+        """A burst of ambient light before the signal starts, then silence."""
+        count = max(1, int(round(us / self.half_period)))
+        self.intervals.extend([ticks(self.half_period)] * count)
+        self.pending_space = then_us
+
+    def end(self, gap_us=40000):
+        """A long silence ends the capture at the edge after it."""
+        self.intervals.append(ticks(gap_us))
+        self.intervals.append(ticks(self.half_period))
+
+
+def nec(capture, code, noise):
+    expect = ["m9000", "s4500"]
+    capture.mark(9000, **noise.get("header", {}))
+    capture.space(4500)
+    for bit in range(32):
+        one = (code >> bit) & 1
+        capture.mark(560, **noise.get(("mark", bit), {}))
+        space = 1690 if one else 560
+        capture.space(space, **noise.get(("space", bit), {}))
+        expect += ["m560", "s%d" % space]
+    capture.mark(560)
+    expect.append("m560")
+    return expect
+
+
+def sony_frame(capture, code, noise, last):
+    expect = ["m2400", "s600"]
+    capture.mark(2400)
+    capture.space(600)
+    for bit in range(8):
+        mark = 1200 if (code >> bit) & 1 else 600
+        capture.mark(mark, **noise.get(("mark", bit), {}))
+        expect.append("m%d" % mark)
+        if bit < 7:
+            capture.space(600)
+            expect.append("s600")
+    if not last:
+        capture.space(12000)
+    return expect
+
+
+def write(name, comment, capture, expect, rejected, carrier, glitch_filter=None):
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+    with open(path, "w") as f:
+        f.write("# %s\n" % comment)
+        f.write("# written by generate.py\n")
+        if glitch_filter is not None:
+            f.write("filter %d\n" % glitch_filter)
+        f.write("carrier %d\n" % carrier)
+        f.write("rejected %d %d %d\n" % rejected)
+        f.write("expect %s\n" % " ".join(expect))
+        f.write("edges\n")
+        for i in range(0, len(capture.intervals), 16):
+            f.write(" ".join(str(t) for t in capture.intervals[i:i + 16]) + "\n")
+
+
+def main():
+    code = 0x20DF10EF
+
+    c = Capture(38000)
+    expect = nec(c, code, {})
+    c.end()
+    write("nec_clean.txt", "NEC frame without any noise", c, expect, (0, 0, 0), 38000)
+
+    c = Capture(38000)
+    c.flash(26, 3000)
+    expect = nec(c, code, {("space", 3): {"flash_at": 800, "flash_us": 10},
+                           ("space", 20): {"flash_at": 300, "flash_us": 15}})
+    c.end()
+    write("nec_ambient_flash.txt", "NEC frame with flashes of light before it and inside two spaces",
+          c, expect, (3, 0, 0), 38000)
+
+    c = Capture(38000)
+    expect = nec(c, code, {"header": {"dropout_at": 3000, "dropout_us": 60},
+                           ("mark", 7): {"dropout_at": 200, "dropout_us": 80}})
+    c.end()
+    write("nec_carrier_dropout.txt", "NEC frame with the carrier dropping out in the header and in a bit",
+          c, expect, (0, 2, 0), 38000)
+
+    c = Capture(38000)
+    expect = nec(c, code, {"header": {"bounce_at": 100},
+                           ("mark", 0): {"bounce_at": 200},
+                           ("mark", 31): {"bounce_at": 300}})
+    c.end()
+    write("nec_edge_bounce.txt", "NEC frame with edges bouncing inside a carrier period",
+          c, expect, (0, 0, 3), 38000)
+
+    c = Capture(38000)
+    c.flash(150, 3000)
+    expect = nec(c, code, {"header": {"dropout_at": 4000, "dropout_us": 150},
+                           ("space", 5): {"flash_at": 400, "flash_us": 150}})
+    c.end()
+    write("nec_long_glitches.txt", "NEC frame with glitches only a wider glitch filter rejects",
+          c, expect, (2, 2, 0), 38000, glitch_filter=200)
+
+    c = Capture(40000)
+    expect = []
+    for frame in range(3):
+        noise = {("mark", 2): {"bounce_at": 100}} if frame == 1 else {}
+        frame_expect = sony_frame(c, 0x95, noise, frame == 2)
+        if frame == 0:
+            expect = frame_expect
+    c.end(30000)
+    expect += ["x", "g12000", "n2"]
+    write("repeat_frames_bounce.txt", "Frame sent three times with a bounce in the second copy, folded to one frame",
+          c, expect, (0, 0, 1), 40000)
+
+
+if __name__ == "__main__":
+    main()
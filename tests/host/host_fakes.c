@@ -0,0 +1,199 @@
+/**
+ * This file represents the fakes the host tests link the firmware against. Everything is
+ * weak, so a test that links the real module, or needs a fake that does more, replaces it.
+ * @file host_fakes.c
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ti/drivers/Capture.h>
+#include <ti/drivers/GPIO.h>
+#include <ti/drivers/PWM.h>
+#include <ti/drivers/Timer.h>
+#include <ti/drivers/dpl/HwiP.h>
+#include "host_fakes.h"
+#include "Profiler.h"
+#include "Timer_Wheel.h"
+#include "Trace.h"
+
+#define HOST_REGISTERS 32
+#define HOST_ACCESS_LOG 64
+
+#define WEAK __attribute__((weak))
+
+typedef struct
+{
+    unsigned long address;
+    volatile unsigned long value;
+    bool watched;
+    int16_t lastAccess; // index of the last logged access, -1 if value is current
+} HostRegister;
+
+int hostTestFailures = 0;
+uint32_t hostCycleCount = 0;
+static HostRegister hostRegisters[HOST_REGISTERS];
+static uint8_t numHostRegisters = 0;
+static HostRegisterAccess accessLog[HOST_ACCESS_LOG];
+static volatile unsigned long accessValues[HOST_ACCESS_LOG];
+static uint16_t numAccesses = 0;
+
+static HostRegister* findRegister(unsigned long address);
+
+WEAK uint32_t hostCycles(void)
+{
+    return hostCycleCount;
+}
+
+/**
+ * Finds the memory behind a peripheral register, a register not used before reads 0.
+ * Every access of a watched register gets its own memory, so the order of the writes
+ * can be read back with hostReadAccesses; each starts out with the value of the last.
+ * @param address The address of the register
+ * @return The memory of the register
+ */
+volatile unsigned long* hostRegister(unsigned long address)
+{
+    HostRegister* reg = findRegister(address);
+    volatile unsigned long* RetVal = &reg->value;
+
+    if (reg->watched && (numAccesses < HOST_ACCESS_LOG))
+    {
+        accessValues[numAccesses] = (reg->lastAccess >= 0) ? accessValues[reg->lastAccess] : reg->value;
+        accessLog[numAccesses].address = address;
+        reg->lastAccess = numAccesses;
+        RetVal = &accessValues[numAccesses];
+        numAccesses++;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Sets a register the way the hardware does, without logging an access
+ * @param address The address of the register
+ * @param value The new value
+ */
+void hostSetRegister(unsigned long address, unsigned long value)
+{
+    HostRegister* reg = findRegister(address);
+
+    if (reg->lastAccess >= 0)
+    {
+        accessValues[reg->lastAccess] = value;
+    }
+    reg->value = value;
+}
+
+/**
+ * Logs every access of a register from now on
+ * @param address The address of the register
+ */
+void hostWatchRegister(unsigned long address)
+{
+    findRegister(address)->watched = true;
+}
+
+/**
+ * Takes the accesses of the watched registers since the last call, oldest first
+ * @param accesses Filled with the accesses
+ * @param maxAccesses The room in accesses
+ * @return The number of accesses
+ */
+uint16_t hostReadAccesses(HostRegisterAccess* accesses, uint16_t maxAccesses)
+{
+    uint16_t RetVal = (numAccesses < maxAccesses) ? numAccesses : maxAccesses;
+
+    for (uint16_t i = 0; i < RetVal; i++)
+    {
+        accesses[i].address = accessLog[i].address;
+        accesses[i].value = accessValues[i];
+    }
+
+    for (uint8_t i = 0; i < numHostRegisters; i++)
+    {
+        if (hostRegisters[i].lastAccess >= 0)
+        {
+            hostRegisters[i].value = accessValues[hostRegisters[i].lastAccess];
+            hostRegisters[i].lastAccess = -1;
+        }
+    }
+    numAccesses = 0;
+
+    return RetVal;
+}
+
+void hostResetRegisters(void)
+{
+    numHostRegisters = 0;
+    numAccesses = 0;
+}
+
+/**
+ * Finds the register of an address, a new one reads 0
+ * @param address The address of the register
+ * @return The register, the last one if there is no room for more
+ */
+static HostRegister* findRegister(unsigned long address)
+{
+    HostRegister* RetVal = NULL;
+
+    for (uint8_t i = 0; i < numHostRegisters; i++)
+    {
+        if (hostRegisters[i].address == address)
+        {
+            RetVal = &hostRegisters[i];
+            break;
+        }
+    }
+
+    if (RetVal == NULL)
+    {
+        RetVal = &hostRegisters[(numHostRegisters < HOST_REGISTERS) ? numHostRegisters++ : (HOST_REGISTERS - 1)];
+        RetVal->address = address;
+        RetVal->value = 0;
+        RetVal->watched = false;
+        RetVal->lastAccess = -1;
+    }
+
+    return RetVal;
+}
+
+WEAK uintptr_t HwiP_disable(void) { return 0; }
+WEAK void HwiP_restore(uintptr_t key) { (void)key; }
+
+WEAK void GPIO_init(void) {}
+WEAK void GPIO_write(uint_least8_t index, unsigned int value) { (void)index; (void)value; }
+WEAK unsigned int GPIO_read(uint_least8_t index) { (void)index; return 0; }
+WEAK void GPIO_enableInt(uint_least8_t index) { (void)index; }
+WEAK void GPIO_disableInt(uint_least8_t index) { (void)index; }
+WEAK int GPIO_setConfig(uint_least8_t index, uint32_t pinConfig) { (void)index; (void)pinConfig; return 0; }
+WEAK void GPIO_setCallback(uint_least8_t index, GPIO_CallbackFxn callback) { (void)index; (void)callback; }
+
+WEAK void Capture_init(void) {}
+WEAK void Capture_Params_init(Capture_Params* params) { (void)params; }
+WEAK Capture_Handle Capture_open(uint_least8_t index, Capture_Params* params) { (void)index; (void)params; return NULL; }
+WEAK int32_t Capture_start(Capture_Handle handle) { (void)handle; return 0; }
+WEAK void Capture_stop(Capture_Handle handle) { (void)handle; }
+
+WEAK void PWM_init(void) {}
+WEAK void PWM_Params_init(PWM_Params* params) { (void)params; }
+WEAK PWM_Handle PWM_open(uint_least8_t index, PWM_Params* params) { (void)index; (void)params; return NULL; }
+WEAK int_fast16_t PWM_setDuty(PWM_Handle handle, uint32_t duty) { (void)handle; (void)duty; return 0; }
+WEAK int_fast16_t PWM_setPeriod(PWM_Handle handle, uint32_t period) { (void)handle; (void)period; return 0; }
+WEAK void PWM_start(PWM_Handle handle) { (void)handle; }
+WEAK void PWM_stop(PWM_Handle handle) { (void)handle; }
+
+WEAK void Timer_init(void) {}
+WEAK void Timer_Params_init(Timer_Params* params) { (void)params; }
+WEAK Timer_Handle Timer_open(uint_least8_t index, Timer_Params* params) { (void)index; (void)params; return NULL; }
+WEAK int32_t Timer_start(Timer_Handle handle) { (void)handle; return 0; }
+WEAK void Timer_stop(Timer_Handle handle) { (void)handle; }
+
+WEAK int Report(const char* pcFormat, ...) { (void)pcFormat; return 0; }
+
+WEAK uint8_t traceLevels[TRACE_MODULE_COUNT];
+WEAK void traceRecord(uint32_t header, uint32_t a, uint32_t b, uint32_t c) { (void)header; (void)a; (void)b; (void)c; }
+
+WEAK void profilerRecord(ProfileProbe probe, uint32_t startCycles) { (void)probe; (void)startCycles; }
+WEAK uint64_t timerWheelGetUptime() { return hostCycleCount / PROFILER_CYCLES_PER_US / 1000; }
@@ -0,0 +1,29 @@
+/**
+ * This header file represents the fakes the host tests link the firmware against. The SDK
+ * drivers do nothing, the peripheral registers are plain memory and the cycle counter is
+ * a variable the test moves along. It is included ahead of every source by the Makefile.
+ * @file host_fakes.h
+ */
+
+#ifndef HOST_FAKES_H_
+#define HOST_FAKES_H_
+
+#include <stdint.h>
+
+// One access of a watched register, with the value the register held after it
+typedef struct
+{
+    unsigned long address;
+    unsigned long value;
+} HostRegisterAccess;
+
+extern uint32_t hostCycleCount;
+
+uint32_t hostCycles(void);
+volatile unsigned long* hostRegister(unsigned long address);
+void hostSetRegister(unsigned long address, unsigned long value);
+void hostWatchRegister(unsigned long address);
+uint16_t hostReadAccesses(HostRegisterAccess* accesses, uint16_t maxAccesses);
+void hostResetRegisters(void);
+
+#endif /* HOST_FAKES_H_ */
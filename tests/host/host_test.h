@@ -0,0 +1,24 @@
+/**
+ * This header file represents the checks of the host tests. A failed check prints where
+ * it failed and is counted, the test goes on so one run shows every failure.
+ * @file host_test.h
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+
+extern int hostTestFailures;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); hostTestFailures++; } } while (0)
+#define CHECK_EQUAL(expected, actual) \
+    do { long long e_ = (long long)(expected), a_ = (long long)(actual); \
+         if (e_ != a_) { printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); hostTestFailures++; } } while (0)
+
+// Ends a test, the exit code is what make checks
+#define HOST_TEST_END(name) \
+    (printf("%s: %s\n", (name), (hostTestFailures == 0) ? "passed" : "FAILED"), (hostTestFailures == 0) ? 0 : 1)
+
+#endif /* HOST_TEST_H_ */
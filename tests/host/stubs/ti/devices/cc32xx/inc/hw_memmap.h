@@ -0,0 +1,10 @@
+/* Host stub of the CC32xx memory map, only the peripherals the firmware uses */
+#ifndef __HW_MEMMAP_H__
+#define __HW_MEMMAP_H__
+
+#define TIMERA0_BASE 0x40030000
+#define TIMERA1_BASE 0x40031000
+#define TIMERA2_BASE 0x40032000
+#define TIMERA3_BASE 0x40033000
+
+#endif
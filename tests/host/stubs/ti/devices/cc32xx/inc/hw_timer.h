@@ -0,0 +1,13 @@
+/* Host stub of the CC32xx timer registers, only the ones the firmware uses */
+#ifndef __HW_TIMER_H__
+#define __HW_TIMER_H__
+
+#define TIMER_O_TAMR 0x00000004
+#define TIMER_O_RIS 0x0000001C
+#define TIMER_O_TAILR 0x00000028
+#define TIMER_O_TBMATCHR 0x00000034
+#define TIMER_O_TAV 0x00000050
+#define TIMER_TAMR_TAILD 0x00000100
+#define TIMER_RIS_TATORIS 0x00000001
+
+#endif
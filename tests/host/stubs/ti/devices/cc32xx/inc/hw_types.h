@@ -0,0 +1,7 @@
+/* Host stub of the register access macro, registers are plain memory kept by host_fakes.c */
+#ifndef __HW_TYPES_H__
+#define __HW_TYPES_H__
+
+#define HWREG(x) (*hostRegister(x))
+
+#endif
@@ -0,0 +1,24 @@
+/* Host stub of the SDK capture driver, only what the firmware uses */
+#ifndef ti_drivers_Capture__include
+#define ti_drivers_Capture__include
+
+#include <stdint.h>
+
+typedef struct Capture_Config_ *Capture_Handle;
+typedef void (*Capture_CallBackFxn)(Capture_Handle handle, uint32_t interval);
+typedef enum {Capture_RISING_EDGE, Capture_FALLING_EDGE, Capture_ANY_EDGE} Capture_Mode;
+typedef enum {Capture_PERIOD_US, Capture_PERIOD_HZ, Capture_PERIOD_COUNTS} Capture_PeriodUnits;
+typedef struct
+{
+    Capture_Mode mode;
+    Capture_CallBackFxn callbackFxn;
+    Capture_PeriodUnits periodUnit;
+} Capture_Params;
+
+void Capture_init(void);
+void Capture_Params_init(Capture_Params* params);
+Capture_Handle Capture_open(uint_least8_t index, Capture_Params* params);
+int32_t Capture_start(Capture_Handle handle);
+void Capture_stop(Capture_Handle handle);
+
+#endif
@@ -0,0 +1,20 @@
+/* Host stub of the SDK GPIO driver, only what the firmware uses */
+#ifndef ti_drivers_GPIO__include
+#define ti_drivers_GPIO__include
+
+#include <stdint.h>
+
+#define GPIO_CFG_IN_NOPULL 0x1
+#define GPIO_CFG_IN_INT_BOTH_EDGES 0x2
+
+typedef void (*GPIO_CallbackFxn)(uint_least8_t index);
+
+void GPIO_init(void);
+void GPIO_write(uint_least8_t index, unsigned int value);
+unsigned int GPIO_read(uint_least8_t index);
+void GPIO_enableInt(uint_least8_t index);
+void GPIO_disableInt(uint_least8_t index);
+int GPIO_setConfig(uint_least8_t index, uint32_t pinConfig);
+void GPIO_setCallback(uint_least8_t index, GPIO_CallbackFxn callback);
+
+#endif
@@ -0,0 +1,7 @@
+/* Host stub of the SDK UART driver, only what the firmware uses */
+#ifndef ti_drivers_UART__include
+#define ti_drivers_UART__include
+
+typedef struct UART_Config_ *UART_Handle;
+
+#endif
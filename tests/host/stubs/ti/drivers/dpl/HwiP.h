@@ -0,0 +1,10 @@
+/* Host stub of the SDK interrupt masking, a no-op in host_fakes.c, test_task_queue masks with a lock */
+#ifndef ti_dpl_HwiP__include
+#define ti_dpl_HwiP__include
+
+#include <stdint.h>
+
+uintptr_t HwiP_disable(void);
+void HwiP_restore(uintptr_t key);
+
+#endif
@@ -0,0 +1,45 @@
+/* Host stub of the SimpleLink host driver, only the types and calls the host tests link */
+#ifndef __SIMPLELINK_H__
+#define __SIMPLELINK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t _u8;
+typedef int8_t _i8;
+typedef uint16_t _u16;
+typedef int16_t _i16;
+typedef uint32_t _u32;
+typedef int32_t _i32;
+
+typedef struct
+{
+    _u32 s_addr;
+} SlInAddr_t;
+
+typedef struct
+{
+    _u16 sin_family;
+    _u16 sin_port;
+    SlInAddr_t sin_addr;
+    _i8 sin_zero[8];
+} SlSockAddrIn_t;
+
+#define SL_WLAN_CFG_P2P_PARAM_ID 2
+#define SL_WLAN_P2P_OPT_DEV_NAME 2
+
+#define SL_NETAPP_MDNS_ID 4
+#define SL_NETAPP_MDNS_OPTIONS_IS_UNIQUE_BIT (1UL << 31)
+#define SL_NETAPP_MDNS_OPTIONS_IS_NOT_PERSISTENT (1UL << 28)
+#define SL_ERROR_NET_APP_MDNS_EXIST_UNIQUE_REGISTERED_SERVICE_ERROR (-15)
+
+_i16 sl_WlanGet(const _u16 ConfigId, _u16* pConfigOpt, _u16* pConfigLen, _u8* pValues);
+_i16 sl_NetAppStart(const _u32 AppBitMap);
+_i16 sl_NetAppMDNSRegisterService(const _i8* pServiceName, const _u8 ServiceNameLen, const _i8* pText,
+                                  const _u8 TextLen, const _u16 Port, const _u32 TTL, _u32 Options);
+_i16 sl_NetAppMDNSUnRegisterService(const _i8* pServiceName, const _u8 ServiceNameLen, _u32 Options);
+
+#endif
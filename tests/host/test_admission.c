@@ -0,0 +1,84 @@
+/**
+ * Runs the admission control of received commands: the class of each command keyword,
+ * written in any case, and the token buckets of a client as the uptime moves on.
+ * @file test_admission.c
+ */
+
+#include <string.h>
+#include "host_test.h"
+#include "Admission.h"
+#include "Profiler.h"
+
+static SlSockAddrIn_t simClient(uint32_t ip)
+{
+    SlSockAddrIn_t RetVal;
+
+    memset(&RetVal, 0, sizeof(RetVal));
+    RetVal.sin_addr.s_addr = ip;
+
+    return RetVal;
+}
+
+static void simAdvance_ms(uint32_t ms)
+{
+    hostCycleCount += ms * 1000 * PROFILER_CYCLES_PER_US;
+}
+
+/**
+ * Commands are classed by their keyword whatever its case, as runCommand lowercases it
+ */
+static void testClassifyAnyCase()
+{
+    CHECK_EQUAL(command_class_interactive, admissionClassify("send_button,Power,0"));
+    CHECK_EQUAL(command_class_interactive, admissionClassify("SEND_BUTTON,Power,0"));
+    CHECK_EQUAL(command_class_interactive, admissionClassify("Send_Macro,Movie,2"));
+    CHECK_EQUAL(command_class_bulk, admissionClassify("Button_Refresh"));
+    CHECK_EQUAL(command_class_bulk, admissionClassify("CLEAR_ALL"));
+    CHECK_EQUAL(command_class_bulk, admissionClassify("Batch\nsend_button,Power,0"));
+    CHECK_EQUAL(command_class_normal, admissionClassify("PING,1"));
+    CHECK_EQUAL(command_class_normal, admissionClassify("set_time,1700000000"));
+    CHECK_EQUAL(command_class_normal, admissionClassify(""));
+}
+
+/**
+ * A client gets its burst of commands, then one more each time a token has refilled,
+ * and a bulk command costs more than a normal one
+ */
+static void testBucketsRefill()
+{
+    SlSockAddrIn_t client = simClient(0x0a000002);
+    SlSockAddrIn_t other = simClient(0x0a000003);
+
+    for (uint8_t i = 0; i < ADMISSION_INTERACTIVE_BURST; i++)
+    {
+        CHECK(admissionAdmit(&client, command_class_interactive));
+    }
+    CHECK(!admissionAdmit(&client, command_class_interactive));
+    CHECK(admissionAdmit(&other, command_class_interactive));
+
+    simAdvance_ms(1000 / ADMISSION_INTERACTIVE_RATE);
+    CHECK(admissionAdmit(&client, command_class_interactive));
+    CHECK(!admissionAdmit(&client, command_class_interactive));
+
+    // The other bucket is still full
+    for (uint8_t i = 0; i < ADMISSION_REQUEST_BURST / ADMISSION_BULK_COST; i++)
+    {
+        CHECK(admissionAdmit(&client, command_class_bulk));
+    }
+    CHECK(!admissionAdmit(&client, command_class_normal));
+
+    AdmissionStats stats;
+    admissionGetStats(&stats);
+    CHECK_EQUAL(ADMISSION_INTERACTIVE_BURST + 2, stats.admitted[command_class_interactive]);
+    CHECK_EQUAL(2, stats.dropped[command_class_interactive]);
+    CHECK_EQUAL(ADMISSION_REQUEST_BURST / ADMISSION_BULK_COST, stats.admitted[command_class_bulk]);
+    CHECK_EQUAL(1, stats.dropped[command_class_normal]);
+}
+
+int main(int argc, char** argv)
+{
+    testClassifyAnyCase();
+    testBucketsRefill();
+
+    return HOST_TEST_END("test_admission");
+}
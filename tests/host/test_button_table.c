@@ -0,0 +1,370 @@
+/**
+ * Runs the button table on an in-memory flash, and checks the summary advertised to the
+ * clients: the button count, and the table generation, which has to be the FNV-1a hash of
+ * the table file as it is on the flash, so it is the same across restarts.
+ * @file test_button_table.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "Button.h"
+#include "Filesystem.h"
+#include "Task_Queue.h"
+
+#define SIM_MAX_FILES 16
+#define SIM_FILE_NAME_SIZE 32
+#define SIM_FILE_SIZE 8192
+
+typedef struct
+{
+    char name[SIM_FILE_NAME_SIZE];
+    _u8 data[SIM_FILE_SIZE];
+    _u32 size;    // bytes written so far, what sl_FsGetInfo reports
+    _u32 maxSize;
+    bool used;
+} SimFile;
+
+static SimFile files[SIM_MAX_FILES];
+static Task tableChangeTask;
+static uint32_t tableChanges = 0;
+static bool failTableWrite = false; // the flash is full, the table file cannot be written
+
+static SimFile* findFile(const unsigned char* fileName)
+{
+    SimFile* RetVal = NULL;
+
+    for (uint8_t i = 0; i < SIM_MAX_FILES; i++)
+    {
+        if (files[i].used && (strcmp(files[i].name, (const char*)fileName) == 0))
+        {
+            RetVal = &files[i];
+            break;
+        }
+    }
+
+    return RetVal;
+}
+
+// The file descriptor is the index of the file, as every file is only open once at a time
+int fsGetFileSizeInBytes(const unsigned char* fileName)
+{
+    SimFile* file = findFile(fileName);
+    return (file != NULL) ? (int)file->size : FILE_IO_ERROR;
+}
+
+int fsCreateFile(const unsigned char* fileName, _u32 maxFileSize)
+{
+    int RetVal = FILE_IO_ERROR;
+    SimFile* file = findFile(fileName);
+
+    for (uint8_t i = 0; (file == NULL) && (i < SIM_MAX_FILES); i++)
+    {
+        if (!files[i].used)
+        {
+            file = &files[i];
+        }
+    }
+
+    if ((file != NULL) && (maxFileSize <= SIM_FILE_SIZE))
+    {
+        // Created over an existing file, the old contents are gone
+        memset(file, 0, sizeof(SimFile));
+        snprintf(file->name, SIM_FILE_NAME_SIZE, "%s", fileName);
+        file->maxSize = maxFileSize;
+        file->used = true;
+        RetVal = file - files;
+    }
+
+    return RetVal;
+}
+
+int fsOpenFile(const unsigned char* fileName, flashOperation fileOp)
+{
+    int RetVal = FILE_IO_ERROR;
+    SimFile* file = findFile(fileName);
+
+    if ((file != NULL) && !(failTableWrite && (fileOp == flash_write) && (strcmp((const char*)fileName, BUTTON_TABLE_FILE) == 0)))
+    {
+        // Opened for writing, the whole file is written again
+        if (fileOp == flash_write)
+        {
+            file->size = 0;
+        }
+        RetVal = file - files;
+    }
+
+    return RetVal;
+}
+
+int fsReadFile(_i32 fileHandle, void* buff, _u32 offset, _u32 length)
+{
+    int RetVal = FILE_IO_ERROR;
+    SimFile* file = &files[fileHandle];
+
+    if (offset + length <= file->size)
+    {
+        memcpy(buff, &file->data[offset], length);
+        RetVal = length;
+    }
+
+    return RetVal;
+}
+
+int fsWriteFile(_i32 fileHandle, _u32 offset, _u32 length, const void* buffer)
+{
+    int RetVal = FILE_IO_ERROR;
+    SimFile* file = &files[fileHandle];
+
+    if (offset + length <= file->maxSize)
+    {
+        memcpy(&file->data[offset], buffer, length);
+        file->size = (offset + length > file->size) ? (offset + length) : file->size;
+        RetVal = length;
+    }
+
+    return RetVal;
+}
+
+int fsCloseFile(_i32 fileDescriptor)
+{
+    return 0;
+}
+
+int fsDeleteFile(const unsigned char* fileName)
+{
+    int RetVal = FILE_IO_ERROR;
+    SimFile* file = findFile(fileName);
+
+    if (file != NULL)
+    {
+        file->used = false;
+        RetVal = 0;
+    }
+
+    return RetVal;
+}
+
+bool fsCheckFileExists(const unsigned char* fileName)
+{
+    return (findFile(fileName) != NULL);
+}
+
+/**
+ * The FNV-1a hash of the table file, worked out here from the flash
+ */
+static _u32 simTableHash()
+{
+    _u32 RetVal = 2166136261u;
+    SimFile* file = findFile((const unsigned char*)BUTTON_TABLE_FILE);
+
+    for (_u32 i = 0; (file != NULL) && (i < file->size); i++)
+    {
+        RetVal = (RetVal ^ file->data[i]) * 16777619u;
+    }
+
+    return RetVal;
+}
+
+static void tableChangeTaskFxn(Task* task)
+{
+    tableChanges++;
+}
+
+/**
+ * Runs the tasks that were posted
+ * @return The number of table change tasks that ran
+ */
+static uint32_t simRunTasks()
+{
+    uint32_t changesBefore = tableChanges;
+
+    while (taskRunNext())
+    {
+    }
+
+    return tableChanges - changesBefore;
+}
+
+static int simCreateButtonFilled(const char* name, _u8 fill)
+{
+    SignalInterval sequence[4];
+    memset(sequence, fill, sizeof(sequence));
+    return createButton((const unsigned char*)name, 38000, sequence, sizeof(sequence));
+}
+
+static int simCreateButton(const char* name)
+{
+    return simCreateButtonFilled(name, 0);
+}
+
+/**
+ * Every change of the table changes the generation to the hash of the new table,
+ * posts the table change task once and keeps the count of the buttons
+ */
+static void testGenerationFollowsTheTable()
+{
+    MacroStep steps[2] = {{0, 100}, {1, 0}};
+
+    button_init();
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK(fsCheckFileExists((const unsigned char*)BUTTON_TABLE_FILE));
+    CHECK_EQUAL(0, getNumButtons());
+    CHECK_EQUAL(simTableHash(), getButtonTableGeneration());
+
+    CHECK_EQUAL(0, simCreateButton("Power"));
+    CHECK_EQUAL(1, simRunTasks());
+    _u32 afterPower = getButtonTableGeneration();
+    CHECK_EQUAL(simTableHash(), afterPower);
+
+    CHECK_EQUAL(1, simCreateButton("Volume Up"));
+    CHECK_EQUAL(2, createMacro((const unsigned char*)"Movie", steps, 2));
+    // Posted twice before it ran, it runs once
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK_EQUAL(3, getNumButtons());
+    CHECK_EQUAL(simTableHash(), getButtonTableGeneration());
+    CHECK(getButtonTableGeneration() != afterPower);
+
+    // A name that is already used is not added, nothing changed
+    CHECK(simCreateButton("Power") < 0);
+    CHECK_EQUAL(0, simRunTasks());
+    CHECK_EQUAL(3, getNumButtons());
+
+    CHECK_EQUAL(0, deleteButton(1));
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK_EQUAL(2, getNumButtons());
+    CHECK_EQUAL(simTableHash(), getButtonTableGeneration());
+    CHECK(!fsCheckFileExists((const unsigned char*)"Button1"));
+}
+
+/**
+ * The generation only depends on what is on the flash: it is the same after a restart,
+ * which does not post the table change task, and the same table gets the same generation
+ */
+static void testGenerationIsStable()
+{
+    _u32 generation = getButtonTableGeneration();
+
+    button_init();
+    CHECK_EQUAL(0, simRunTasks());
+    CHECK_EQUAL(generation, getButtonTableGeneration());
+    CHECK_EQUAL(2, getNumButtons());
+
+    // The deleted button is added back into its empty entry, as it was before
+    CHECK_EQUAL(1, simCreateButton("Volume Up"));
+    CHECK_EQUAL(1, simRunTasks());
+    _u32 readded = getButtonTableGeneration();
+    CHECK_EQUAL(0, deleteButton(1));
+    CHECK_EQUAL(1, simCreateButton("Volume Up"));
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK_EQUAL(readded, getButtonTableGeneration());
+}
+
+/**
+ * A batch of changes is written once when it ends, and only then the generation changes
+ * and the table change task is posted, once for the whole batch
+ */
+static void testBatchChangesOnce()
+{
+    _u32 generation = getButtonTableGeneration();
+
+    buttonTableBeginBatch();
+    CHECK_EQUAL(3, simCreateButton("Mute"));
+    CHECK_EQUAL(4, simCreateButton("Input"));
+    CHECK_EQUAL(0, deleteButton(0));
+    CHECK_EQUAL(0, simRunTasks());
+    CHECK_EQUAL(generation, getButtonTableGeneration());
+    CHECK_EQUAL(generation, simTableHash());
+    CHECK(fsCheckFileExists((const unsigned char*)"Button0"));
+
+    CHECK_EQUAL(0, buttonTableEndBatch());
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK_EQUAL(4, getNumButtons());
+    CHECK_EQUAL(simTableHash(), getButtonTableGeneration());
+    CHECK(getButtonTableGeneration() != generation);
+    CHECK(!fsCheckFileExists((const unsigned char*)"Button0"));
+
+    // An empty batch writes nothing
+    buttonTableBeginBatch();
+    CHECK_EQUAL(0, buttonTableEndBatch());
+    CHECK_EQUAL(0, simRunTasks());
+}
+
+/**
+ * The files of the buttons a batch deleted are kept if the table cannot be written, and
+ * a button added in the batch does not take the entry of one the batch deleted
+ */
+static void testBatchDeletesAfterTheWrite()
+{
+    _u32 generation = getButtonTableGeneration();
+
+    buttonTableBeginBatch();
+    CHECK_EQUAL(0, deleteButton(3));
+    failTableWrite = true;
+    CHECK_EQUAL(FILE_IO_ERROR, buttonTableEndBatch());
+    failTableWrite = false;
+    CHECK_EQUAL(0, simRunTasks());
+    CHECK_EQUAL(generation, getButtonTableGeneration());
+    CHECK_EQUAL(4, getNumButtons());
+    CHECK(fsCheckFileExists((const unsigned char*)"Button3"));
+
+    // The first new button takes the empty entry 0, the second a new entry past the one
+    // deleted in the batch, whose file is deleted with the table written
+    buttonTableBeginBatch();
+    CHECK_EQUAL(0, deleteButton(3));
+    CHECK_EQUAL(0, simCreateButton("Power"));
+    CHECK_EQUAL(5, simCreateButton("Guide"));
+    CHECK_EQUAL(0, buttonTableEndBatch());
+    CHECK_EQUAL(1, simRunTasks());
+    CHECK_EQUAL(5, getNumButtons());
+    CHECK(fsCheckFileExists((const unsigned char*)"Button0"));
+    CHECK(!fsCheckFileExists((const unsigned char*)"Button3"));
+    CHECK(fsCheckFileExists((const unsigned char*)"Button5"));
+
+    // The entry comes free once the batch is written
+    CHECK_EQUAL(3, simCreateButton("Mute"));
+    CHECK_EQUAL(1, simRunTasks());
+}
+
+/**
+ * A batch that deletes a button and adds new ones, then fails to write the table, leaves
+ * the file of the deleted button as it was, so the old table still points at its data
+ */
+static void testBatchDeleteThenAddKeepsTheOldFile()
+{
+    _u8 oldData[SIM_FILE_SIZE];
+    SimFile* file = findFile((const unsigned char*)"Button4");
+    _u32 oldSize = file->size;
+    _u32 generation = getButtonTableGeneration();
+    memcpy(oldData, file->data, oldSize);
+
+    buttonTableBeginBatch();
+    CHECK_EQUAL(0, deleteButton(4));
+    CHECK_EQUAL(6, simCreateButtonFilled("Record", 0xab));
+    failTableWrite = true;
+    CHECK_EQUAL(FILE_IO_ERROR, buttonTableEndBatch());
+    failTableWrite = false;
+    CHECK_EQUAL(0, simRunTasks());
+    CHECK_EQUAL(generation, getButtonTableGeneration());
+    CHECK_EQUAL(6, getNumButtons());
+
+    file = findFile((const unsigned char*)"Button4");
+    CHECK(file != NULL);
+    CHECK_EQUAL(oldSize, (file != NULL) ? file->size : 0);
+    CHECK((file != NULL) && (memcmp(oldData, file->data, oldSize) == 0));
+}
+
+int main(int argc, char** argv)
+{
+    taskCreate(&tableChangeTask, tableChangeTaskFxn, task_priority_low);
+    buttonSetTableChangeTask(&tableChangeTask);
+
+    testGenerationFollowsTheTable();
+    testGenerationIsStable();
+    testBatchChangesOnce();
+    testBatchDeletesAfterTheWrite();
+    testBatchDeleteThenAddKeepsTheOldFile();
+
+    return HOST_TEST_END("test_button_table");
+}
@@ -0,0 +1,1144 @@
+/**
+ * Runs the emitter against a simulation of its interval timer. The simulated timer
+ * counts down, reloads itself at every timeout (from the load register, or right away
+ * when a load is written while TAILD is clear) and calls the interrupt some ticks late.
+ * The test records every timeout and every change of the carrier gates.
+ * The corpus files given on the command line are sent as a benchmark of what reaches the
+ * air: every interval of the carrier against the stored one, the drift over the sequence
+ * and the carrier start and stop latency, for the interrupt latency and driver overhead
+ * given with --isr-latency-ns= and --driver-overhead-ns= (--verbose lists every interval).
+ * @file test_ir_emitter.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ti/drivers/PWM.h>
+#include <ti/drivers/Timer.h>
+#include <ti/drivers/dpl/HwiP.h>
+#include <ti/devices/cc32xx/inc/hw_memmap.h>
+#include <ti/devices/cc32xx/inc/hw_timer.h>
+#include "host_test.h"
+#include "Board.h"
+#include "IR_Emitter.h"
+
+#define SIM_MATCH_ON 0x0800   // match register value the fake PWM driver uses for a 50% duty
+#define SIM_MATCH_OFF 0xFFFF  // and for a 0% duty
+#define SIM_MAX_EVENTS 1024
+#define SIM_MAX_STEPS 100000
+#define SIM_TAMR (EMITTER_TIMER_BASE + TIMER_O_TAMR)
+#define SIM_TAILR (EMITTER_TIMER_BASE + TIMER_O_TAILR)
+#define SIM_TAV (EMITTER_TIMER_BASE + TIMER_O_TAV)
+#define BENCH_LATENCIES 97   // interrupt latencies the corpus benchmark takes in turn
+#define BENCH_SENDS 1000     // sends the first edge benchmark times
+
+typedef struct
+{
+    uint32_t time;
+    bool on;
+} GateChange;
+
+static const unsigned long matchRegister[EMITTER_CHANNEL_COUNT] =
+{
+    TIMERA2_BASE + TIMER_O_TBMATCHR,
+    TIMERA3_BASE + TIMER_O_TBMATCHR
+};
+
+// Simulated interval timer, times are in timer ticks
+static Timer_CallBackFxn timerCallback = NULL;
+static uint32_t timerPeriod = 0;
+static bool timerRunning = false;
+static uint32_t timerStarts = 0;
+static uint32_t simNow = 0;
+static uint32_t simCount = 0;        // ticks until the next timeout
+static uint32_t simReload = 0;       // load register, counted down after the next timeout
+static bool simLoadOnTimeout = false; // TAILD
+static uint32_t staleReloads = 0;    // timeouts that came before the interrupt queued the next load
+static uint32_t minReload = 0;       // shortest interval the timer reloaded with
+static uint32_t simPrepareTicks = 0; // time the thread takes to prepare a send, spent when it starts the carrier
+static uint8_t simMaskDepth = 0;
+static bool simUnmasked = false;     // the thread is sending with interrupts enabled
+static uint32_t unmaskedTimerAccesses = 0; // accesses of the timer the interrupt could have come in between
+static struct timespec firstGateClock; // host time the first gate change of a run was applied
+
+static uint32_t timeouts[SIM_MAX_EVENTS];
+static uint32_t timeoutLatency[SIM_MAX_EVENTS];
+static uint16_t numTimeouts = 0;
+static GateChange gates[EMITTER_CHANNEL_COUNT][SIM_MAX_EVENTS];
+static uint16_t numGates[EMITTER_CHANNEL_COUNT];
+static unsigned long gateValue[EMITTER_CHANNEL_COUNT];
+
+Timer_Handle Timer_open(uint_least8_t index, Timer_Params* params)
+{
+    timerCallback = params->timerCallback;
+    timerPeriod = params->period * EMITTER_TICKS_PER_US;
+    return (Timer_Handle)(uintptr_t)(index + 1);
+}
+
+int32_t Timer_start(Timer_Handle handle)
+{
+    timerRunning = true;
+    timerStarts++;
+    simCount = timerPeriod;
+    simReload = timerPeriod;
+    hostSetRegister(SIM_TAV, simCount);
+    return 0;
+}
+
+void Timer_stop(Timer_Handle handle)
+{
+    timerRunning = false;
+}
+
+PWM_Handle PWM_open(uint_least8_t index, PWM_Params* params)
+{
+    return (PWM_Handle)(uintptr_t)(index + 1);
+}
+
+void PWM_start(PWM_Handle handle)
+{
+    simNow += simPrepareTicks;
+    simCount -= simPrepareTicks;
+    hostSetRegister(SIM_TAV, simCount);
+}
+
+int_fast16_t PWM_setDuty(PWM_Handle handle, uint32_t duty)
+{
+    uint8_t channel = (uint8_t)((uintptr_t)handle - 1);
+    hostSetRegister(matchRegister[channel], (duty == 0) ? SIM_MATCH_OFF : SIM_MATCH_ON);
+    gateValue[channel] = (duty == 0) ? SIM_MATCH_OFF : SIM_MATCH_ON;
+    return 0;
+}
+
+/**
+ * Applies the register writes of the emitter to the simulated timer and records the gate changes
+ */
+static void simApplyAccesses()
+{
+    HostRegisterAccess accesses[64];
+    uint16_t numAccesses = hostReadAccesses(accesses, 64);
+
+    for (uint16_t i = 0; i < numAccesses; i++)
+    {
+        if (simUnmasked && ((accesses[i].address == SIM_TAMR) || (accesses[i].address == SIM_TAILR) || (accesses[i].address == SIM_TAV)))
+        {
+            unmaskedTimerAccesses++;
+        }
+        if (accesses[i].address == SIM_TAMR)
+        {
+            simLoadOnTimeout = (accesses[i].value & TIMER_TAMR_TAILD) != 0;
+        }
+        else if (accesses[i].address == SIM_TAILR)
+        {
+            simReload = accesses[i].value;
+            if (!simLoadOnTimeout)
+            {
+                simCount = accesses[i].value;
+                hostSetRegister(SIM_TAV, simCount);
+            }
+        }
+        else if (accesses[i].address == SIM_TAV)
+        {
+            simCount = accesses[i].value;
+        }
+
+        for (uint8_t ch = 0; ch < EMITTER_CHANNEL_COUNT; ch++)
+        {
+            if ((accesses[i].address == matchRegister[ch]) && (accesses[i].value != gateValue[ch]))
+            {
+                gateValue[ch] = accesses[i].value;
+                if ((numGates[0] == 0) && (numGates[1] == 0))
+                {
+                    clock_gettime(CLOCK_MONOTONIC, &firstGateClock);
+                }
+                if (numGates[ch] < SIM_MAX_EVENTS)
+                {
+                    gates[ch][numGates[ch]].time = simNow;
+                    gates[ch][numGates[ch]].on = (accesses[i].value == SIM_MATCH_ON);
+                    numGates[ch]++;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Masking the interrupts applies the accesses made before with them enabled, and
+ * enabling them again the ones made while they were masked
+ */
+uintptr_t HwiP_disable(void)
+{
+    if (simMaskDepth++ == 0)
+    {
+        simApplyAccesses();
+    }
+    bool wasUnmasked = simUnmasked;
+    simUnmasked = false;
+    return wasUnmasked;
+}
+
+void HwiP_restore(uintptr_t key)
+{
+    if (--simMaskDepth == 0)
+    {
+        simApplyAccesses();
+    }
+    simUnmasked = (key != 0);
+}
+
+/**
+ * Lets the timer run to its next timeout and runs the interrupt for it
+ * @param latency Ticks from the timeout until the interrupt has queued the next load
+ * @return false if the timer is stopped
+ */
+static bool simStep(uint32_t latency)
+{
+    if (!timerRunning)
+    {
+        return false;
+    }
+
+    simNow += simCount;
+    simCount = simReload;
+    if ((minReload == 0) || (simCount < minReload))
+    {
+        minReload = simCount;
+    }
+
+    if (simCount <= latency)
+    {
+        staleReloads++;
+        latency = simCount - 1;
+    }
+    if (numTimeouts < SIM_MAX_EVENTS)
+    {
+        timeouts[numTimeouts] = simNow;
+        timeoutLatency[numTimeouts] = latency;
+        numTimeouts++;
+    }
+    simNow += latency;
+    simCount -= latency;
+    hostSetRegister(SIM_TAV, simCount);
+
+    timerCallback(NULL);
+    simApplyAccesses();
+
+    return true;
+}
+
+/**
+ * Finds the timeout at a time
+ * @return The index of the timeout, -1 if the timer did not time out then
+ */
+static int findTimeout(uint32_t time)
+{
+    for (uint16_t i = 0; i < numTimeouts; i++)
+    {
+        if (timeouts[i] == time)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Finds the timeout at a time and gets how late its interrupt was
+ * @return The latency in ticks, 0 if the timer did not time out then
+ */
+static uint32_t latencyAt(uint32_t time)
+{
+    int timeout = findTimeout(time);
+
+    CHECK(timeout >= 0);
+    return (timeout >= 0) ? timeoutLatency[timeout] : 0;
+}
+
+/**
+ * Converts timer ticks to the nanoseconds the emitter reports
+ */
+static uint32_t ticksToNs(uint32_t ticks)
+{
+    return (uint32_t)(((uint64_t)ticks * 1000) / EMITTER_TICKS_PER_US);
+}
+
+/**
+ * Gets the carrier gate of a channel at a time
+ * @param start A time before the send, times are compared from it so they can wrap
+ * @param time The time to look at
+ * @return true if the carrier was gated on
+ */
+static bool gateOnAt(uint8_t channel, uint32_t start, uint32_t time)
+{
+    bool RetVal = false;
+
+    for (uint16_t i = 0; i < numGates[channel]; i++)
+    {
+        if ((gates[channel][i].time - start) <= (time - start))
+        {
+            RetVal = gates[channel][i].on;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Checks that a channel sent exactly a list of intervals: one timeout at the end of
+ * every interval, and the carrier gated the way the interval says from its start on
+ * @param channel The channel
+ * @param intervals The intervals the channel should have sent
+ * @param numIntervals The number of intervals
+ * @param start The time of the first edge
+ */
+static void checkEmission(uint8_t channel, const SignalInterval* intervals, uint16_t numIntervals, uint32_t start)
+{
+    uint32_t time = start;
+    uint32_t gated = start;
+
+    CHECK_EQUAL(numIntervals, numTimeouts);
+    for (uint16_t i = 0; i < numIntervals; i++)
+    {
+        if (gateOnAt(channel, start, gated) != intervals[i].PWM)
+        {
+            printf("channel %u interval %u is gated %s\n", channel, i, intervals[i].PWM ? "off" : "on");
+            hostTestFailures++;
+        }
+
+        time += intervals[i].time_us * EMITTER_TICKS_PER_US;
+        int timeout = findTimeout(time);
+        if (timeout < 0)
+        {
+            printf("channel %u interval %u does not end on a timeout\n", channel, i);
+            hostTestFailures++;
+        }
+        gated = (timeout >= 0) ? (time + timeoutLatency[timeout]) : time;
+    }
+    CHECK(!gateOnAt(channel, start, gated));
+}
+
+/**
+ * Sends a sequence on a channel from the thread, at the current simulated time
+ */
+static void simSend(uint8_t channel, const SignalInterval* sequence, uint16_t length, uint32_t trailingGap_us)
+{
+    SignalInterval* button = malloc(length * sizeof(SignalInterval));
+    memcpy(button, sequence, length * sizeof(SignalInterval));
+
+    simApplyAccesses();
+    simUnmasked = true;
+    IRemitterSendButton(channel, button, 38000, trailingGap_us);
+    simApplyAccesses();
+    simUnmasked = false;
+}
+
+/**
+ * Runs the timer until it stops, with the interrupt latencies taken in turn from a list
+ * @return The number of interrupts
+ */
+static uint32_t simRun(const uint32_t* latencies, uint16_t numLatencies)
+{
+    uint32_t steps = 0;
+
+    while ((steps < SIM_MAX_STEPS) && simStep(latencies[steps % numLatencies]))
+    {
+        steps++;
+    }
+    CHECK(!timerRunning);
+
+    return steps;
+}
+
+static void simReset()
+{
+    numTimeouts = 0;
+    memset(numGates, 0, sizeof(numGates));
+    staleReloads = 0;
+    minReload = 0;
+    timerStarts = 0;
+    unmaskedTimerAccesses = 0;
+}
+
+/**
+ * The timer reloads itself in hardware, so every timeout falls exactly where the
+ * sequence says no matter how late the interrupt runs
+ */
+static void testIntervalsIgnoreInterruptLatency()
+{
+    static const SignalInterval sequence[] =
+    {
+        {9000, true}, {4500, false}, {560, true}, {560, false}, {560, true}, {1690, false}, {560, true}, {0, false}
+    };
+    static const uint32_t latencies[] = {120, 640, 80, 400, 230, 560, 90};
+    uint16_t numIntervals = (sizeof(sequence) / sizeof(sequence[0])) - 1;
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, sequence, numIntervals + 1, 0);
+    CHECK(IRemitterBusy(0));
+    CHECK_EQUAL(0, unmaskedTimerAccesses);
+
+    simRun(latencies, sizeof(latencies) / sizeof(latencies[0]));
+
+    // The first edge is gated by the send itself, every other one by the interrupt of a
+    // timeout exactly where the sequence puts the edge
+    uint32_t expected = start;
+    int timeout = -1;
+    CHECK_EQUAL(numIntervals + 1, numGates[0]);
+    CHECK_EQUAL(start, gates[0][0].time);
+    for (uint16_t i = 0; (i < numIntervals) && (i + 1 < numGates[0]); i++)
+    {
+        expected += sequence[i].time_us * EMITTER_TICKS_PER_US;
+        timeout = findTimeout(expected);
+        CHECK(timeout >= 0);
+        if (timeout >= 0)
+        {
+            CHECK_EQUAL(timeouts[timeout] + timeoutLatency[timeout], gates[0][i + 1].time);
+        }
+        CHECK_EQUAL((i + 1 < numIntervals) ? sequence[i + 1].PWM : false, gates[0][i + 1].on);
+    }
+
+    // The timer was started once for the whole sequence, took one interrupt per interval
+    // and nothing went stale
+    CHECK_EQUAL(1, timerStarts);
+    CHECK_EQUAL(numIntervals, numTimeouts);
+    CHECK_EQUAL(0, staleReloads);
+
+    uint32_t duration_us = 0;
+    CHECK(!IRemitterBusy(0));
+    CHECK(IRemitterCompleted(0, &duration_us));
+    CHECK_EQUAL((expected - start + ((timeout >= 0) ? timeoutLatency[timeout] : 0)) / EMITTER_TICKS_PER_US, duration_us);
+}
+
+/**
+ * The longest sequence a button stores, sent against a spread of interrupt latencies:
+ * the timeouts do not drift from the schedule over all of it, where a timer reloaded from
+ * the interrupt would have fallen behind by every latency added up
+ */
+static void testLongSequenceDoesNotDrift()
+{
+    static SignalInterval sequence[MAX_SEQUENCE_INDEX];
+    static const uint32_t latencies[] = {120, 640, 80, 400, 230, 560, 90, 1000, 10, 700, 300};
+    uint16_t numLatencies = sizeof(latencies) / sizeof(latencies[0]);
+    EmitterStats stats;
+
+    for (uint16_t i = 0; i < MAX_SEQUENCE_INDEX; i++)
+    {
+        sequence[i].time_us = ((i % 3) == 0) ? 1690 : 560;
+        sequence[i].PWM = (i % 2) == 0;
+    }
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, sequence, MAX_SEQUENCE_INDEX, 0);
+    uint32_t steps = simRun(latencies, numLatencies);
+    checkEmission(0, sequence, MAX_SEQUENCE_INDEX, start);
+    CHECK_EQUAL(MAX_SEQUENCE_INDEX, steps);
+    CHECK_EQUAL(0, staleReloads);
+
+    // Where the last timeout fell against where the schedule puts it, and how far behind a
+    // timer reloaded from the interrupt would be by then
+    uint32_t scheduled = start;
+    uint64_t softwareDrift = 0;
+    for (uint16_t i = 0; i < MAX_SEQUENCE_INDEX; i++)
+    {
+        scheduled += sequence[i].time_us * EMITTER_TICKS_PER_US;
+        softwareDrift += latencies[i % numLatencies];
+    }
+    int32_t drift = (numTimeouts > 0) ? (int32_t)(timeouts[numTimeouts - 1] - scheduled) : -1;
+    CHECK_EQUAL(0, drift);
+
+    IRgetEmitterStats(0, &stats);
+    CHECK_EQUAL(MAX_SEQUENCE_INDEX, stats.edges);
+    CHECK_EQUAL((int32_t)ticksToNs(latencies[(MAX_SEQUENCE_INDEX - 1) % numLatencies]), stats.cumulativeDrift_ns);
+    CHECK(IRemitterCompleted(0, NULL));
+
+    printf("%u intervals: timeouts drifted %d ns, carrier gate %d ns, max interval error %u ns, "
+           "reloaded from the interrupt %llu ns\n",
+           MAX_SEQUENCE_INDEX, drift * 1000 / EMITTER_TICKS_PER_US, stats.cumulativeDrift_ns, stats.maxIntervalError_ns,
+           (unsigned long long)((softwareDrift * 1000) / EMITTER_TICKS_PER_US));
+}
+
+/**
+ * Works out the accuracy measurements a send should report from the latencies of the
+ * timeouts at its edges
+ * @param sequence The intervals sent
+ * @param numIntervals The number of intervals sent
+ * @param time The timeout that started the first interval
+ * @param firstLatency How late the first interval was gated
+ * @param stats Filled with the measurements, apart from the start latency
+ */
+static void expectStats(const SignalInterval* sequence, uint16_t numIntervals, uint32_t time,
+                        uint32_t firstLatency, EmitterStats* stats)
+{
+    uint32_t previous = firstLatency;
+    uint32_t maxLatency = firstLatency;
+    uint32_t maxError = 0;
+    uint32_t latency = 0;
+
+    for (uint16_t i = 0; i < numIntervals; i++)
+    {
+        time += sequence[i].time_us * EMITTER_TICKS_PER_US;
+        latency = latencyAt(time);
+
+        // The timeout after the last interval only switches the carrier off
+        if (i + 1 < numIntervals)
+        {
+            uint32_t error = (latency > previous) ? (latency - previous) : (previous - latency);
+            maxLatency = (latency > maxLatency) ? latency : maxLatency;
+            maxError = (error > maxError) ? error : maxError;
+            previous = latency;
+        }
+    }
+
+    stats->edges = numIntervals;
+    stats->maxEdgeLatency_ns = ticksToNs(maxLatency);
+    stats->maxIntervalError_ns = ticksToNs(maxError);
+    stats->carrierStopLatency_ns = ticksToNs(latency);
+    stats->cumulativeDrift_ns = (int32_t)ticksToNs(latency) - (int32_t)ticksToNs(firstLatency);
+}
+
+/**
+ * The accuracy measurements of a send are the interrupt latencies the timer saw at
+ * its edges, for a channel that starts the timer and for one that waits for it
+ */
+static void testStatsReflectInterruptLatency()
+{
+    static const SignalInterval first[] =
+    {
+        {9000, true}, {4500, false}, {560, true}, {560, false}, {560, true}, {1690, false}, {560, true}, {0, false}
+    };
+    static const SignalInterval second[] =
+    {
+        {2400, true}, {600, false}, {1200, true}, {600, false}, {600, true}, {0, false}
+    };
+    static const uint32_t latencies[] = {320, 40, 720, 160, 480, 0, 600, 240};
+    uint16_t numFirst = (sizeof(first) / sizeof(first[0])) - 1;
+    uint16_t numSecond = (sizeof(second) / sizeof(second[0])) - 1;
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, first, numFirst + 1, 0);
+
+    // Ask for the second channel part way into the header of the first
+    for (uint16_t i = 0; i < 3; i++)
+    {
+        simStep(latencies[i]);
+    }
+    uint32_t request = simNow;
+    simSend(1, second, numSecond + 1, 0);
+    CHECK(IRemitterBusy(1));
+    CHECK_EQUAL(0, unmaskedTimerAccesses);
+
+    simRun(latencies, sizeof(latencies) / sizeof(latencies[0]));
+
+    // The first channel gated its first edge straight from the send
+    EmitterStats expected;
+    EmitterStats stats;
+    expectStats(first, numFirst, start, 0, &expected);
+    IRgetEmitterStats(0, &stats);
+    CHECK_EQUAL(expected.edges, stats.edges);
+    CHECK_EQUAL(0, stats.carrierStartLatency_ns);
+    CHECK_EQUAL(expected.maxEdgeLatency_ns, stats.maxEdgeLatency_ns);
+    CHECK_EQUAL(expected.maxIntervalError_ns, stats.maxIntervalError_ns);
+    CHECK_EQUAL(expected.carrierStopLatency_ns, stats.carrierStopLatency_ns);
+    CHECK_EQUAL(expected.cumulativeDrift_ns, stats.cumulativeDrift_ns);
+
+    // The second channel waited from the request until an interrupt gated its first edge
+    CHECK_EQUAL(numSecond + 1, numGates[1]);
+    int timeout = -1;
+    for (uint16_t i = 0; (i < numTimeouts) && (numGates[1] > 0); i++)
+    {
+        if (timeouts[i] + timeoutLatency[i] == gates[1][0].time)
+        {
+            timeout = i;
+        }
+    }
+    CHECK(timeout >= 0);
+    if (timeout >= 0)
+    {
+        expectStats(second, numSecond, timeouts[timeout], timeoutLatency[timeout], &expected);
+        IRgetEmitterStats(1, &stats);
+        CHECK_EQUAL(expected.edges, stats.edges);
+        CHECK_EQUAL(ticksToNs(gates[1][0].time - request), stats.carrierStartLatency_ns);
+        CHECK_EQUAL(expected.maxEdgeLatency_ns, stats.maxEdgeLatency_ns);
+        CHECK_EQUAL(expected.maxIntervalError_ns, stats.maxIntervalError_ns);
+        CHECK_EQUAL(expected.carrierStopLatency_ns, stats.carrierStopLatency_ns);
+        CHECK_EQUAL(expected.cumulativeDrift_ns, stats.cumulativeDrift_ns);
+    }
+
+    CHECK_EQUAL(0, staleReloads);
+    CHECK(IRemitterCompleted(0, NULL));
+    CHECK(IRemitterCompleted(1, NULL));
+}
+
+
+/**
+ * A send that takes longer to prepare than the nanoseconds of its start latency fit
+ * in 32 bits of ticks still reports the whole latency
+ */
+static void testLongStartLatency()
+{
+    static const SignalInterval sequence[] = {{560, true}, {560, false}, {560, true}, {0, false}};
+    static const uint32_t latencies[] = {100};
+
+    simReset();
+    simPrepareTicks = 60000 * EMITTER_TICKS_PER_US;
+    uint32_t start = simNow;
+    simSend(0, sequence, sizeof(sequence) / sizeof(sequence[0]), 0);
+    simPrepareTicks = 0;
+    simRun(latencies, 1);
+
+    EmitterStats stats;
+    IRgetEmitterStats(0, &stats);
+    CHECK_EQUAL(start + (60000 * EMITTER_TICKS_PER_US), gates[0][0].time);
+    CHECK_EQUAL(60000000, stats.carrierStartLatency_ns);
+    CHECK_EQUAL(3, stats.edges);
+    CHECK(IRemitterCompleted(0, NULL));
+}
+
+/**
+ * Checks that every edge of a channel was gated no earlier than the schedule puts it
+ * and no later than the minimum reload plus the interrupt latency after that
+ * @param channel The channel
+ * @param sequence The intervals sent on the channel
+ * @param numIntervals The number of intervals
+ * @param origin Where the schedule puts the first edge
+ * @param maxLatency The longest interrupt latency of the run
+ */
+static void checkEdgesNearSchedule(uint8_t channel, const SignalInterval* sequence, uint16_t numIntervals,
+                                   uint32_t origin, uint32_t maxLatency)
+{
+    uint32_t scheduled = origin;
+
+    CHECK_EQUAL(numIntervals + 1, numGates[channel]);
+    for (uint16_t i = 0; (i <= numIntervals) && (i < numGates[channel]); i++)
+    {
+        uint32_t late = gates[channel][i].time - scheduled;
+        if ((int32_t)late < 0 || late > (EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US) + maxLatency)
+        {
+            printf("channel %u edge %u is %d ticks late\n", channel, i, (int32_t)late);
+            hostTestFailures++;
+        }
+        if (i < numIntervals)
+        {
+            scheduled += sequence[i].time_us * EMITTER_TICKS_PER_US;
+        }
+    }
+}
+
+/**
+ * Two channels whose edges slide past each other: edges closer together than the
+ * minimum reload are gated at one timeout, so the timer is never loaded with less than
+ * that and no interrupt comes too late to queue the next interval
+ */
+static void testCloseEdgesAreMerged()
+{
+    static SignalInterval first[60];
+    static SignalInterval second[60];
+    static const uint32_t latencies[] = {400, 1200, 80, 900, 240, 1100, 0};
+    uint32_t maxLatency = 1200;
+
+    for (uint16_t i = 0; i < 59; i++)
+    {
+        first[i].time_us = 560;
+        first[i].PWM = (i % 2) == 0;
+        second[i].time_us = 570;
+        second[i].PWM = (i % 2) == 0;
+    }
+    first[59].time_us = 0;
+    second[59].time_us = 0;
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, first, 60, 0);
+    simStep(latencies[0]);
+    simSend(1, second, 60, 0);
+    simRun(latencies, sizeof(latencies) / sizeof(latencies[0]));
+
+    // The edges came closer than the minimum reload, and the timer still never went stale
+    CHECK_EQUAL(EMITTER_MIN_RELOAD_US * EMITTER_TICKS_PER_US, minReload);
+    CHECK_EQUAL(0, staleReloads);
+
+    // Both schedules hold, the first from the send and the second from its first timeout
+    checkEdgesNearSchedule(0, first, 59, start, maxLatency);
+    int timeout = -1;
+    for (uint16_t i = 0; (i < numTimeouts) && (numGates[1] > 0); i++)
+    {
+        if (timeouts[i] + timeoutLatency[i] == gates[1][0].time)
+        {
+            timeout = i;
+        }
+    }
+    CHECK(timeout >= 0);
+    if (timeout >= 0)
+    {
+        checkEdgesNearSchedule(1, second, 59, timeouts[timeout], maxLatency);
+    }
+
+    // One timeout for each edge, and two to start the second channel: the cut interval
+    // and the one it waited out
+    CHECK(numTimeouts <= 59 + 59 + 2);
+    CHECK(IRemitterCompleted(0, NULL));
+    CHECK(IRemitterCompleted(1, NULL));
+}
+
+/**
+ * A channel asked to send while another counts down a long trailing gap starts within
+ * the idle period instead of after the gap, and the gap still ends on time
+ */
+static void testPendingStartCutsLongInterval()
+{
+    static const SignalInterval first[] = {{2400, true}, {600, false}, {1200, true}, {0, false}};
+    static const SignalInterval second[] = {{560, true}, {560, false}, {560, true}, {0, false}};
+    static const uint32_t latencies[] = {300};
+    uint32_t gap_us = 2000000;
+    uint32_t idle = EMITTER_IDLE_PERIOD_US * EMITTER_TICKS_PER_US;
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, first, 4, gap_us);
+
+    // Run until the first channel is in its trailing gap, one timeout per interval
+    while ((numGates[0] < 4) && simStep(latencies[0]))
+    {
+    }
+    CHECK_EQUAL(3, numTimeouts);
+
+    // Half a second into the gap the second channel is asked for
+    uint32_t request = simNow;
+    simPrepareTicks = 500000 * EMITTER_TICKS_PER_US;
+    simSend(1, second, 4, 0);
+    simPrepareTicks = 0;
+    uint32_t prepared = request + (500000 * EMITTER_TICKS_PER_US);
+
+    simRun(latencies, 1);
+
+    CHECK_EQUAL(4, numGates[1]);
+    CHECK(gates[1][0].time - prepared <= (2 * idle) + latencies[0]);
+
+    EmitterStats stats;
+    IRgetEmitterStats(1, &stats);
+    CHECK_EQUAL(((uint64_t)(gates[1][0].time - request) * 1000) / EMITTER_TICKS_PER_US, stats.carrierStartLatency_ns);
+
+    // The gap of the first channel ended where its schedule put it
+    uint32_t end = start + ((2400 + 600 + 1200) * EMITTER_TICKS_PER_US) + (gap_us * EMITTER_TICKS_PER_US);
+    CHECK(findTimeout(end) >= 0);
+    uint32_t duration_us = 0;
+    CHECK(IRemitterCompleted(0, &duration_us));
+    CHECK_EQUAL((end - start + latencies[0]) / EMITTER_TICKS_PER_US, duration_us);
+    CHECK(IRemitterCompleted(1, NULL));
+
+    // A handful of timeouts for the whole gap, not one every idle period
+    CHECK(numTimeouts < 16);
+    CHECK_EQUAL(0, staleReloads);
+}
+
+/**
+ * A frame stored with a repeat marker is sent as the frame, then the gap and the
+ * repeat code for every repeat
+ */
+static void testRepeatsAreExpanded()
+{
+    static const SignalInterval repeatCode[] =
+    {
+        {9000, true}, {4500, false}, {560, true},
+        {FRAME_REPEAT_MARKER, false}, {40000, false}, {2, false}, {9000, true}, {2250, false}, {560, true}, {0, false}
+    };
+    static const SignalInterval repeatCodeSent[] =
+    {
+        {9000, true}, {4500, false}, {560, true},
+        {40000, false}, {9000, true}, {2250, false}, {560, true},
+        {40000, false}, {9000, true}, {2250, false}, {560, true}
+    };
+    static const SignalInterval wholeFrame[] =
+    {
+        {560, true}, {560, false}, {1120, true}, {FRAME_REPEAT_MARKER, false}, {20000, false}, {1, false}, {0, false}
+    };
+    static const SignalInterval wholeFrameSent[] =
+    {
+        {560, true}, {560, false}, {1120, true}, {20000, false}, {560, true}, {560, false}, {1120, true}
+    };
+    static const uint32_t latencies[] = {200, 700, 50};
+    EmitterStats stats;
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, repeatCode, sizeof(repeatCode) / sizeof(repeatCode[0]), 0);
+    simRun(latencies, sizeof(latencies) / sizeof(latencies[0]));
+    checkEmission(0, repeatCodeSent, sizeof(repeatCodeSent) / sizeof(repeatCodeSent[0]), start);
+    IRgetEmitterStats(0, &stats);
+    CHECK_EQUAL(sizeof(repeatCodeSent) / sizeof(repeatCodeSent[0]), stats.edges);
+    CHECK(IRemitterCompleted(0, NULL));
+
+    simReset();
+    start = simNow;
+    simSend(1, wholeFrame, sizeof(wholeFrame) / sizeof(wholeFrame[0]), 0);
+    simRun(latencies, sizeof(latencies) / sizeof(latencies[0]));
+    checkEmission(1, wholeFrameSent, sizeof(wholeFrameSent) / sizeof(wholeFrameSent[0]), start);
+    CHECK(IRemitterCompleted(1, NULL));
+}
+
+/**
+ * A trailing gap longer than the timer can count in one interval is split, and the
+ * channel stays busy until all of it has passed
+ */
+static void testTrailingGapIsSplit()
+{
+    static const SignalInterval sequence[] = {{560, true}, {560, false}, {560, true}, {0, false}};
+    static const SignalInterval sent[] =
+    {
+        {560, true}, {560, false}, {560, true}, {EMITTER_MAX_GAP_US, false}, {500000, false}
+    };
+    static const uint32_t latencies[] = {400};
+
+    simReset();
+    uint32_t start = simNow;
+    simSend(0, sequence, sizeof(sequence) / sizeof(sequence[0]), EMITTER_MAX_GAP_US + 500000);
+    simRun(latencies, 1);
+    checkEmission(0, sent, sizeof(sent) / sizeof(sent[0]), start);
+    CHECK(IRemitterCompleted(0, NULL));
+
+    // The longest gap allowed takes more ticks than fit in 32 bits, the completion
+    // still reports all of it
+    uint32_t duration_us = 0;
+    simReset();
+    simSend(0, sequence, sizeof(sequence) / sizeof(sequence[0]), EMITTER_GAP_EDGES * EMITTER_MAX_GAP_US);
+    simRun(latencies, 1);
+    CHECK_EQUAL(EMITTER_GAP_EDGES + 3, numTimeouts);
+    CHECK(IRemitterCompleted(0, &duration_us));
+    CHECK_EQUAL((3 * 560) + (EMITTER_GAP_EDGES * EMITTER_MAX_GAP_US) + (latencies[0] / EMITTER_TICKS_PER_US), duration_us);
+}
+
+/**
+ * The time a channel has left counts down with the schedule, trailing gap included,
+ * for a channel that starts the timer and one that waits for it
+ */
+static void testTimeUntilDone()
+{
+    static const SignalInterval first[] = {{9000, true}, {4500, false}, {560, true}, {0, false}};
+    static const SignalInterval second[] = {{2400, true}, {600, false}, {1200, true}, {0, false}};
+    static const uint32_t latencies[] = {400};
+    uint32_t gap_us = 30000000;
+
+    simReset();
+    uint32_t end = simNow + ((9000 + 4500 + 560) * EMITTER_TICKS_PER_US) + (gap_us * EMITTER_TICKS_PER_US);
+    simSend(0, first, 4, gap_us);
+    CHECK_EQUAL(9000 + 4500 + 560 + gap_us, IRemitterGetTimeUntilDone(0));
+    CHECK_EQUAL(0, IRemitterGetTimeUntilDone(1));
+
+    simSend(1, second, 4, 0);
+    CHECK_EQUAL(EMITTER_IDLE_PERIOD_US, IRemitterGetTimeUntilDone(1));
+
+    while (simStep(latencies[0]) && IRemitterBusy(0))
+    {
+        CHECK_EQUAL(((end - simNow) + EMITTER_TICKS_PER_US - 1) / EMITTER_TICKS_PER_US, IRemitterGetTimeUntilDone(0));
+        if (IRemitterBusy(1) && (numGates[1] > 0))
+        {
+            uint32_t secondEnd = gates[1][0].time - latencies[0] + ((2400 + 600 + 1200) * EMITTER_TICKS_PER_US);
+            CHECK_EQUAL(((secondEnd - simNow) + EMITTER_TICKS_PER_US - 1) / EMITTER_TICKS_PER_US, IRemitterGetTimeUntilDone(1));
+        }
+    }
+    CHECK_EQUAL(0, IRemitterGetTimeUntilDone(0));
+    CHECK_EQUAL(0, IRemitterGetTimeUntilDone(1));
+    CHECK(IRemitterCompleted(0, NULL));
+    CHECK(IRemitterCompleted(1, NULL));
+}
+
+/**
+ * Times the send call on the host until the first edge is gated, for sends on the
+ * carrier of the send before and on a new carrier the PWM has to be set up for first
+ */
+static void benchFirstEdge()
+{
+    static const SignalInterval sequence[] = {{560, true}, {560, false}, {560, true}, {0, false}};
+    static const uint32_t latencies[] = {100};
+    uint64_t total_ns[2] = {0, 0};
+    uint64_t min_ns[2] = {UINT64_MAX, UINT64_MAX};
+    struct timespec call;
+
+    for (uint32_t i = 0; i < 2 * BENCH_SENDS; i++)
+    {
+        // Every other send changes the carrier
+        uint16_t carrier = ((((i + 1) / 2) % 2) != 0) ? 36000 : 40000;
+        SignalInterval* button = malloc(sizeof(sequence));
+        memcpy(button, sequence, sizeof(sequence));
+
+        simReset();
+        simApplyAccesses();
+        simUnmasked = true;
+        clock_gettime(CLOCK_MONOTONIC, &call);
+        IRemitterSendButton(0, button, carrier, 0);
+        simApplyAccesses();
+        simUnmasked = false;
+
+        CHECK(numGates[0] > 0);
+        uint64_t elapsed_ns = ((uint64_t)(firstGateClock.tv_sec - call.tv_sec) * 1000000000) + firstGateClock.tv_nsec - call.tv_nsec;
+        total_ns[i % 2] += elapsed_ns;
+        min_ns[i % 2] = (elapsed_ns < min_ns[i % 2]) ? elapsed_ns : min_ns[i % 2];
+
+        simRun(latencies, 1);
+        CHECK(IRemitterCompleted(0, NULL));
+    }
+    CHECK_EQUAL(0, unmaskedTimerAccesses);
+
+    printf("send call to first edge on the host: same carrier mean %llu ns min %llu ns, new carrier mean %llu ns min %llu ns\n",
+           (unsigned long long)(total_ns[0] / BENCH_SENDS), (unsigned long long)min_ns[0],
+           (unsigned long long)(total_ns[1] / BENCH_SENDS), (unsigned long long)min_ns[1]);
+}
+
+/**
+ * Reads a capture of the corpus into the sequence a button stores for it: m<us> mark,
+ * s<us> space, x the repeat marker, g<us> the frame gap and n<count> the repeats
+ * @param path The corpus file
+ * @param sequence Filled with the sequence, ending with a zero time
+ * @param carrier Filled with the carrier frequency
+ * @return The number of intervals stored with the zero time, 0 if the file cannot be read
+ */
+static uint16_t benchReadCapture(const char* path, SignalInterval* sequence, uint16_t* carrier)
+{
+    uint16_t RetVal = 0;
+    char word[32];
+    bool expect = false;
+    FILE* file = fopen(path, "r");
+
+    while ((file != NULL) && (RetVal + 1 < MAX_SEQUENCE_INDEX) && (fscanf(file, "%31s", word) == 1))
+    {
+        if (word[0] == '#')
+        {
+            fscanf(file, "%*[^\n]");
+        }
+        else if (strcmp(word, "carrier") == 0)
+        {
+            fscanf(file, "%hu", carrier);
+        }
+        else if (strcmp(word, "expect") == 0)
+        {
+            expect = true;
+        }
+        else if (strcmp(word, "edges") == 0)
+        {
+            break;
+        }
+        else if (expect)
+        {
+            sequence[RetVal].time_us = (word[0] == 'x') ? FRAME_REPEAT_MARKER : strtoul(&word[1], NULL, 10);
+            sequence[RetVal].PWM = (word[0] == 'm');
+            RetVal++;
+        }
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+        sequence[RetVal].time_us = 0;
+        sequence[RetVal].PWM = false;
+        RetVal++;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Adds intervals to what the carrier should do, joining those with the same gating
+ * @return The number of intervals in air
+ */
+static uint16_t benchAppend(SignalInterval* air, uint16_t numAir, const SignalInterval* intervals, uint16_t first, uint16_t end)
+{
+    for (uint16_t i = first; (i < end) && (numAir < EMITTER_EDGE_TABLE_SIZE); i++)
+    {
+        if ((numAir > 0) && (air[numAir - 1].PWM == intervals[i].PWM))
+        {
+            air[numAir - 1].time_us += intervals[i].time_us;
+        }
+        else
+        {
+            air[numAir++] = intervals[i];
+        }
+    }
+
+    return numAir;
+}
+
+/**
+ * Works out what a stored sequence should put on the air: the frame, then the gap and
+ * the repeat code (or the whole frame) for every repeat
+ * @return The number of carrier on and off intervals
+ */
+static uint16_t benchExpand(const SignalInterval* sequence, SignalInterval* air)
+{
+    uint16_t end = 0;
+    uint16_t numAir = 0;
+
+    while ((sequence[end].time_us != 0) && (sequence[end].time_us != FRAME_REPEAT_MARKER))
+    {
+        end++;
+    }
+    numAir = benchAppend(air, numAir, sequence, 0, end);
+
+    if (sequence[end].time_us == FRAME_REPEAT_MARKER)
+    {
+        SignalInterval gap = {sequence[end + 1].time_us, false};
+        uint16_t repeatStart = end + 3;
+        uint16_t repeatEnd = repeatStart;
+        while (sequence[repeatEnd].time_us != 0)
+        {
+            repeatEnd++;
+        }
+        if (repeatEnd == repeatStart)
+        {
+            repeatStart = 0;
+            repeatEnd = end;
+        }
+
+        for (uint32_t i = 0; i < sequence[end + 2].time_us; i++)
+        {
+            numAir = benchAppend(air, numAir, &gap, 0, 1);
+            numAir = benchAppend(air, numAir, sequence, repeatStart, repeatEnd);
+        }
+    }
+
+    return numAir;
+}
+
+/**
+ * Sends a capture of the corpus and compares what the carrier did with what was asked
+ * for: the error of every interval, the drift over the whole sequence and how late the
+ * carrier started after the send call and stopped after the last interval
+ * @param path The corpus file
+ * @param latencies Interrupt latencies in ticks, taken in turn
+ * @param numLatencies The number of latencies
+ * @param overhead Ticks the send spends in the drivers before the carrier starts
+ * @param verbose Print the error of every interval
+ */
+static void benchCapture(const char* path, const uint32_t* latencies, uint16_t numLatencies, uint32_t overhead, bool verbose)
+{
+    static SignalInterval sequence[MAX_SEQUENCE_INDEX];
+    static SignalInterval air[EMITTER_EDGE_TABLE_SIZE];
+    uint16_t carrier = 0;
+    uint16_t length = benchReadCapture(path, sequence, &carrier);
+    uint32_t maxLatency = 0;
+
+    CHECK(length > 1);
+    if (length <= 1)
+    {
+        return;
+    }
+    uint16_t numAir = benchExpand(sequence, air);
+    for (uint16_t i = 0; i < numLatencies; i++)
+    {
+        maxLatency = (latencies[i] > maxLatency) ? latencies[i] : maxLatency;
+    }
+
+    simReset();
+    uint32_t request = simNow;
+    simPrepareTicks = overhead;
+    SignalInterval* button = malloc(length * sizeof(SignalInterval));
+    memcpy(button, sequence, length * sizeof(SignalInterval));
+    IRemitterSendButton(0, button, carrier, 0);
+    simApplyAccesses();
+    simPrepareTicks = 0;
+    simRun(latencies, numLatencies);
+
+    // Every interval starts and ends with a change of the carrier gate
+    CHECK_EQUAL(numAir + 1, numGates[0]);
+    if (numGates[0] < numAir + 1)
+    {
+        return;
+    }
+
+    uint32_t maxError = 0;
+    uint64_t sumError = 0;
+    uint32_t requested = 0;
+    for (uint16_t i = 0; i < numAir; i++)
+    {
+        uint32_t produced = gates[0][i + 1].time - gates[0][i].time;
+        int32_t error = (int32_t)(produced - (air[i].time_us * EMITTER_TICKS_PER_US));
+        uint32_t size = (error < 0) ? -error : error;
+
+        CHECK_EQUAL(air[i].PWM, gates[0][i].on);
+        maxError = (size > maxError) ? size : maxError;
+        sumError += size;
+        requested += air[i].time_us * EMITTER_TICKS_PER_US;
+        if (verbose)
+        {
+            printf("  %c%u: %d ns\n", air[i].PWM ? 'm' : 's', air[i].time_us, error * 1000 / EMITTER_TICKS_PER_US);
+        }
+    }
+    uint32_t drift = (gates[0][numAir].time - gates[0][0].time) - requested;
+    uint32_t startLatency = gates[0][0].time - request;
+
+    // An interval is only off by the difference of the latencies at its two ends, and the
+    // emitter reports what the carrier did
+    EmitterStats stats;
+    IRgetEmitterStats(0, &stats);
+    CHECK(maxError <= maxLatency);
+    CHECK_EQUAL(ticksToNs(startLatency), stats.carrierStartLatency_ns);
+    CHECK_EQUAL(ticksToNs(drift), stats.cumulativeDrift_ns);
+    CHECK(stats.maxIntervalError_ns <= ticksToNs(maxError));
+    CHECK(IRemitterCompleted(0, NULL));
+
+    printf("%s: %u intervals, error max %u ns mean %u ns, drift %u ns, carrier start %u ns stop %u ns\n",
+           path, numAir, ticksToNs(maxError), ticksToNs((uint32_t)(sumError / numAir)), ticksToNs(drift),
+           ticksToNs(startLatency), stats.carrierStopLatency_ns);
+}
+
+int main(int argc, char** argv)
+{
+    hostWatchRegister(SIM_TAMR);
+    hostWatchRegister(SIM_TAILR);
+    hostWatchRegister(SIM_TAV);
+    for (uint8_t ch = 0; ch < EMITTER_CHANNEL_COUNT; ch++)
+    {
+        hostWatchRegister(matchRegister[ch]);
+    }
+
+    IR_Init_Emitter();
+    simApplyAccesses();
+
+    testIntervalsIgnoreInterruptLatency();
+    testLongSequenceDoesNotDrift();
+    testStatsReflectInterruptLatency();
+    testLongStartLatency();
+    testCloseEdgesAreMerged();
+    testPendingStartCutsLongInterval();
+    testRepeatsAreExpanded();
+    testTrailingGapIsSplit();
+    testTimeUntilDone();
+    benchFirstEdge();
+
+    // The corpus files on the command line are sent with an interrupt entry latency that
+    // varies from the one given to twice that, and the driver overhead of the send call
+    static uint32_t latencies[BENCH_LATENCIES];
+    uint32_t isrLatency_ns = 0;
+    uint32_t driverOverhead_ns = 0;
+    bool verbose = false;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        sscanf(argv[i], "--isr-latency-ns=%u", &isrLatency_ns);
+        sscanf(argv[i], "--driver-overhead-ns=%u", &driverOverhead_ns);
+        verbose = verbose || (strcmp(argv[i], "--verbose") == 0);
+    }
+    for (uint16_t i = 0; i < BENCH_LATENCIES; i++)
+    {
+        uint32_t latency = (isrLatency_ns * EMITTER_TICKS_PER_US) / 1000;
+        seed = (seed * 1103515245u) + 12345u;
+        latencies[i] = latency + ((seed >> 16) % (latency + 1));
+    }
+    if (argc > 1)
+    {
+        printf("interrupt latency %u to %u ns, driver overhead %u ns\n", isrLatency_ns, 2 * isrLatency_ns, driverOverhead_ns);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            benchCapture(argv[i], latencies, BENCH_LATENCIES, (driverOverhead_ns * EMITTER_TICKS_PER_US) / 1000, verbose);
+        }
+    }
+
+    return HOST_TEST_END("test_ir_emitter");
+}
@@ -0,0 +1,258 @@
+/**
+ * Replays the noisy capture corpus through the capture interrupt of the receiver and
+ * checks the sequence it learns, its carrier and what the glitch filter rejected. Every
+ * capture is learned with the glitch filter off as well, and both decode rates are reported.
+ * The corpus files are described in corpus/generate.py.
+ * @file test_ir_receiver.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include <ti/drivers/Capture.h>
+#include "IR_Receiver.h"
+
+#define CORPUS_MAX_EDGES 8192
+#define CORPUS_MAX_EXPECT MAX_SEQUENCE_INDEX
+#define CARRIER_TOLERANCE_PCT 2
+#define INTERVAL_TOLERANCE_PCT 3
+#define INTERVAL_MIN_TOLERANCE_US 20
+
+void IRedgeProgramButton(Capture_Handle handle, uint32_t interval);
+
+typedef struct
+{
+    uint32_t glitchFilter_us;
+    uint32_t carrier;
+    GlitchCounters rejected;
+    char expect[CORPUS_MAX_EXPECT][16];
+    uint16_t numExpect;
+    uint32_t edges[CORPUS_MAX_EDGES];
+    uint16_t numEdges;
+} CorpusCapture;
+
+static CorpusCapture capture;
+
+/**
+ * Reads a corpus file
+ * @param path The file to read
+ * @return true if the file was read
+ */
+static bool readCapture(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char word[32];
+    bool inEdges = false;
+
+    if (file == NULL)
+    {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+
+    memset(&capture, 0, sizeof(capture));
+    capture.glitchFilter_us = GLITCH_MIN_PULSE_US;
+
+    while (fscanf(file, "%31s", word) == 1)
+    {
+        if (word[0] == '#')
+        {
+            fscanf(file, "%*[^\n]");
+        }
+        else if (inEdges)
+        {
+            if (capture.numEdges < CORPUS_MAX_EDGES)
+            {
+                capture.edges[capture.numEdges++] = strtoul(word, NULL, 10);
+            }
+        }
+        else if (strcmp(word, "filter") == 0)
+        {
+            fscanf(file, "%u", &capture.glitchFilter_us);
+        }
+        else if (strcmp(word, "carrier") == 0)
+        {
+            fscanf(file, "%u", &capture.carrier);
+        }
+        else if (strcmp(word, "rejected") == 0)
+        {
+            fscanf(file, "%u %u %u", &capture.rejected.rejectedMarks, &capture.rejected.rejectedSpaces,
+                   &capture.rejected.rejectedEdges);
+        }
+        else if (strcmp(word, "expect") == 0)
+        {
+            while ((capture.numExpect < CORPUS_MAX_EXPECT) && (fscanf(file, " %15[^ \n]", capture.expect[capture.numExpect]) == 1))
+            {
+                capture.numExpect++;
+                if (fgetc(file) == '\n')
+                {
+                    break;
+                }
+            }
+        }
+        else if (strcmp(word, "edges") == 0)
+        {
+            inEdges = true;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * Checks a learned interval against the corpus: m<us> mark, s<us> space, g<us> frame gap,
+ * n<count> an exact count and x the repeat marker
+ */
+static bool intervalMatches(const char* expect, const SignalInterval* learned)
+{
+    uint32_t value = strtoul(&expect[1], NULL, 10);
+    uint32_t tolerance = (value * INTERVAL_TOLERANCE_PCT) / 100;
+    uint32_t difference = (learned->time_us > value) ? (learned->time_us - value) : (value - learned->time_us);
+
+    if (tolerance < INTERVAL_MIN_TOLERANCE_US)
+    {
+        tolerance = INTERVAL_MIN_TOLERANCE_US;
+    }
+
+    switch (expect[0])
+    {
+    case 'm':
+        return learned->PWM && (difference <= tolerance);
+    case 's':
+    case 'g':
+        return !learned->PWM && (difference <= tolerance);
+    case 'n':
+        return learned->time_us == value;
+    case 'x':
+        return learned->time_us == FRAME_REPEAT_MARKER;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Learns the capture that was read, the way the learn command does
+ * @param glitchFilter_us The glitch filter to learn with, 0 turns it off
+ * @param path The corpus file, for the report
+ * @param report true to print every interval that does not match
+ * @return true if the learned sequence and carrier match the corpus
+ */
+static bool learnCapture(uint32_t glitchFilter_us, const char* path, bool report)
+{
+    bool RetVal = true;
+
+    IRsetGlitchFilter(glitchFilter_us);
+    IRreceiverSetMode(program);
+
+    for (uint16_t i = 0; i < capture.numEdges; i++)
+    {
+        IRedgeProgramButton(NULL, capture.edges[i]);
+    }
+    IRreceiverSetMode(passthru);
+
+    uint16_t sequenceSize = 0;
+    SignalInterval* sequence = IRbuttonReady() ? getIRsequence(&sequenceSize) : NULL;
+    uint16_t length = sequenceSize / sizeof(SignalInterval);
+    uint16_t carrier = getIRcarrierFrequency();
+
+    // The sequence ends with a zero time that is not in the corpus
+    if ((sequence == NULL) || (length != capture.numExpect + 1) || (sequence[length - 1].time_us != 0))
+    {
+        if (report)
+        {
+            printf("%s: learned %u intervals, expected %u\n", path, length, capture.numExpect + 1);
+        }
+        RetVal = false;
+    }
+    for (uint16_t i = 0; RetVal && (i < capture.numExpect); i++)
+    {
+        if (!intervalMatches(capture.expect[i], &sequence[i]))
+        {
+            if (report)
+            {
+                printf("%s: interval %u is %s%u, expected %s\n", path, i, sequence[i].PWM ? "m" : "s",
+                       sequence[i].time_us, capture.expect[i]);
+            }
+            RetVal = false;
+        }
+    }
+
+    if (abs((int)carrier - (int)capture.carrier) > (int)((capture.carrier * CARRIER_TOLERANCE_PCT) / 100))
+    {
+        if (report)
+        {
+            printf("%s: carrier is %u, expected %u\n", path, carrier, capture.carrier);
+        }
+        RetVal = false;
+    }
+
+    return RetVal;
+}
+
+/**
+ * Learns one corpus capture with the glitch filter of the corpus, which has to decode it
+ * and reject what the corpus lists, and once more with the filter off. Without the filter,
+ * a capture only decodes if it holds no pulse the filter would have rejected.
+ * @param path The corpus file
+ * @param decoded Counts the captures decoded with and without the filter
+ */
+static void replayCapture(const char* path, uint16_t decoded[2])
+{
+    int failuresBefore = hostTestFailures;
+
+    if (!readCapture(path))
+    {
+        hostTestFailures++;
+        return;
+    }
+
+    bool filtered = learnCapture(capture.glitchFilter_us, path, true);
+    CHECK(filtered);
+
+    GlitchCounters glitches;
+    IRgetGlitchCounters(&glitches);
+    CHECK_EQUAL(capture.rejected.rejectedMarks, glitches.rejectedMarks);
+    CHECK_EQUAL(capture.rejected.rejectedSpaces, glitches.rejectedSpaces);
+    CHECK_EQUAL(capture.rejected.rejectedEdges, glitches.rejectedEdges);
+
+    // Only the edges within a carrier period are still dropped with the filter off
+    bool unfiltered = learnCapture(0, path, false);
+    CHECK_EQUAL((capture.rejected.rejectedMarks + capture.rejected.rejectedSpaces) == 0, unfiltered);
+
+    decoded[0] += filtered ? 1 : 0;
+    decoded[1] += unfiltered ? 1 : 0;
+    printf("%-32s filter %3uus %-8s filter off %s\n", path, capture.glitchFilter_us,
+           filtered ? "decoded" : "FAILED", unfiltered ? "decoded" : "failed");
+
+    if (hostTestFailures != failuresBefore)
+    {
+        printf("%s: replay failed\n", path);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    IR_Init_Receiver();
+
+    // The filter cannot be widened past the shortest real pulses
+    CHECK(IRsetGlitchFilter(GLITCH_MAX_PULSE_US));
+    CHECK(!IRsetGlitchFilter(GLITCH_MAX_PULSE_US + 1));
+
+    uint16_t decoded[2] = {0, 0};
+    for (int i = 1; i < argc; i++)
+    {
+        replayCapture(argv[i], decoded);
+    }
+    printf("decoded with the glitch filter %u of %d, without it %u of %d\n", decoded[0], argc - 1, decoded[1], argc - 1);
+    CHECK_EQUAL(argc - 1, decoded[0]);
+
+    // Learning again starts the glitch counters over
+    IRreceiverSetMode(program);
+    GlitchCounters glitches;
+    IRgetGlitchCounters(&glitches);
+    CHECK_EQUAL(0, glitches.rejectedMarks + glitches.rejectedSpaces + glitches.rejectedEdges);
+    IRreceiverSetMode(passthru);
+
+    return HOST_TEST_END("test_ir_receiver");
+}
@@ -0,0 +1,248 @@
+/**
+ * Registers the command socket with a local stand-in of the mDNS responder of the NWP,
+ * and browses for it the way a client does: every _ncir._udp service, its port and the
+ * fields of its text record.
+ * @file test_mdns_service.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ti/drivers/net/wifi/simplelink.h>
+#include "host_test.h"
+#include "Mdns_Service.h"
+
+#define SIM_MAX_RECORDS 8
+#define SIM_NAME_SIZE 128
+#define SIM_TEXT_SIZE 256
+#define SIM_PORT 44444
+
+typedef struct
+{
+    char name[SIM_NAME_SIZE];
+    char text[SIM_TEXT_SIZE];
+    uint16_t port;
+    uint32_t ttl;
+    uint32_t options;
+} SimRecord;
+
+// The responder: records are kept until they are unregistered or the NWP restarts
+static SimRecord records[SIM_MAX_RECORDS];
+static uint8_t numRecords = 0;
+static bool responderRunning = false;
+static char deviceName[DEVICE_NAME_LENGTH];
+
+_i16 sl_WlanGet(const _u16 ConfigId, _u16* pConfigOpt, _u16* pConfigLen, _u8* pValues)
+{
+    _i16 RetVal = -1;
+
+    if ((ConfigId == SL_WLAN_CFG_P2P_PARAM_ID) && (*pConfigOpt == SL_WLAN_P2P_OPT_DEV_NAME))
+    {
+        uint16_t length = strlen(deviceName) + 1;
+        length = (length > *pConfigLen) ? *pConfigLen : length;
+        memcpy(pValues, deviceName, length);
+        *pConfigLen = length;
+        RetVal = 0;
+    }
+
+    return RetVal;
+}
+
+_i16 sl_NetAppStart(const _u32 AppBitMap)
+{
+    if (AppBitMap & SL_NETAPP_MDNS_ID)
+    {
+        responderRunning = true;
+    }
+    return 0;
+}
+
+static SimRecord* findRecord(const _i8* name, _u8 nameLength)
+{
+    SimRecord* RetVal = NULL;
+
+    for (uint8_t i = 0; i < numRecords; i++)
+    {
+        if ((strlen(records[i].name) == nameLength) && (memcmp(records[i].name, name, nameLength) == 0))
+        {
+            RetVal = &records[i];
+        }
+    }
+
+    return RetVal;
+}
+
+_i16 sl_NetAppMDNSRegisterService(const _i8* pServiceName, const _u8 ServiceNameLen, const _i8* pText,
+                                  const _u8 TextLen, const _u16 Port, const _u32 TTL, _u32 Options)
+{
+    _i16 RetVal = 0;
+
+    if (!responderRunning || (numRecords == SIM_MAX_RECORDS))
+    {
+        RetVal = -1;
+    }
+    else if ((Options & SL_NETAPP_MDNS_OPTIONS_IS_UNIQUE_BIT) && (findRecord(pServiceName, ServiceNameLen) != NULL))
+    {
+        RetVal = SL_ERROR_NET_APP_MDNS_EXIST_UNIQUE_REGISTERED_SERVICE_ERROR;
+    }
+    else
+    {
+        SimRecord* record = &records[numRecords++];
+        memset(record, 0, sizeof(SimRecord));
+        memcpy(record->name, pServiceName, ServiceNameLen);
+        memcpy(record->text, pText, TextLen);
+        record->port = Port;
+        record->ttl = TTL;
+        record->options = Options;
+    }
+
+    return RetVal;
+}
+
+_i16 sl_NetAppMDNSUnRegisterService(const _i8* pServiceName, const _u8 ServiceNameLen, _u32 Options)
+{
+    _i16 RetVal = -1;
+    SimRecord* record = findRecord(pServiceName, ServiceNameLen);
+
+    if (record != NULL)
+    {
+        *record = records[--numRecords];
+        RetVal = 0;
+    }
+
+    return RetVal;
+}
+
+/**
+ * The NWP restarted, e.g. after a reconnect, and lost every record that is not persistent
+ */
+static void simRestartResponder()
+{
+    numRecords = 0;
+    responderRunning = false;
+}
+
+/**
+ * Browses for the services of a type, the way a client does
+ * @return The number of services found, the first one is put in found
+ */
+static uint8_t simBrowse(const char* type, SimRecord* found)
+{
+    uint8_t RetVal = 0;
+
+    for (uint8_t i = 0; i < numRecords; i++)
+    {
+        size_t nameLength = strlen(records[i].name);
+        if ((nameLength > strlen(type)) && (strcmp(&records[i].name[nameLength - strlen(type)], type) == 0))
+        {
+            if (RetVal == 0)
+            {
+                *found = records[i];
+            }
+            RetVal++;
+        }
+    }
+
+    return RetVal;
+}
+
+/**
+ * Gets the value of a key of a text record, key=value pairs split by ';'
+ * @return The value, empty if the key is not in the text
+ */
+static const char* simTextValue(const char* text, const char* key)
+{
+    static char value[SIM_TEXT_SIZE];
+    const char* field = text;
+
+    value[0] = '\0';
+    while (field != NULL)
+    {
+        const char* end = strchr(field, ';');
+        size_t length = (end != NULL) ? (size_t)(end - field) : strlen(field);
+
+        if ((length > strlen(key)) && (strncmp(field, key, strlen(key)) == 0) && (field[strlen(key)] == '='))
+        {
+            length -= strlen(key) + 1;
+            memcpy(value, &field[strlen(key) + 1], length);
+            value[length] = '\0';
+            break;
+        }
+        field = (end != NULL) ? (end + 1) : NULL;
+    }
+
+    return value;
+}
+
+/**
+ * The service is found by its type, under the device name, with the port of the command
+ * socket and every field of the text record
+ */
+static void testServiceIsFound()
+{
+    SimRecord found;
+    strcpy(deviceName, "Living Room");
+
+    CHECK_EQUAL(0, mdnsAdvertiseService(SIM_PORT, 3, 0x1234abcd));
+
+    CHECK_EQUAL(1, simBrowse("._ncir._udp.local", &found));
+    CHECK(strcmp(found.name, "Living Room._ncir._udp.local") == 0);
+    CHECK_EQUAL(SIM_PORT, found.port);
+    CHECK_EQUAL(MDNS_SERVICE_TTL, found.ttl);
+    CHECK(found.options & SL_NETAPP_MDNS_OPTIONS_IS_UNIQUE_BIT);
+    CHECK(found.options & SL_NETAPP_MDNS_OPTIONS_IS_NOT_PERSISTENT);
+
+    CHECK(strcmp(simTextValue(found.text, "name"), "Living Room") == 0);
+    CHECK(strcmp(simTextValue(found.text, "fw"), FIRMWARE_VERSION) == 0);
+    CHECK(strcmp(simTextValue(found.text, "buttons"), "3") == 0);
+    CHECK(strcmp(simTextValue(found.text, "gen"), "1234abcd") == 0);
+}
+
+/**
+ * Advertising again replaces the record, the unique name is not registered twice,
+ * and a renamed device is no longer found under its old name
+ */
+static void testChangesReplaceTheRecord()
+{
+    SimRecord found;
+
+    CHECK_EQUAL(0, mdnsAdvertiseService(SIM_PORT, 4, 0x0000000f));
+    CHECK_EQUAL(1, simBrowse("._ncir._udp.local", &found));
+    CHECK(strcmp(simTextValue(found.text, "buttons"), "4") == 0);
+    CHECK(strcmp(simTextValue(found.text, "gen"), "0000000f") == 0);
+
+    strcpy(deviceName, "Bedroom");
+    CHECK_EQUAL(0, mdnsAdvertiseService(SIM_PORT, 4, 0x0000000f));
+    CHECK_EQUAL(1, simBrowse("._ncir._udp.local", &found));
+    CHECK(strcmp(found.name, "Bedroom._ncir._udp.local") == 0);
+    CHECK(strcmp(simTextValue(found.text, "name"), "Bedroom") == 0);
+}
+
+/**
+ * The record is registered again after the NWP restarted, and the longest device name
+ * and largest values fit the name and text without being cut off
+ */
+static void testRestartAndLongestValues()
+{
+    SimRecord found;
+
+    simRestartResponder();
+    memset(deviceName, 'n', DEVICE_NAME_LENGTH - 1);
+    deviceName[DEVICE_NAME_LENGTH - 1] = '\0';
+
+    CHECK_EQUAL(0, mdnsAdvertiseService(SIM_PORT, 65535, 0xffffffff));
+    CHECK_EQUAL(1, simBrowse("._ncir._udp.local", &found));
+    CHECK_EQUAL(DEVICE_NAME_LENGTH - 1 + strlen(MDNS_SERVICE_TYPE), strlen(found.name));
+    CHECK(strcmp(simTextValue(found.text, "name"), deviceName) == 0);
+    CHECK(strcmp(simTextValue(found.text, "buttons"), "65535") == 0);
+    CHECK(strcmp(simTextValue(found.text, "gen"), "ffffffff") == 0);
+}
+
+int main(int argc, char** argv)
+{
+    testServiceIsFound();
+    testChangesReplaceTheRecord();
+    testRestartAndLongestValues();
+
+    return HOST_TEST_END("test_mdns_service");
+}
@@ -0,0 +1,135 @@
+/**
+ * Runs the reply cache through the retries a client sends when a reply gets lost: before
+ * the command replied, after it replied once, more than once or not at all, and once its
+ * sequence number has dropped out of the cache.
+ * @file test_reply_cache.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "host_test.h"
+#include "Reply_Cache.h"
+
+static ReplyAddr simClient(uint16_t port, uint32_t seq)
+{
+    ReplyAddr RetVal;
+
+    memset(&RetVal, 0, sizeof(RetVal));
+    RetVal.addr.sin_addr.s_addr = 0x0a000002;
+    RetVal.addr.sin_port = port;
+    RetVal.seq = seq;
+    RetVal.hasSeq = true;
+
+    return RetVal;
+}
+
+/**
+ * Sends a retry of a command
+ * @return The result, and the reply it is answered with in reply
+ */
+static ReplyCacheResult simRetry(const ReplyAddr* client, char* reply)
+{
+    const char* cached = NULL;
+    uint16_t length = 0;
+    ReplyCacheResult RetVal = replyCacheCheck(client, &cached, &length);
+
+    reply[0] = '\0';
+    if (RetVal == reply_cache_hit)
+    {
+        memcpy(reply, cached, length);
+        reply[length] = '\0';
+    }
+
+    return RetVal;
+}
+
+static void simStore(const ReplyAddr* client, const char* reply)
+{
+    replyCacheStore(client, reply, strlen(reply));
+}
+
+/**
+ * A retry is ignored until the command replied, then answered with the reply, and a
+ * command that ran without replying answers with command_done
+ */
+static void testRetriesOfOneReply()
+{
+    char reply[REPLY_CACHE_REPLY_SIZE + 1];
+    ReplyAddr client = simClient(5000, 1);
+
+    CHECK_EQUAL(reply_cache_miss, simRetry(&client, reply));
+    CHECK_EQUAL(reply_cache_pending, simRetry(&client, reply));
+
+    simStore(&client, "#1,\r\ntime_set,1700000000\r\n");
+    replyCacheComplete(&client);
+    CHECK_EQUAL(reply_cache_hit, simRetry(&client, reply));
+    CHECK(strcmp(reply, "#1,\r\ntime_set,1700000000\r\n") == 0);
+
+    // clear_all replies nothing
+    client.seq = 2;
+    CHECK_EQUAL(reply_cache_miss, simRetry(&client, reply));
+    replyCacheComplete(&client);
+    CHECK_EQUAL(reply_cache_hit, simRetry(&client, reply));
+    CHECK(strcmp(reply, "#2,\r\n" REPLY_COMMAND_DONE "\r\n") == 0);
+}
+
+/**
+ * A command that replied more than once, or too long for the cache, is never run again,
+ * its retries are told the reply is not cached
+ */
+static void testRepliesThatDoNotFit()
+{
+    char reply[REPLY_CACHE_REPLY_SIZE + 1];
+    char longReply[REPLY_CACHE_REPLY_SIZE + 2];
+    ReplyAddr client = simClient(5001, 10);
+
+    // A macro reports every step, the retry would only get the last one
+    CHECK_EQUAL(reply_cache_miss, simRetry(&client, reply));
+    simStore(&client, "#10,\r\nmacro_started,Movie,2,2\r\n");
+    simStore(&client, "#10,\r\nmacro_progress,Movie,1,2\r\n");
+    simStore(&client, "#10,\r\nmacro_done,Movie,2,250\r\n");
+    CHECK_EQUAL(reply_cache_hit, simRetry(&client, reply));
+    CHECK(strcmp(reply, "#10,\r\n" REPLY_NOT_CACHED "\r\n") == 0);
+
+    client.seq = 11;
+    memset(longReply, 'x', sizeof(longReply) - 1);
+    longReply[sizeof(longReply) - 1] = '\0';
+    CHECK_EQUAL(reply_cache_miss, simRetry(&client, reply));
+    simStore(&client, longReply);
+    replyCacheComplete(&client);
+    CHECK_EQUAL(reply_cache_hit, simRetry(&client, reply));
+    CHECK(strcmp(reply, "#11,\r\n" REPLY_NOT_CACHED "\r\n") == 0);
+}
+
+/**
+ * Every client keeps its own last REPLY_CACHE_DEPTH sequence numbers
+ */
+static void testClientsAndDepth()
+{
+    char reply[REPLY_CACHE_REPLY_SIZE + 1];
+    ReplyAddr first = simClient(5002, 100);
+    ReplyAddr second = simClient(5003, 100);
+
+    CHECK_EQUAL(reply_cache_miss, simRetry(&first, reply));
+    CHECK_EQUAL(reply_cache_miss, simRetry(&second, reply));
+    simStore(&second, "#100,\r\npong,,always_on\r\n");
+    CHECK_EQUAL(reply_cache_pending, simRetry(&first, reply));
+
+    for (uint32_t seq = 101; seq < 101 + REPLY_CACHE_DEPTH; seq++)
+    {
+        first.seq = seq;
+        CHECK_EQUAL(reply_cache_miss, simRetry(&first, reply));
+    }
+    first.seq = 100;
+    CHECK_EQUAL(reply_cache_miss, simRetry(&first, reply));
+    CHECK_EQUAL(reply_cache_hit, simRetry(&second, reply));
+}
+
+int main(int argc, char** argv)
+{
+    testRetriesOfOneReply();
+    testRepliesThatDoNotFit();
+    testClientsAndDepth();
+
+    return HOST_TEST_END("test_reply_cache");
+}
@@ -0,0 +1,375 @@
+/**
+ * Runs the threaded build of the task queue (TASK_THREADS) on the POSIX threads of the
+ * host: one thread per priority, the way the FreeRTOS build runs them. The cycle counter
+ * is the monotonic clock, so the queueing latency probes measure real waits under load.
+ * @file test_task_queue.c
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ti/drivers/dpl/HwiP.h>
+#include "host_test.h"
+#include "Profiler.h"
+#include "Task_Queue.h"
+
+#define SIM_LOG_SIZE 64
+#define SIM_SLOW_TASK_MS 200 // a flash write of the button table takes about this long
+#define SIM_LOAD_RUNS 100
+
+static pthread_mutex_t interruptMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t threads[TASK_PRIORITY_COUNT];
+static volatile bool stopping[TASK_PRIORITY_COUNT];
+static ProbeStats waits[PROFILER_PROBE_COUNT];
+
+// What the tasks did, they only ever run one at a time so none of this needs a lock
+static Task* runLog[SIM_LOG_SIZE];
+static uint16_t numRuns = 0;
+static int running = 0;
+static int maxRunning = 0;
+static volatile uint32_t slowRuns = 0;
+static volatile uint32_t commandRuns = 0;
+static volatile uint32_t commandsDuringSlow = 0;
+static volatile bool slowRunning = false;
+static volatile uint32_t loadRuns = 0;
+static volatile uint32_t sendsDuringSlow = 0;
+
+static Task tasks[4];
+static Task stopTasks[TASK_PRIORITY_COUNT];
+
+/**
+ * The cycle counter at the 80 MHz of the CPU, from the monotonic clock
+ */
+uint32_t hostCycles(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec) * PROFILER_CYCLES_PER_US / 1000);
+}
+
+// Interrupts are masked by one lock, the threads and the simulated interrupts all take it
+uintptr_t HwiP_disable(void)
+{
+    pthread_mutex_lock(&interruptMutex);
+    return 0;
+}
+
+void HwiP_restore(uintptr_t key)
+{
+    (void)key;
+    pthread_mutex_unlock(&interruptMutex);
+}
+
+void profilerRecord(ProfileProbe probe, uint32_t startCycles)
+{
+    uint32_t cycles = hostCycles() - startCycles;
+
+    pthread_mutex_lock(&statsMutex);
+    waits[probe].count++;
+    waits[probe].totalCycles += cycles;
+    waits[probe].maxCycles = (cycles > waits[probe].maxCycles) ? cycles : waits[probe].maxCycles;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+static void simSleep_ms(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+/**
+ * Notes a task running, and that no other task runs with it
+ */
+static void enterTask(Task* task)
+{
+    running++;
+    maxRunning = (running > maxRunning) ? running : maxRunning;
+    if (numRuns < SIM_LOG_SIZE)
+    {
+        runLog[numRuns++] = task;
+    }
+}
+
+static void logTaskFxn(Task* task)
+{
+    enterTask(task);
+    running--;
+}
+
+static void repostTaskFxn(Task* task)
+{
+    enterTask(task);
+    // Posted again while it runs, so it runs once more
+    if (numRuns == 1)
+    {
+        taskPost(task);
+    }
+    running--;
+}
+
+static void slowTaskFxn(Task* task)
+{
+    enterTask(task);
+    slowRunning = true;
+    simSleep_ms(SIM_SLOW_TASK_MS);
+    slowRunning = false;
+    slowRuns++;
+    running--;
+}
+
+static void sendTaskFxn(Task* task)
+{
+    enterTask(task);
+    if (slowRunning)
+    {
+        sendsDuringSlow++;
+    }
+    running--;
+}
+
+static void commandTaskFxn(Task* task)
+{
+    enterTask(task);
+    if (slowRunning)
+    {
+        commandsDuringSlow++;
+    }
+    commandRuns++;
+    running--;
+}
+
+static void loadTaskFxn(Task* task)
+{
+    enterTask(task);
+    // Busy for 2 ms, like a report being built
+    uint32_t start = hostCycles();
+    while ((hostCycles() - start) < (2000 * PROFILER_CYCLES_PER_US))
+    {
+    }
+    loadRuns++;
+    if (loadRuns < SIM_LOAD_RUNS)
+    {
+        taskPost(task);
+    }
+    running--;
+}
+
+static void stopTaskFxn(Task* task)
+{
+    stopping[task->priority] = true;
+}
+
+static void* simTaskThread(void* arg0)
+{
+    TaskPriority priority = (TaskPriority)(uintptr_t)arg0;
+
+    while (!stopping[priority])
+    {
+        taskWaitAndRun(priority);
+    }
+
+    return NULL;
+}
+
+/**
+ * Waits up to a second for the tasks to finish what is posted
+ */
+static void waitIdle()
+{
+    for (uint16_t i = 0; (i < 1000) && taskPending(); i++)
+    {
+        simSleep_ms(1);
+    }
+    // The last task taken may still be running
+    taskLock();
+    taskUnlock();
+}
+
+static void resetLog()
+{
+    memset(runLog, 0, sizeof(runLog));
+    numRuns = 0;
+    maxRunning = 0;
+}
+
+/**
+ * Tasks of one priority run in the order they were posted, and a task posted again
+ * before it ran only runs once
+ */
+static void testTasksRunOnceInOrder()
+{
+    resetLog();
+    taskCreate(&tasks[0], logTaskFxn, task_priority_normal);
+    taskCreate(&tasks[1], logTaskFxn, task_priority_normal);
+    taskCreate(&tasks[2], logTaskFxn, task_priority_normal);
+
+    // Hold the tasks off until everything is posted
+    taskLock();
+    taskPost(&tasks[0]);
+    taskPost(&tasks[1]);
+    taskPost(&tasks[0]);
+    taskPost(&tasks[2]);
+    CHECK(taskPending());
+    taskUnlock();
+    waitIdle();
+
+    CHECK(!taskPending());
+    CHECK_EQUAL(3, numRuns);
+    CHECK(runLog[0] == &tasks[0]);
+    CHECK(runLog[1] == &tasks[1]);
+    CHECK(runLog[2] == &tasks[2]);
+    CHECK_EQUAL(1, maxRunning);
+
+    // The posted flag is cleared before a task runs, so it can post itself again
+    resetLog();
+    taskCreate(&tasks[3], repostTaskFxn, task_priority_high);
+    taskPost(&tasks[3]);
+    waitIdle();
+    CHECK_EQUAL(2, numRuns);
+}
+
+/**
+ * While a slow storage task runs, datagrams keep being taken from the socket by the
+ * receive thread, which is not a task. Their command tasks wait for the slow task to
+ * finish, as the tasks share the state of the main loop, and then all of them are run.
+ */
+static void testReceptionDuringSlowTask()
+{
+    uint32_t receivedDuringSlow = 0;
+
+    resetLog();
+    taskCreate(&tasks[0], slowTaskFxn, task_priority_low);
+    taskCreate(&tasks[1], commandTaskFxn, task_priority_normal);
+    commandRuns = 0;
+
+    taskPost(&tasks[0]);
+    while ((slowRuns == 0) && !slowRunning)
+    {
+        simSleep_ms(1);
+    }
+
+    // The receive thread posts the command task for every datagram it queues
+    while (slowRunning)
+    {
+        receivedDuringSlow++;
+        taskPost(&tasks[1]);
+        simSleep_ms(1);
+    }
+    waitIdle();
+
+    CHECK_EQUAL(1, slowRuns);
+    CHECK(receivedDuringSlow >= (SIM_SLOW_TASK_MS / 4));
+    CHECK_EQUAL(0, commandsDuringSlow);
+    // The posts made while the slow task ran are run once it is done, no post is lost
+    CHECK(commandRuns >= 1);
+    CHECK_EQUAL(1, maxRunning);
+}
+
+/**
+ * A send posted during a slow storage task does not preempt it, it waits for the task to
+ * finish, and then goes before a command that was posted ahead of it
+ */
+static void testSendWaitsForRunningTask()
+{
+    resetLog();
+    memset(waits, 0, sizeof(waits));
+    taskCreate(&tasks[0], slowTaskFxn, task_priority_low);
+    taskCreate(&tasks[1], commandTaskFxn, task_priority_normal);
+    taskCreate(&tasks[2], sendTaskFxn, task_priority_high);
+    sendsDuringSlow = 0;
+    commandsDuringSlow = 0;
+
+    taskPost(&tasks[0]);
+    while (!slowRunning)
+    {
+        simSleep_ms(1);
+    }
+    taskPost(&tasks[1]);
+    simSleep_ms(SIM_SLOW_TASK_MS / 4);
+    taskPost(&tasks[2]);
+    waitIdle();
+
+    CHECK_EQUAL(3, numRuns);
+    CHECK(runLog[0] == &tasks[0]);
+    CHECK(runLog[1] == &tasks[2]);
+    CHECK(runLog[2] == &tasks[1]);
+    CHECK_EQUAL(0, sendsDuringSlow);
+    CHECK_EQUAL(0, commandsDuringSlow);
+    CHECK_EQUAL(1, maxRunning);
+
+    // The send waited for what was left of the storage task, not for the command
+    uint32_t wait_us = waits[probe_task_wait_high].maxCycles / PROFILER_CYCLES_PER_US;
+    CHECK(wait_us <= (SIM_SLOW_TASK_MS * 1000));
+    printf("send posted during a %u ms storage task waited %u us\n", SIM_SLOW_TASK_MS, wait_us);
+}
+
+/**
+ * Measures the queueing latency of each priority while the storage thread is kept busy,
+ * with sends posted every millisecond and commands every three, as from interrupts
+ */
+static void testQueueingLatencyUnderLoad()
+{
+    uint32_t highPosts = 0;
+
+    resetLog();
+    memset(waits, 0, sizeof(waits));
+    taskCreate(&tasks[0], loadTaskFxn, task_priority_low);
+    taskCreate(&tasks[1], logTaskFxn, task_priority_high);
+    taskCreate(&tasks[2], commandTaskFxn, task_priority_normal);
+    loadRuns = 0;
+
+    taskPost(&tasks[0]);
+    for (uint32_t ms = 0; loadRuns < SIM_LOAD_RUNS; ms++)
+    {
+        taskPost(&tasks[1]);
+        highPosts++;
+        if ((ms % 3) == 0)
+        {
+            taskPost(&tasks[2]);
+        }
+        simSleep_ms(1);
+    }
+    waitIdle();
+
+    CHECK_EQUAL(SIM_LOAD_RUNS, loadRuns);
+    CHECK_EQUAL(1, maxRunning);
+    CHECK(waits[probe_task_wait_high].count > 0);
+    CHECK(waits[probe_task_wait_high].count <= highPosts);
+
+    for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+        ProbeStats* stats = &waits[probe_task_wait_high + priority];
+        if (stats->count > 0)
+        {
+            printf("priority %u: %u runs, wait avg %llu us max %u us\n", priority, stats->count,
+                   (unsigned long long)(stats->totalCycles / stats->count / PROFILER_CYCLES_PER_US),
+                   stats->maxCycles / PROFILER_CYCLES_PER_US);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    taskQueue_init();
+
+    for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+        pthread_create(&threads[priority], NULL, simTaskThread, (void*)(uintptr_t)priority);
+    }
+
+    testTasksRunOnceInOrder();
+    testReceptionDuringSlowTask();
+    testSendWaitsForRunningTask();
+    testQueueingLatencyUnderLoad();
+
+    for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+        taskCreate(&stopTasks[priority], stopTaskFxn, (TaskPriority)priority);
+        taskPost(&stopTasks[priority]);
+        pthread_join(threads[priority], NULL);
+    }
+
+    return HOST_TEST_END("test_task_queue");
+}
@@ -0,0 +1,259 @@
+/**
+ * Runs the timer wheel tick by tick against a list of the times every timer has to
+ * fire at. The timers are spread over all levels of the wheel, so they are cascaded
+ * down before they fire, and are started, stopped and restarted while the wheel runs.
+ * @file test_timer_wheel.c
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ti/drivers/Timer.h>
+#include "host_test.h"
+#include "Timer_Wheel.h"
+
+#define SIM_TIMERS 256
+#define SIM_NEVER 0 // expected firing time of a timer that must not fire
+
+typedef struct
+{
+    WheelTimer timer;   // must stay first, the callback gets a pointer to it
+    uint64_t expected;  // uptime the callback has to see when the timer fires next
+    uint32_t fired;
+    uint32_t restartTimeout; // a callback with this set restarts its one-shot timer
+} SimTimer;
+
+static Timer_CallBackFxn tickCallback = NULL;
+static SimTimer timers[SIM_TIMERS];
+static uint32_t lateOrEarly = 0;
+static uint32_t seed = 1;
+
+Timer_Handle Timer_open(uint_least8_t index, Timer_Params* params)
+{
+    tickCallback = params->timerCallback;
+    return (Timer_Handle)(uintptr_t)(index + 1);
+}
+
+/**
+ * A small fixed generator, so every run checks the same timers
+ */
+static uint32_t simRandom(uint32_t range)
+{
+    seed = (seed * 1103515245) + 12345;
+    return ((seed >> 8) % range);
+}
+
+/**
+ * Checks a timer fires when it should, the uptime has already moved past the tick it is due on
+ */
+static void simCallback(WheelTimer* wheelTimer)
+{
+    SimTimer* sim = (SimTimer*)wheelTimer;
+    uint64_t now = timerWheelGetUptime();
+
+    if ((sim->expected == SIM_NEVER) || (now != sim->expected))
+    {
+        if (lateOrEarly < 10)
+        {
+            printf("timer %d fired at %llu, expected %llu\n", (int)(sim - timers),
+                   (unsigned long long)now, (unsigned long long)sim->expected);
+        }
+        lateOrEarly++;
+    }
+    sim->fired++;
+    sim->expected = (wheelTimer->period > 0) ? (sim->expected + wheelTimer->period) : SIM_NEVER;
+
+    if (sim->restartTimeout > 0)
+    {
+        sim->restartTimeout--;
+        timerWheelStart(wheelTimer, simCallback, sim->restartTimeout, 0);
+        sim->expected = now + sim->restartTimeout + 1;
+    }
+}
+
+/**
+ * Starts a timer and works out when it fires: on the tick its timeout ends on, so the
+ * uptime is one past that in the callback
+ */
+static void simStart(SimTimer* sim, uint32_t timeout_ms, uint32_t period_ms)
+{
+    uint32_t clamped = (timeout_ms > TIMER_WHEEL_MAX_MS) ? TIMER_WHEEL_MAX_MS : timeout_ms;
+
+    timerWheelStart(&sim->timer, simCallback, timeout_ms, period_ms);
+    sim->expected = timerWheelGetUptime() + clamped + 1;
+}
+
+static void simTicks(uint32_t ticks)
+{
+    for (uint32_t i = 0; i < ticks; i++)
+    {
+        tickCallback(NULL);
+    }
+}
+
+/**
+ * One-shot timers on every level fire on their tick, also when they are started
+ * part way into the slots of the levels above
+ */
+static void testOneShotTimersFireOnTime()
+{
+    uint64_t last = 0;
+
+    for (uint16_t i = 0; i < SIM_TIMERS; i++)
+    {
+        // Half of them start later on, so they are inserted with the wheel at some other tick
+        if (i == SIM_TIMERS / 2)
+        {
+            simTicks(4093);
+        }
+
+        // Spread the timeouts over the ranges of all levels
+        uint32_t range = 1UL << (((i % TIMER_WHEEL_LEVELS) + 1) * TIMER_WHEEL_SLOT_BITS);
+        simStart(&timers[i], simRandom(range), 0);
+        last = (timers[i].expected > last) ? timers[i].expected : last;
+    }
+
+    simTicks(last - timerWheelGetUptime() + 1);
+
+    CHECK_EQUAL(0, lateOrEarly);
+    for (uint16_t i = 0; i < SIM_TIMERS; i++)
+    {
+        CHECK_EQUAL(1, timers[i].fired);
+        CHECK(!timerWheelActive(&timers[i].timer));
+    }
+}
+
+/**
+ * Stopped timers do not fire, restarted ones only fire for their new timeout and
+ * periodic ones keep their period without drifting
+ */
+static void testStopRestartAndPeriodic()
+{
+    memset(timers, 0, sizeof(timers));
+    lateOrEarly = 0;
+
+    for (uint16_t i = 0; i < 64; i++)
+    {
+        simStart(&timers[i], 100 + simRandom(200000), 0);
+    }
+    simStart(&timers[64], 250, 700);
+    simStart(&timers[65], 70000, 5000);
+
+    simTicks(50);
+    for (uint16_t i = 0; i < 64; i += 2)
+    {
+        timerWheelStop(&timers[i].timer);
+        timers[i].expected = SIM_NEVER;
+    }
+    for (uint16_t i = 1; i < 64; i += 4)
+    {
+        simStart(&timers[i], simRandom(300000), 0);
+    }
+
+    simTicks(300000);
+    timerWheelStop(&timers[64].timer);
+    timerWheelStop(&timers[65].timer);
+    simTicks(1000);
+
+    CHECK_EQUAL(0, lateOrEarly);
+    for (uint16_t i = 0; i < 64; i++)
+    {
+        CHECK_EQUAL((i % 2) == 0 ? 0 : 1, timers[i].fired);
+    }
+    CHECK_EQUAL(((300000 + 50) - 250 - 1) / 700 + 1, timers[64].fired);
+    CHECK_EQUAL(((300000 + 50) - 70000 - 1) / 5000 + 1, timers[65].fired);
+}
+
+/**
+ * A callback that restarts its timer with no timeout is fired again on the next tick,
+ * not in the same one, and a timeout past the longest one the wheel holds is shortened
+ */
+static void testRestartFromCallbackAndLongest()
+{
+    memset(timers, 0, sizeof(timers));
+    lateOrEarly = 0;
+
+    timers[0].restartTimeout = 3;
+    simStart(&timers[0], 10, 0);
+    simTicks(11);
+    CHECK_EQUAL(1, timers[0].fired);
+    simTicks(1);
+    CHECK_EQUAL(1, timers[0].fired);
+    simTicks(20);
+    CHECK_EQUAL(4, timers[0].fired);
+    CHECK(!timerWheelActive(&timers[0].timer));
+
+    simStart(&timers[1], TIMER_WHEEL_MAX_MS + 100000, 0);
+    simTicks(TIMER_WHEEL_MAX_MS);
+    CHECK_EQUAL(0, timers[1].fired);
+    simTicks(1);
+    CHECK_EQUAL(1, timers[1].fired);
+
+    CHECK_EQUAL(0, lateOrEarly);
+}
+
+/**
+ * The time until the next timer fires is the smallest time left of any running timer,
+ * wherever in the wheel it is, and there is no next timer once all have fired
+ */
+static void testTimeUntilNext()
+{
+    memset(timers, 0, sizeof(timers));
+    lateOrEarly = 0;
+
+    CHECK_EQUAL(UINT32_MAX, timerWheelGetTimeUntilNext());
+
+    for (uint16_t i = 0; i < 32; i++)
+    {
+        uint32_t range = 1UL << (((i % TIMER_WHEEL_LEVELS) + 1) * TIMER_WHEEL_SLOT_BITS);
+        simStart(&timers[i], simRandom(range), 0);
+    }
+    simStart(&timers[32], 0, 0);
+    CHECK_EQUAL(0, timerWheelGetTimeUntilNext());
+
+    uint32_t mismatches = 0;
+    uint32_t running = 33;
+    while (running > 0)
+    {
+        uint64_t now = timerWheelGetUptime();
+        uint32_t expected = UINT32_MAX;
+        running = 0;
+        for (uint16_t i = 0; i < 33; i++)
+        {
+            if (timerWheelActive(&timers[i].timer))
+            {
+                // The callback sees the uptime one past the tick the timer fires on
+                uint32_t wait = (uint32_t)(timers[i].expected - 1 - now);
+                expected = (wait < expected) ? wait : expected;
+                running++;
+            }
+        }
+        if (timerWheelGetTimeUntilNext() != expected)
+        {
+            mismatches++;
+        }
+
+        // Jump straight to the next timer now and then, the way the main loop sleeps
+        simTicks((expected == UINT32_MAX) ? 1 : ((expected % 3 == 0) ? (expected + 1) : 1 + simRandom(97)));
+    }
+
+    CHECK_EQUAL(0, mismatches);
+    CHECK_EQUAL(0, lateOrEarly);
+    CHECK_EQUAL(UINT32_MAX, timerWheelGetTimeUntilNext());
+}
+
+int main(int argc, char** argv)
+{
+    timerWheel_init();
+    CHECK(tickCallback != NULL);
+
+    if (tickCallback != NULL)
+    {
+        testOneShotTimersFireOnTime();
+        testStopRestartAndPeriodic();
+        testRestartFromCallbackAndLongest();
+        testTimeUntilNext();
+    }
+
+    return HOST_TEST_END("test_timer_wheel");
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Decodes the binary trace of the firmware, see inc/Trace.h.
+
+The format strings are not stored on the device. They are read from the
+TRACE calls in src/, by source file and line, so the source has to match
+the firmware the trace came from. Every file that traces names its ID with
+a TRACE_FILE define.
+
+Fetch the trace from a device and decode it:
+    trace_decode.py --host 192.168.1.40
+Decode trace_dump replies that were saved to files:
+    trace_decode.py dump1.bin dump2.bin
+"""
+
+import argparse
+import glob
+import os
+import re
+import socket
+import struct
+import sys
+
+PORT = 44444
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+REPLY_HEADER = re.compile(rb"\r\ntrace_dump,(\d+),(\d+)\r\n")
+TRACE_CALL = re.compile(r'TRACE(\d)\(\s*(trace_module_\w+)\s*,\s*(TRACE_LEVEL_\w+)\s*,\s*"((?:[^"\\]|\\.)*)"')
+TRACE_FILE = re.compile(r"^\s*#define\s+TRACE_FILE\s+(trace_file_\w+)", re.MULTILINE)
+C_FORMAT = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[lh]*([diuxXcs%])")
+
+
+def load_enum(root, prefix):
+    """Gets the names of an enum of Trace.h in their order, e.g. the TraceModule names"""
+    with open(os.path.join(root, "inc", "Trace.h")) as header:
+        return re.findall(r"^\s*(%s\w+)" % prefix, header.read(), re.MULTILINE)
+
+
+def load_formats(root, files):
+    """Maps (file ID, line) of every TRACE call in the source to its file and format string"""
+    formats = {}
+    owners = {}
+    for path in sorted(glob.glob(os.path.join(root, "src", "*.c"))):
+        with open(path) as source:
+            text = source.read()
+        calls = [(number, call) for number, line in enumerate(text.splitlines(), 1) for call in TRACE_CALL.finditer(line)]
+        define = TRACE_FILE.search(text)
+        if not calls:
+            continue
+        if define is None or define.group(1) not in files:
+            print("warning: %s traces without a known TRACE_FILE" % os.path.basename(path), file=sys.stderr)
+            continue
+        file_id = files.index(define.group(1))
+        if owners.setdefault(file_id, path) != path:
+            print("warning: %s is the TRACE_FILE of two files" % define.group(1), file=sys.stderr)
+        for number, call in calls:
+            formats[(file_id, number)] = (os.path.basename(path), call.group(4))
+    return formats
+
+
+def format_args(fmt, args):
+    """Formats the raw 32-bit arguments like printf would on the device"""
+    values = iter(args)
+
+    def convert(match):
+        kind = match.group(1)
+        if kind == "%":
+            return "%"
+        value = next(values, 0)
+        if kind in "di":
+            value = struct.unpack("<i", struct.pack("<I", value))[0]
+            return (match.group(0)[:-1].rstrip("lh") + "d") % value
+        if kind == "u":
+            return (match.group(0)[:-1].rstrip("lh") + "d") % value
+        if kind == "c":
+            return chr(value & 0xFF)
+        if kind == "s":
+            return "0x%08x" % value
+        return match.group(0).replace("l", "").replace("h", "") % value
+
+    return C_FORMAT.sub(convert, fmt.encode().decode("unicode_escape"))
+
+
+def parse_replies(data):
+    """Gets the trace words and the drop count out of trace_dump replies"""
+    words = []
+    dropped = 0
+    offset = 0
+    for header in REPLY_HEADER.finditer(data):
+        if header.start() < offset:
+            continue
+        dropped = int(header.group(1))
+        count = int(header.group(2))
+        start = header.end()
+        words.extend(struct.unpack("<%dI" % count, data[start:start + (count * 4)]))
+        offset = start + (count * 4)
+    return words, dropped
+
+
+def fetch(host):
+    """Asks the device for trace records until a reply holds none"""
+    data = b""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2.0)
+    while True:
+        sock.sendto(b"trace_dump", (host, PORT))
+        reply, _ = sock.recvfrom(8192)
+        data += reply
+        header = REPLY_HEADER.search(reply)
+        if header is None or int(header.group(2)) == 0:
+            return data
+
+
+def decode(words, modules, formats):
+    """Prints one line per record"""
+    index = 0
+    while index + 2 <= len(words):
+        header, time_ms = words[index], words[index + 1]
+        module = header >> 28
+        file_id = (header >> 23) & 0x1F
+        level = (header >> 20) & 0x07
+        nargs = (header >> 16) & 0x0F
+        line = header & 0xFFFF
+        args = words[index + 2:index + 2 + nargs]
+        index += 2 + nargs
+
+        name = modules[module][len("trace_module_"):] if module < len(modules) else "module%d" % module
+        source, fmt = formats.get((file_id, line), ("file%d" % file_id, "unknown trace call" + " %u" * nargs))
+        print("%10.3f %-5s %-10s %s:%d  %s" % (time_ms / 1000.0, LEVELS.get(level, str(level)), name,
+                                                source, line, format_args(fmt, args)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the binary trace of the firmware")
+    parser.add_argument("dumps", nargs="*", help="files holding saved trace_dump replies")
+    parser.add_argument("--host", help="fetch the trace from the device at this address")
+    parser.add_argument("--root", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."),
+                        help="source tree the firmware was built from")
+    options = parser.parse_args()
+
+    modules = load_enum(options.root, "trace_module_")
+    formats = load_formats(options.root, load_enum(options.root, "trace_file_"))
+
+    data = fetch(options.host) if options.host else b""
+    for path in options.dumps:
+        with open(path, "rb") as dump:
+            data += dump.read()
+
+    words, dropped = parse_replies(data)
+    decode(words, modules, formats)
+    if dropped:
+        print("%d records were dropped because the trace was full" % dropped)
+
+
+if __name__ == "__main__":
+    main()